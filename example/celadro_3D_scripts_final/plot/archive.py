@@ -37,6 +37,10 @@ class archive(archive_base.archive):
         lx, ly, lz = self.Size
         px, py, pz = self.patch_size
 
+        # phi is not in the frame files with --delta-frames
+        if not hasattr(frame, 'phi'):
+            return frame
+
         phi = []
         for i in range(len(frame.phi)):
             p = np.reshape(frame.phi[i], (pz, px, py))
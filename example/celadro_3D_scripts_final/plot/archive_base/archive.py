@@ -15,6 +15,7 @@
 
 import os
 from zipfile import ZipFile
+import base64
 import json
 import numpy as np
 
@@ -73,6 +74,18 @@ class archive:
         elif t == 'string':
             # quotes are already erased for string types
             return v
+        elif t[:7] == 'base64(':
+            # reduced precision array (see src/precision.hpp)
+            data = base64.b64decode(v)
+            leaf = t[7:-1]
+            if leaf == 'float16':
+                return np.frombuffer(data, dtype=np.float16) \
+                         .astype(np.float64)
+            elif leaf[:6] == 'fixed(':
+                offset, step, word = leaf[6:-1].split(',')
+                q = np.frombuffer(data, dtype=np.dtype(word))
+                return float(offset) + float(step)*q.astype(np.float64)
+            raise ValueError('Unrecognized type ' + t)
         elif t[:5] == 'array':
             return np.array([self.get_value(i, t[6:-1]) for i in v])
         else:
@@ -0,0 +1,48 @@
+import struct
+import numpy as np
+
+
+class contacts:
+    """
+    Reads the cell-cell contact graphs 'contacts.bin' written by the in-situ
+    analysis 'contacts'.
+
+    Every frame is a tuple (time, edges, t1) where edges is a structured array
+    with fields i, j (persistent cell ids, i < j) and weight (overlap
+    integral), and t1 is an array of T1 events (i, j, k, l), where the contact
+    i-j has been replaced by the contact k-l since the previous frame.
+    """
+    edge_dtype = np.dtype([('i', '=u4'), ('j', '=u4'), ('weight', '=f4')])
+
+    def __init__(self, filename):
+        with open(filename, 'rb') as f:
+            buf = f.read()
+        if buf[:8] != b'CELADRCN':
+            raise ValueError(filename + ' is not a contact graph file')
+        version, self.threshold = struct.unpack_from('=Id', buf, 8)
+        if version != 1:
+            raise ValueError('unsupported contact graph file version')
+
+        self.frames = []
+        pos = 20
+        while pos + 8 <= len(buf):
+            time, nedges = struct.unpack_from('=II', buf, pos)
+            pos += 8
+            edges = np.frombuffer(buf, self.edge_dtype, nedges, pos)
+            pos += 12 * nedges
+            (nevents,) = struct.unpack_from('=I', buf, pos)
+            pos += 4
+            t1 = np.frombuffer(buf, '=u4', 4 * nevents, pos).reshape(-1, 4)
+            pos += 16 * nevents
+            self.frames.append((time, edges, t1))
+
+    def times(self):
+        """Times of all the frames."""
+        return np.array([f[0] for f in self.frames])
+
+    def degrees(self, frame):
+        """Number of contacts of every cell {id -> degree} in a frame."""
+        _, edges, _ = self.frames[frame]
+        ids, counts = np.unique(np.concatenate([edges['i'], edges['j']]),
+                                return_counts=True)
+        return dict(zip(ids.tolist(), counts.tolist()))
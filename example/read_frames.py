@@ -0,0 +1,155 @@
+import struct
+import numpy as np
+
+
+def _decode(buf, pos, n, ref):
+    """
+    Decode n values XORed with their prediction ref (previous value if ref is
+    None) starting at buf[pos].
+    """
+    values = np.empty(n)
+    prev = 0
+    k = 0
+    while k < n:
+        ctrl = buf[pos]
+        pos += 1
+        if ctrl == 0xff:
+            # run of exact predictions
+            r, shift = 0, 0
+            while True:
+                b = buf[pos]
+                pos += 1
+                r |= (b & 0x7f) << shift
+                shift += 7
+                if not b & 0x80:
+                    break
+            for _ in range(r):
+                if ref is not None:
+                    values[k] = ref[k]
+                else:
+                    values[k] = struct.unpack('=d', struct.pack('=Q', prev))[0]
+                k += 1
+            continue
+        lead, trail = ctrl >> 4, ctrl & 0x0f
+        x = 0
+        for i in range(trail, 8 - lead):
+            x |= buf[pos] << (8 * i)
+            pos += 1
+        if ref is not None:
+            x ^= struct.unpack('=Q', struct.pack('=d', ref[k]))[0]
+        else:
+            x ^= prev
+        prev = x
+        values[k] = struct.unpack('=d', struct.pack('=Q', x))[0]
+        k += 1
+    return values, pos
+
+
+class frames:
+    """
+    Reads the delta-encoded archive 'frames.bin' of the phase and stress fields
+    written with the option --delta-frames.
+
+    Frames are reconstructed by replaying from the nearest keyframe. The last
+    decoded frame is kept, such that reading frames in order is cheap. The
+    fields are returned in the same memory layout as in the json frames.
+    """
+    stress_names = ['field_sxx', 'field_syy', 'field_szz',
+                    'field_sxy', 'field_sxz', 'field_syz']
+
+    def __init__(self, filename):
+        self._f = open(filename, 'rb')
+        if self._f.read(8) != b'CELADRDF':
+            raise ValueError(filename + ' is not a delta archive')
+        (version,) = struct.unpack('=I', self._f.read(4))
+        if version != 1:
+            raise ValueError('unsupported delta archive version')
+        self.Size = struct.unpack('=3I', self._f.read(12))
+        self.patch_size = struct.unpack('=3I', self._f.read(12))
+        (self.interval,) = struct.unpack('=I', self._f.read(4))
+
+        # scan frames, skipping the data sections
+        self._frames = []
+        while True:
+            pos = self._f.tell()
+            buf = self._f.read(17)
+            if len(buf) < 17:
+                break
+            time, key, ncells, size = struct.unpack('=IBIQ', buf)
+            self._frames.append((pos, time, key))
+            self._f.seek(28 * ncells + size, 1)
+        self.times = [t for _, t, _ in self._frames]
+
+        self._last = None
+        self._current = -1
+
+    def _predict(self, prev, pmin, off, cid):
+        """Phi of cell cid in frame prev, at the nodes of the current patch."""
+        px, py, pz = self.patch_size
+        m = prev['ids'].index(cid)
+        q = np.arange(px * py * pz)
+        qpos = [(q // py) % px, q % py, q // (px * py)]
+        p = []
+        inside = np.ones(len(q), dtype=bool)
+        for d in range(3):
+            x = ((qpos[d] + off[d]) % self.patch_size[d] + pmin[d]) \
+                % self.Size[d]
+            y = (x + self.Size[d] - prev['patch_min'][m][d]) % self.Size[d]
+            inside &= y < self.patch_size[d]
+            p.append((y + self.patch_size[d] - prev['offset'][m][d])
+                     % self.patch_size[d])
+        pred = np.zeros(len(q))
+        idx = p[1] + py * p[0] + px * py * p[2]
+        pred[inside] = prev['phi'][m][idx[inside]]
+        return pred
+
+    def _decode_frame(self, i):
+        pos, time, key = self._frames[i]
+        self._f.seek(pos)
+        time, key, ncells, size = struct.unpack('=IBIQ', self._f.read(17))
+        frame = {'time': time, 'ids': [], 'patch_min': [], 'offset': []}
+        for n in range(ncells):
+            c = struct.unpack('=7I', self._f.read(28))
+            frame['ids'].append(c[0])
+            frame['patch_min'].append(c[1:4])
+            frame['offset'].append(c[4:7])
+        buf = self._f.read(size)
+
+        prev = self._last if not key else None
+        patch_N = int(np.prod(self.patch_size))
+        N = int(np.prod(self.Size))
+        pos = 0
+        frame['phi'] = []
+        for n in range(ncells):
+            ref = None
+            if prev is not None and frame['ids'][n] in prev['ids']:
+                ref = self._predict(prev, frame['patch_min'][n],
+                                    frame['offset'][n], frame['ids'][n])
+            phi, pos = _decode(buf, pos, patch_N, ref)
+            frame['phi'].append(phi)
+        for name in self.stress_names:
+            ref = prev[name] if prev is not None else None
+            frame[name], pos = _decode(buf, pos, N, ref)
+
+        self._last = frame
+        self._current = i
+
+    def read_frame(self, i):
+        """
+        Returns frame i as a dictionary with keys time, ids (persistent cell
+        ids), patch_min, offset, phi and the stress fields.
+        """
+        if i == self._current:
+            return self._last
+        # nearest keyframe, or continue from the last decoded frame
+        k = i
+        while not self._frames[k][2]:
+            k -= 1
+        start = self._current + 1 if k <= self._current < i else k
+        for j in range(start, i + 1):
+            self._decode_frame(j)
+        return self._last
+
+    def read_time(self, t):
+        """Returns frame at time t."""
+        return self.read_frame(self.times.index(t))
@@ -0,0 +1,83 @@
+import struct
+import numpy as np
+
+
+def _decode_xor(buf, pos, n):
+    """Decode n XOR-compressed doubles starting at buf[pos]."""
+    values = np.empty(n)
+    prev = 0
+    for k in range(n):
+        ctrl = buf[pos]
+        pos += 1
+        lead, trail = ctrl >> 4, ctrl & 0x0f
+        x = 0
+        for i in range(trail, 8 - lead):
+            x |= buf[pos] << (8 * i)
+            pos += 1
+        prev ^= x
+        values[k] = struct.unpack('=d', struct.pack('=Q', prev))[0]
+    return values, pos
+
+
+class timeseries:
+    """
+    Reads the columnar per-cell time-series store 'timeseries.bin' written
+    with the option --timeseries.
+
+    Only the chunk indices are read when opening the file, such that the
+    trajectory of a single cell can be obtained without reading the data of
+    the other cells.
+    """
+    def __init__(self, filename):
+        self._f = open(filename, 'rb')
+        if self._f.read(8) != b'CELADRTS':
+            raise ValueError(filename + ' is not a time-series file')
+        version, ncols = struct.unpack('=II', self._f.read(8))
+        if version != 1:
+            raise ValueError('unsupported time-series file version')
+        self.columns = []
+        for c in range(ncols):
+            (n,) = struct.unpack('=B', self._f.read(1))
+            self.columns.append(self._f.read(n).decode())
+
+        # scan chunks, skipping the data sections
+        self._chunks = []
+        while True:
+            buf = self._f.read(16)
+            if len(buf) < 16:
+                break
+            nframes, ncells, size = struct.unpack('=IIQ', buf)
+            times = struct.unpack('=%dI' % nframes, self._f.read(4 * nframes))
+            cells = {}
+            for i in range(ncells):
+                cid, first, count, offset, bsize = \
+                    struct.unpack('=IIIQI', self._f.read(24))
+                cells[cid] = (first, count, offset, bsize)
+            data = self._f.tell()
+            self._f.seek(size, 1)
+            self._chunks.append((data, times, cells))
+
+    def cells(self):
+        """Persistent ids of all the cells in the file."""
+        return sorted({c for _, _, cells in self._chunks for c in cells})
+
+    def read_cell(self, cid):
+        """
+        Returns (time, data) for cell with persistent id cid, where data is a
+        dictionary {column name -> np.array}.
+        """
+        time = []
+        data = {c: [] for c in self.columns}
+        for start, times, cells in self._chunks:
+            if cid not in cells:
+                continue
+            first, count, offset, bsize = cells[cid]
+            self._f.seek(start + offset)
+            buf = self._f.read(bsize)
+            pos = 0
+            for c in self.columns:
+                values, pos = _decode_xor(buf, pos, count)
+                data[c].append(values)
+            time.extend(times[first:first + count])
+        return np.array(time), {c: np.concatenate(v) if v else np.array([])
+                                for c, v in data.items()}
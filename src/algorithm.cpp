@@ -0,0 +1,372 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "header.hpp"
+#include "model.hpp"
+
+using namespace std;
+
+// =============================================================================
+
+void Model::Advance(unsigned nt)
+{
+  for(unsigned s=0; s<nt*nsubsteps; ++s)
+  {
+    // first sweeps produces estimate of values
+    // subsequent sweeps produce corrected values
+    for(unsigned i=0; i<=npc; ++i){
+      Update(i==0,i==npc,globalT);
+      globalT++;
+    }
+
+    // runtime checks every check_every time steps
+    if(check_every and (runtime_check or runtime_stats)
+       and globalT%(check_every*nsubsteps*(npc+1))==0)
+      Diagnose();
+
+    // in-situ analyses at the end of every time step
+    if(!analyses.empty() and globalT%(nsubsteps*(npc+1))==0)
+      Analyse(globalT/(nsubsteps*(npc+1)));
+
+    // replays are checked against the checkpoints of the original run
+    if(replay and globalT%(nsubsteps*checkpoint_every*(npc+1))==0)
+      CheckReplay(globalT/(nsubsteps*(npc+1)));
+  }
+}
+
+void Model::Algorithm()
+{
+  // visTMP(999);
+
+  // initial state (when replaying, done in Advance() at the window start)
+  if(!analyses.empty()) Analyse(start_time);
+
+  // when replaying, run from the restored checkpoint to the window
+  if(replay and start_time<nstart)
+  {
+    if(verbose) cout << "replay from t = " << start_time << " to "
+                     << nstart << " ..." << flush;
+    Advance(nstart-start_time);
+    GetFromDevice();
+    start_time = nstart;
+    if(verbose) cout << " done" << endl;
+  }
+
+  for(unsigned t=start_time; t<nsteps; t+=ninfo)
+  {
+    // full state checkpoint
+    if(checkpoint_every and !replay and t%checkpoint_every==0)
+    {
+      scoped_timer stage_timer(timers, stage::write);
+      WriteCheckpoint(t);
+    }
+
+    if(!no_write and t>=nstart)
+    {
+      const auto start = chrono::steady_clock::now();
+      scoped_timer stage_timer(timers, stage::write);
+
+      try
+      {
+       WriteFrame(t);
+       if(delta_frames) WriteDeltaFrame(t);
+        // Write_OU(t);
+        // print_new_cell_props();
+        if (proliferate_bool) write_cellHist_binary("cellHist.bin", t, cellHist);
+       Write_COM(t);
+       if(write_timeseries) Write_timeseries(t);
+       //Write_visData(t);
+	//Write_velocities(t);  
+	//Write_forces(t);  	
+  	//Write_contArea(t);
+  	//Write_Density(t);
+
+      }
+      catch(...) {
+        cerr << "error" << endl;
+        throw;
+      }
+
+      write_duration += chrono::steady_clock::now() - start;
+    }
+
+    // live frames (independent of the file output)
+    if(!shm_name.empty())
+    {
+      scoped_timer stage_timer(timers, stage::write);
+      PublishFrame(t);
+    }
+
+    // some verbose
+    if(verbose>1) cout << '\n';
+    
+    if(verbose)
+      cout << "timesteps t = " << setw(pad) << setfill(' ') << right
+                                 << t << " to "
+                                 << setw(pad) << setfill(' ') << right
+                                 << t+ninfo << endl;
+    if(verbose>1) cout << string(width, '-') << endl;
+
+    // do the computation
+    Advance(ninfo);
+
+
+    // get data from device to host memory
+    GetFromDevice();
+    timers.end_streak(t+ninfo);
+    counters.end_interval(t+ninfo);
+
+    // runtime stats and checks (done in Advance() with --check-every)
+    if((runtime_check or runtime_stats) and !check_every) Diagnose();
+    if(runtime_stats and verbose>1) RuntimeStats();
+  }
+
+  // finally write final frame
+  scoped_timer stage_timer(timers, stage::write);
+  if(!no_write and nsteps>=nstart) WriteFrame(nsteps);
+  if(delta_frames and !no_write and nsteps>=nstart) WriteDeltaFrame(nsteps);
+  if(delta_frames) CloseDeltaFrames();
+  // if(!no_write and nsteps>=nstart) Write_OU(nsteps);
+  if (proliferate_bool and !no_write and nsteps >= nstart) write_cellHist_binary("cellHist.bin", nsteps, cellHist);
+  if(!no_write and nsteps>=nstart) Write_COM(nsteps);	
+  if(write_timeseries and !no_write and nsteps>=nstart) Write_timeseries(nsteps);
+  if(write_timeseries) CloseTimeSeries();
+  if(!analyses.empty()) CloseAnalyses();
+  if(!shm_name.empty()) PublishFrame(nsteps);
+  if(!shm_name.empty()) ClosePublisher();
+
+  if(replay and verbose)
+  {
+    if(replay_checks)
+      cout << "replay checked against " << replay_checks << " checkpoint(s) "
+           << "of the original run: largest difference " << replay_error
+           << " (tolerance " << replay_tolerance << ")" << endl;
+    else
+      cout << "warning: no checkpoint of the original run within the "
+           << "window, the replay was not checked" << endl;
+  }
+  // if(!no_write and nsteps>=nstart) Write_velocities(nsteps);	
+  //if(!no_write and nsteps>=nstart) Write_forces(nsteps);
+  //if(!no_write and nsteps>=nstart) Write_contArea(nsteps);
+  //if(!no_write and nsteps>=nstart) Write_Density(nsteps);
+	
+
+}
+
+
+// -----------------------------------------------------------------------------
+// simulation set-up 
+// -----------------------------------------------------------------------------
+void Model::Setup(int argc, char **argv)
+{
+
+  if(argc<2) throw error_msg("no argument provided. Type -h for help.");
+  // parse program options
+
+  ParseProgramOptions(argc, argv);
+  // dry run (nothing is set up, the program stops)
+  if(plan)
+  {
+    PrintMemoryPlan();
+    return;
+  }
+  // check that we have a run name
+  if(runname.empty())
+    throw error_msg("please specify a file path for this run.");
+  // print simulation parameters
+  if(verbose)
+  {
+    cout << "Run parameters" << endl;
+    cout << string(width, '=') << endl;
+    PrintProgramOptions();
+  }
+
+  SetupModel();
+}
+
+void Model::SetupModel()
+{
+  if(!trace_file.empty()) trace::start(trace_size);
+  scoped_timer stage_timer(timers, stage::setup);
+
+  // Initialization
+  if(verbose) cout << endl << "Initialization" << endl << string(width, '=')
+                   << endl;
+
+  // warning and flags
+  // no output
+  if(no_write and verbose) cout << "warning: output is not enabled." << endl;
+
+  // model init
+  if(verbose) cout << "model initialization ..." << flush;
+  try {
+    InitializeRandomNumbers();
+    Initialize();
+  } catch(...) {
+    if(verbose) cout << " error" << endl;
+    throw;
+  }
+  if(verbose) cout << " done" << endl;
+
+  // branches share the set-up above and continue from the checkpoint, each in
+  // its own process (neither the CUDA context nor the OpenMP thread pool can be
+  // shared across a fork: no parallel region may run before), the parent has
+  // nothing left to do
+  if(!branch_args.empty() and !ForkBranches()) return;
+
+  // parameters init
+  if(verbose) cout << "system initialisation ..." << flush;
+  try {
+    InitializeNeighbors();
+    // the generated configurations avoid the walls (both are restored from the
+    // checkpoint in a branch)
+    if(branch<0)
+    {
+      ConfigureWalls(BC);
+      Configure();
+    }
+  } catch(...) {
+    if(verbose) cout << " error" << endl;
+    throw;
+  }
+  if(verbose) cout << " done" << endl;
+
+  // cuda set-up 
+
+    if(verbose) cout << "setting up CUDA devices ..." << endl;
+    QueryDeviceProperties();
+    InitializeCuda();
+
+    if(roofline)
+    {
+      if(verbose) cout << "... measure the peak of the device ..." << flush;
+      peak = measure_device_peak();
+      if(verbose) cout << " done" << endl;
+    }
+
+    if(verbose) cout << "... allocate device memory ...";
+    AllocDeviceMemory();
+    if(verbose) cout << " done" << endl;
+
+    if(verbose) cout << "... random numbers initialization ..." << flush;
+    InitializeCUDARandomNumbers();
+    if(verbose) cout << " done" << endl;
+
+    if(verbose) cout << "... copy data to device ...";
+    PutToDevice();
+    if(verbose) cout << " done" << endl;
+
+  // write params to file
+  if(!no_write)
+  {
+    if(verbose) cout << "create output directory " << " ...";
+    try {
+      CreateOutputDir();
+    } catch(...) {
+      if(verbose) cout << " error" << endl;
+      throw;
+    }
+    if(verbose) cout << " done" << endl;
+
+
+    if(verbose and compress_full)
+      cout << "create output file " << runname << ".zip ...";
+    if(verbose and not compress_full)
+      cout << "write parameters ...";
+
+    try {
+      WriteParams();
+    } catch(...) {
+      if(verbose) cout << " error" << endl;
+      throw;
+    }
+    if(verbose) cout << " done" << endl;
+  }
+
+  // stats stream (independent of the output)
+  if(!counters_file.empty()) counters.open(counters_file);
+
+  // checkpoints (done last as the output set-up may use random numbers)
+  if(replay) LoadCheckpoint();
+  else if(checkpoint_every) params_hash = ParametersHash();
+}
+
+// -----------------------------------------------------------------------------
+// runs the simulation
+// -----------------------------------------------------------------------------
+void Model::Run()
+{
+  // preparation
+  if(verbose)   cout << "preparation ... " << flush;
+  // pre-run
+  // Write_visData(999);
+  // (the relaxation is part of the restored state when replaying or branching)
+  if(!replay and branch<0) Pre();//to be revisited*/
+  // Write_visData(1000);
+  if(verbose) cout << " done" << endl;
+  if(verbose) cout << endl << "Run" << endl << string(width, '=') << "\n\n";
+  // print some stats
+  PreRunStats();
+  // record starting time
+  const auto start = chrono::steady_clock::now();
+  Algorithm();
+  // record end time	
+  const auto duration = chrono::steady_clock::now() - start;
+
+  if(verbose) cout << "post-processing ... " << flush;
+  Post();
+  if(verbose) cout << "done" << endl;
+
+  if(verbose)
+  {
+    cout << endl << "Statistics" << endl << string(width, '=') << endl;
+    cout << "Total run time :                    "
+         << chrono::duration_cast<chrono::milliseconds>(duration).count()
+            /1000. << " s" << endl;
+    cout << "Total time spent writing output :   "
+         << chrono::duration_cast<chrono::milliseconds>(write_duration).count()
+            /1000. << " s" << endl;
+    cout << "Peak memory :                       "
+         << memory_high_host/1048576. << " MB host, "
+         << memory_high_device/1048576. << " MB device ("
+         << memory_high_nphases << " cells)" << endl;
+    cout << "Time spent in each stage :" << endl;
+    timers.print(cout);
+    if(roofline)
+    {
+      cout << "Efficiency of each stage :" << endl;
+      costs.print(cout, timers.total, peak);
+    }
+    cout << "Transfers and events :" << endl;
+    counters.print(cout);
+    if(diag_run.count)
+    {
+      cout << "Runtime diagnostics (worst values) :" << endl;
+      diag_run.print(cout);
+    }
+  }
+
+  if(!timings_file.empty()) timers.write_json(timings_file);
+  if(!trace_file.empty()) trace::write(trace_file);
+}
+
+// -----------------------------------------------------------------------------
+// host memory clean-up 
+// -----------------------------------------------------------------------------
+void Model::Cleanup()
+{
+FreeDeviceMemory();
+}
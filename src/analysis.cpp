@@ -0,0 +1,110 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "header.hpp"
+#include "model.hpp"
+#include "files.hpp"
+#include "analysis.hpp"
+#include "timeseries.hpp"
+
+using namespace std;
+
+void Model::ParseAnalysisOptions()
+{
+  analyses.clear();
+
+  for(const auto& line : analysis_args)
+  {
+    // NAME key=value ...
+    istringstream args(line);
+    analysis_slot a;
+    if(!(args >> a.name)) continue;
+
+    a.plugin = make_analysis(a.name);
+    if(!a.plugin)
+    {
+      string names;
+      for(const auto& n : analysis_names()) names += " " + n;
+      throw error_msg("unknown analysis '", a.name, "' (available:", names, ").");
+    }
+    for(const auto& b : analyses)
+      if(b.name==a.name)
+        throw error_msg("analysis '", a.name, "' is selected twice.");
+
+    a.span_name = trace::intern(a.name);
+    a.every = ninfo;
+    string arg;
+    while(args >> arg)
+    {
+      const auto pos = arg.find('=');
+      if(pos==string::npos)
+        throw error_msg("arguments of analysis '", a.name,
+                        "' must be of the form key=value.");
+      const string key = arg.substr(0, pos), value = arg.substr(pos+1);
+
+      if(key=="every") a.every = stoul(value);
+      else if(!a.plugin->set(key, value))
+        throw error_msg("unknown argument '", key, "' of analysis '", a.name, "'.");
+    }
+    if(a.every==0)
+      throw error_msg("analysis '", a.name, "' needs every > 0.");
+
+    analyses.push_back(move(a));
+  }
+}
+
+void Model::Analyse(unsigned t)
+{
+  if(no_write or t<nstart) return;
+
+  scoped_timer stage_timer(timers, stage::analysis);
+  for(auto& a : analyses)
+  {
+    if(t%a.every) continue;
+    trace::span span(a.span_name, "analysis");
+
+    const string oname = inline_str(output_dir, "analysis_", a.name, ".bin");
+    if(!a.out)
+    {
+      a.out = make_shared<tswriter>(oname, a.plugin->columns(), timeseries_chunk);
+      counters.add(counter::files_opened);
+    }
+    counted_file counted(counters, oname, counted_file::mode::stream);
+
+    a.out->new_frame(t);
+    a.plugin->compute(*this, t, *a.out);
+  }
+}
+
+void Model::CloseAnalyses()
+{
+  for(auto& a : analyses)
+  {
+    // device buffers are released before the device memory of the model
+    a.plugin.reset();
+    if(!a.out) continue;
+
+    const string oname = inline_str(output_dir, "analysis_", a.name, ".bin");
+    {
+      // the destructor writes the last chunk
+      counted_file counted(counters, oname, counted_file::mode::stream);
+      a.out.reset();
+    }
+
+    if(compress) compress_file(oname, oname);
+    if(compress_full) compress_file(oname, runname);
+  }
+}
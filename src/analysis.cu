@@ -0,0 +1,540 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "header.hpp"
+#include "model.hpp"
+#include "analysis.hpp"
+#include "timeseries.hpp"
+#include "contacts.hpp"
+#include "memory.hpp"
+#include "cuda.h"
+#include <map>
+
+using namespace std;
+
+/** Threads per block of the layer sums (power of two) */
+#define LayerThreads 256
+/** Threads per block of the overlap integrals (power of two) */
+#define ContactThreads 256
+
+// =============================================================================
+// Registry
+
+/** Registered analyses (constructed on first use, see REGISTER_ANALYSIS) */
+static map<string, analysis_factory>& analysis_registry()
+{
+  static map<string, analysis_factory> registry;
+  return registry;
+}
+
+bool register_analysis(const string& name, analysis_factory factory)
+{
+  return analysis_registry().emplace(name, move(factory)).second;
+}
+
+unique_ptr<analysis> make_analysis(const string& name)
+{
+  const auto it = analysis_registry().find(name);
+  if(it==analysis_registry().end()) return nullptr;
+  return it->second();
+}
+
+vector<string> analysis_names()
+{
+  vector<string> names;
+  for(const auto& a : analysis_registry()) names.push_back(a.first);
+  return names;
+}
+
+// =============================================================================
+// Layers above the substrate
+
+/** Sum of phi^2 of cell blockIdx.x in the plane z = z0 + blockIdx.y
+  *
+  * The plane is a contiguous slab of the patch, which is read in place.
+  * */
+__global__
+void cuLayerSums(const double *phi,
+                 const coord *patch_min,
+                 const coord *offset,
+                 coord patch_size,
+                 coord Size,
+                 unsigned patch_N,
+                 unsigned z0,
+                 double *out)
+{
+	__shared__ double s_sum[LayerThreads];
+
+	const unsigned n = blockIdx.x;
+	const unsigned l = blockIdx.y;
+	const unsigned i = threadIdx.x;
+
+	// height of the plane relative to the patch, with the memory offset
+	const unsigned z  = (z0 + l)%Size[2];
+	const unsigned pz = (z + Size[2] - patch_min[n][2])%Size[2];
+
+	double sum = 0;
+	if(pz<patch_size[2])
+	{
+		const unsigned qz    = (pz + patch_size[2] - offset[n][2])%patch_size[2];
+		const unsigned slab  = patch_size[0]*patch_size[1];
+		const double  *plane = phi + size_t(n)*patch_N + size_t(qz)*slab;
+		for(unsigned q=i; q<slab; q+=blockDim.x)
+			sum += plane[q]*plane[q];
+	}
+
+	s_sum[i] = sum;
+	__syncthreads();
+
+	for(unsigned s=blockDim.x/2; s>0; s/=2)
+	{
+		if(i<s) s_sum[i] += s_sum[i+s];
+		__syncthreads();
+	}
+
+	if(i==0) out[n*gridDim.y + l] = s_sum[0];
+}
+
+namespace
+{
+  /** Base of the analyses of the layers z0, z0+1, ... above the substrate */
+  class layer_analysis : public analysis
+  {
+    double *d_sums = nullptr;
+    size_t capacity = 0;
+
+  protected:
+    /** First plane (wall_thickness if negative) and number of planes */
+    int z0 = -1;
+    unsigned layers = 3;
+
+    /** Per-cell sums of phi^2 over each layer (ncells x layers) */
+    vector<double> sums;
+
+    void compute_sums(Model& model)
+    {
+      const unsigned ncells = model.nphases_index.size();
+      const size_t size = size_t(ncells)*layers;
+      if(capacity<size)
+      {
+        device_free(d_sums);
+        if(!device_malloc(d_sums, size))
+          throw error_msg("can not allocate the device memory of the analysis.");
+        capacity = size;
+        model.TrackMemory("analysis");
+      }
+
+      sums.resize(size);
+      if(ncells==0) return;
+
+      const unsigned z = z0<0 ? unsigned(lround(model.wall_thickness)) : z0;
+      cuLayerSums<<<dim3(ncells, layers), LayerThreads>>>(model.d_phi,
+                                                          model.d_patch_min,
+                                                          model.d_offset,
+                                                          model.patch_size,
+                                                          model.Size,
+                                                          model.patch_N,
+                                                          z,
+                                                          d_sums);
+
+      cudaError_t err = cudaGetLastError();
+      if (err != cudaSuccess)
+        throw error_msg("cuLayerSums launch error: ", cudaGetErrorString(err));
+
+      cudaMemcpy(sums.data(), d_sums, size*sizeof(double), cudaMemcpyDeviceToHost);
+      model.counters.add(counter::bytes_from_device, size*sizeof(double));
+    }
+
+  public:
+    ~layer_analysis()
+    { device_free(d_sums); }
+
+    bool set(const string& key, const string& value) override
+    {
+      if(key=="z0")          z0 = stoi(value);
+      else if(key=="layers") layers = stoul(value);
+      else return false;
+
+      if(layers==0 or layers>65535)
+        throw error_msg("the number of layers must be between 1 and 65535.");
+      return true;
+    }
+  };
+
+  /** Contact area of every cell with the substrate (see Write_contArea)
+    *
+    * Columns: sum of phi^2 over each layer, and volume.
+    * */
+  class contact_area : public layer_analysis
+  {
+  public:
+    vector<string> columns() const override
+    {
+      vector<string> names;
+      for(unsigned l=0; l<layers; ++l) names.push_back(inline_str("area_", l));
+      names.push_back("vol");
+      return names;
+    }
+
+    void compute(Model& model, unsigned, tswriter& out) override
+    {
+      compute_sums(model);
+
+      const unsigned ncells = model.nphases_index.size();
+      vector<double> vol(ncells);
+      cudaMemcpy(vol.data(), model.d_vol, ncells*sizeof(double),
+                 cudaMemcpyDeviceToHost);
+      model.counters.add(counter::bytes_from_device, ncells*sizeof(double));
+
+      vector<double> values(layers+1);
+      for(unsigned n=0; n<ncells; ++n)
+      {
+        copy_n(&sums[size_t(n)*layers], layers, values.begin());
+        values[layers] = vol[n];
+        out.add(model.nphases_index[n], values.data());
+      }
+    }
+  };
+
+  /** Density of the tissue in the layers above the substrate (see
+    * Write_Density)
+    *
+    * A single row (id 0): sum of phi^2 of all cells over each layer, divided
+    * by the area of the domain.
+    * */
+  class density : public layer_analysis
+  {
+  public:
+    vector<string> columns() const override
+    {
+      vector<string> names;
+      for(unsigned l=0; l<layers; ++l) names.push_back(inline_str("density_", l));
+      return names;
+    }
+
+    void compute(Model& model, unsigned, tswriter& out) override
+    {
+      compute_sums(model);
+
+      vector<double> values(layers, 0.);
+      for(unsigned n=0; n<model.nphases_index.size(); ++n)
+        for(unsigned l=0; l<layers; ++l)
+          values[l] += sums[size_t(n)*layers + l];
+      for(auto& v : values) v /= double(model.Size[0])*model.Size[1];
+      out.add(0, values.data());
+    }
+  };
+
+  /** Mean squared displacement of the cells
+    *
+    * A single row (id 0): msd and number of cells averaged over. Cells are
+    * followed from the first evaluation after their birth, and the centers of
+    * mass are unwrapped with the nearest image between two evaluations (the
+    * cadence must be short enough for a cell to move by less than half the
+    * domain).
+    * */
+  class msd : public analysis
+  {
+    /** Initial and last unwrapped position of each cell (persistent id) */
+    map<unsigned, pair<vec<double, 3>, vec<double, 3>>> tracks;
+
+  public:
+    vector<string> columns() const override
+    { return { "msd", "ncells" }; }
+
+    void compute(Model& model, unsigned, tswriter& out) override
+    {
+      const unsigned ncells = model.nphases_index.size();
+      vector<vec<double, 3>> com(ncells);
+      cudaMemcpy(com.data(), model.d_com, ncells*sizeof(vec<double, 3>),
+                 cudaMemcpyDeviceToHost);
+      model.counters.add(counter::bytes_from_device, ncells*sizeof(vec<double, 3>));
+
+      decltype(tracks) current;
+      double sum = 0;
+      unsigned count = 0;
+      for(unsigned n=0; n<ncells; ++n)
+      {
+        const unsigned id = model.nphases_index[n];
+        const auto it = tracks.find(id);
+        if(it==tracks.end())
+        {
+          current[id] = { com[n], com[n] };
+          continue;
+        }
+
+        auto track = it->second;
+        vec<double, 3> delta = com[n] - track.second;
+        for(unsigned d=0; d<3; ++d)
+          delta[d] -= model.Size[d]*round(delta[d]/model.Size[d]);
+        track.second = track.second + delta;
+
+        const vec<double, 3> r = track.second - track.first;
+        sum += r[0]*r[0] + r[1]*r[1] + r[2]*r[2];
+        current[id] = track;
+        ++count;
+      }
+
+      // dead cells are forgotten
+      tracks.swap(current);
+
+      const double values[] = { count ? sum/count : 0., double(count) };
+      out.add(0, values);
+    }
+  };
+}
+
+// =============================================================================
+// Contact network
+
+/** Overlap integral of phi_i*phi_j for the pair of cells blockIdx.x
+  *
+  * The patch of cell i is traversed and the nodes which are also on the patch
+  * of j are looked up there, with both memory offsets.
+  * */
+__global__
+void cuOverlaps(const double *phi,
+                const coord *patch_min,
+                const coord *offset,
+                coord patch_size,
+                coord Size,
+                unsigned patch_N,
+                const unsigned *pairs,
+                double *out)
+{
+	__shared__ double s_sum[ContactThreads];
+
+	const unsigned i = pairs[2*blockIdx.x];
+	const unsigned j = pairs[2*blockIdx.x+1];
+	const unsigned t = threadIdx.x;
+
+	// position of the patch of j relative to the patch of i
+	const coord delta = ( patch_min[j] + Size - patch_min[i] )%Size;
+
+	double sum = 0;
+	for(unsigned q=t; q<patch_N; q+=blockDim.x)
+	{
+		const coord qpos = { (q/patch_size[1])%patch_size[0] , q%patch_size[1]  , q/( patch_size[0]*patch_size[1] ) };
+		// position relative to the patch of i, and then of j
+		const coord pi = ( qpos + offset[i] )%patch_size;
+		const coord pj = ( pi + Size - delta )%Size;
+		if(pj[0]>=patch_size[0] or pj[1]>=patch_size[1] or pj[2]>=patch_size[2]) continue;
+
+		const coord qj = ( pj + patch_size - offset[j] )%patch_size;
+		const unsigned r = qj[1] + patch_size[1]*qj[0] + patch_size[0]*patch_size[1]*qj[2];
+		sum += phi[size_t(i)*patch_N + q]*phi[size_t(j)*patch_N + r];
+	}
+
+	s_sum[t] = sum;
+	__syncthreads();
+
+	for(unsigned s=blockDim.x/2; s>0; s/=2)
+	{
+		if(t<s) s_sum[t] += s_sum[t+s];
+		__syncthreads();
+	}
+
+	if(t==0) out[blockIdx.x] = s_sum[0];
+}
+
+namespace
+{
+  /** Cell-cell contact graph and T1 events (see contacts.hpp)
+    *
+    * The graphs are written to contacts.bin, and a single row (id 0) with the
+    * number of edges, the mean number of contacts per cell and the number of
+    * T1 events since the previous evaluation to the store.
+    *
+    * Only the pairs of cells with overlapping patches are integrated. These are
+    * found with a uniform grid of buckets, at least as large as the patches,
+    * over the centers of mass: the patches are centered on the nearest node.
+    * */
+  class contacts : public analysis
+  {
+    double threshold = 1.;
+
+    /** Candidate pairs (slot indices) and their overlaps on the device */
+    unsigned *d_pairs = nullptr;
+    double *d_overlaps = nullptr;
+    size_t capacity = 0;
+
+    /** Graph at the previous evaluation */
+    vector<contact_edge> last;
+    unique_ptr<contact_writer> writer;
+
+    /** Pairs of cells whose patches overlap */
+    vector<unsigned> candidates(const Model& model,
+                                const vector<vec<double, 3>>& com) const
+    {
+      const unsigned ncells = com.size();
+      const auto& Size = model.Size;
+      const auto& patch_size = model.patch_size;
+
+      // node on which the patch is centered (see cuUpdateAtCell)
+      vector<coord> center(ncells);
+      for(unsigned n=0; n<ncells; ++n)
+        for(unsigned d=0; d<3; ++d)
+          center[n][d] = unsigned(round(com[n][d]))%Size[d];
+
+      array<unsigned, 3> nb;
+      for(unsigned d=0; d<3; ++d) nb[d] = max(1u, Size[d]/patch_size[d]);
+      const auto bucket = [&](const coord& c, unsigned d) {
+        return min(nb[d]-1, unsigned(size_t(c[d])*nb[d]/Size[d]));
+      };
+
+      vector<vector<unsigned>> buckets(size_t(nb[0])*nb[1]*nb[2]);
+      for(unsigned n=0; n<ncells; ++n)
+        buckets[bucket(center[n], 0)
+                + nb[0]*(bucket(center[n], 1) + size_t(nb[1])*bucket(center[n], 2))
+               ].push_back(n);
+
+      vector<unsigned> pairs;
+      for(unsigned n=0; n<ncells; ++n)
+      {
+        // distinct neighbouring buckets (fewer than 3 along small dimensions)
+        array<vector<unsigned>, 3> around;
+        for(unsigned d=0; d<3; ++d)
+        {
+          const unsigned b = bucket(center[n], d);
+          for(const unsigned o : { nb[d]-1, 0u, 1u })
+            around[d].push_back((b+o)%nb[d]);
+          sort(around[d].begin(), around[d].end());
+          around[d].erase(unique(around[d].begin(), around[d].end()), around[d].end());
+        }
+
+        for(const auto bx : around[0])
+        for(const auto by : around[1])
+        for(const auto bz : around[2])
+        for(const auto m : buckets[bx + nb[0]*(by + size_t(nb[1])*bz)])
+        {
+          if(m<=n) continue;
+
+          bool overlap = true;
+          for(unsigned d=0; d<3; ++d)
+          {
+            const unsigned delta = (center[m][d] + Size[d] - center[n][d])%Size[d];
+            overlap = overlap and (delta<patch_size[d] or Size[d]-delta<patch_size[d]);
+          }
+          if(!overlap) continue;
+
+          pairs.push_back(n);
+          pairs.push_back(m);
+        }
+      }
+      return pairs;
+    }
+
+  public:
+    ~contacts()
+    {
+      device_free(d_pairs);
+      device_free(d_overlaps);
+    }
+
+    vector<string> columns() const override
+    { return { "edges", "mean_degree", "t1" }; }
+
+    bool set(const string& key, const string& value) override
+    {
+      if(key!="threshold") return false;
+      threshold = stod(value);
+      return true;
+    }
+
+    void compute(Model& model, unsigned t, tswriter& out) override
+    {
+      const unsigned ncells = model.nphases_index.size();
+      vector<vec<double, 3>> com(ncells);
+      cudaMemcpy(com.data(), model.d_com, ncells*sizeof(vec<double, 3>),
+                 cudaMemcpyDeviceToHost);
+      model.counters.add(counter::bytes_from_device, ncells*sizeof(vec<double, 3>));
+
+      const auto pairs = candidates(model, com);
+      const size_t npairs = pairs.size()/2;
+
+      vector<double> overlaps(npairs);
+      if(npairs)
+      {
+        if(capacity<npairs)
+        {
+          device_free(d_pairs);
+          device_free(d_overlaps);
+          if(!device_malloc(d_pairs, 2*npairs) or !device_malloc(d_overlaps, npairs))
+            throw error_msg("can not allocate the device memory of the contacts.");
+          capacity = npairs;
+          model.TrackMemory("contacts");
+        }
+
+        cudaMemcpy(d_pairs, pairs.data(), 2*npairs*sizeof(unsigned),
+                   cudaMemcpyHostToDevice);
+        model.counters.add(counter::bytes_to_device, 2*npairs*sizeof(unsigned));
+
+        cuOverlaps<<<npairs, ContactThreads>>>(model.d_phi,
+                                               model.d_patch_min,
+                                               model.d_offset,
+                                               model.patch_size,
+                                               model.Size,
+                                               model.patch_N,
+                                               d_pairs,
+                                               d_overlaps);
+
+        cudaError_t err = cudaGetLastError();
+        if (err != cudaSuccess)
+          throw error_msg("cuOverlaps launch error: ", cudaGetErrorString(err));
+
+        cudaMemcpy(overlaps.data(), d_overlaps, npairs*sizeof(double),
+                   cudaMemcpyDeviceToHost);
+        model.counters.add(counter::bytes_from_device, npairs*sizeof(double));
+      }
+
+      // edges between persistent ids
+      vector<contact_edge> edges;
+      for(size_t p=0; p<npairs; ++p)
+        if(overlaps[p]>threshold)
+          edges.push_back({ model.nphases_index[pairs[2*p]],
+                            model.nphases_index[pairs[2*p+1]],
+                            float(overlaps[p]) });
+      sort_edges(edges);
+
+      const auto events = detect_t1(last, edges);
+
+      const string oname = inline_str(model.output_dir, "contacts.bin");
+      if(!writer)
+      {
+        writer.reset(new contact_writer(oname, threshold));
+        model.counters.add(counter::files_opened);
+      }
+      {
+        counted_file counted(model.counters, oname, counted_file::mode::stream);
+        writer->write(t, edges, events);
+      }
+
+      const double values[] = {
+        double(edges.size()),
+        ncells ? 2.*edges.size()/ncells : 0.,
+        double(events.size())
+      };
+      out.add(0, values);
+
+      last.swap(edges);
+    }
+  };
+}
+
+REGISTER_ANALYSIS("contact_area", contact_area)
+REGISTER_ANALYSIS("contacts", contacts)
+REGISTER_ANALYSIS("density", density)
+REGISTER_ANALYSIS("msd", msd)
@@ -0,0 +1,88 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ANALYSIS_HPP_
+#define ANALYSIS_HPP_
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct Model;
+class tswriter;
+
+/** In-situ analyses
+  *
+  * An analysis reduces the state of the model to a few numbers at its own
+  * cadence, without writing frames. It reads the device arrays of the model in
+  * place (d_phi, d_com, ...) and only copies its results back to the host.
+  *
+  * The results are rows of values, one per column, keyed by an id: the
+  * persistent index of a cell for per-cell results, or any other index (e.g.
+  * 0 for a single global row). They are written to a columnar store
+  * analysis_NAME.bin in the output directory (see timeseries.hpp).
+  *
+  * Analyses are registered statically with REGISTER_ANALYSIS() and selected by
+  * name in the runcard, one line per analysis:
+  *
+  *   analysis = contact_area every=100 layers=3
+  *
+  * where every is the number of time steps between two evaluations (ninfo by
+  * default) and the other key=value arguments are passed to the analysis.
+  *
+  * Note that the registration is done by the constructor of a static object,
+  * which the linker drops from a static library unless something else in the
+  * same object file is used: analyses added to libceladro should live in
+  * analysis.cu, analyses of an embedding program in its own object files.
+  * */
+class analysis
+{
+public:
+  virtual ~analysis() = default;
+
+  /** Names of the result columns */
+  virtual std::vector<std::string> columns() const = 0;
+
+  /** Set an argument from the runcard, returns false if the key is unknown */
+  virtual bool set(const std::string& key, const std::string& value)
+  { return false; }
+
+  /** Compute the results at time t and add them to the store
+   *
+   * The frame has already been started, use out.add(id, values).
+   * */
+  virtual void compute(Model& model, unsigned t, tswriter& out) = 0;
+};
+
+/** Factory of a registered analysis */
+using analysis_factory = std::function<std::unique_ptr<analysis>()>;
+
+/** Register an analysis under a name (see REGISTER_ANALYSIS) */
+bool register_analysis(const std::string& name, analysis_factory factory);
+
+/** Create a registered analysis (nullptr if the name is unknown) */
+std::unique_ptr<analysis> make_analysis(const std::string& name);
+
+/** Names of all registered analyses */
+std::vector<std::string> analysis_names();
+
+/** Register analysis class type under name at static initialisation */
+#define REGISTER_ANALYSIS(name, type)                                        \
+  static const bool registered_analysis_##type = register_analysis(name,    \
+    [] { return std::unique_ptr<analysis>(new type()); });
+
+#endif//ANALYSIS_HPP_
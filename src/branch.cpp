@@ -0,0 +1,227 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "header.hpp"
+#include "model.hpp"
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+// =============================================================================
+// Overrides
+//
+// Only the model parameters that do not change the size of the arrays or the
+// precomputed tables can be overridden in a branch. They are named as in the
+// runcard. Parameters which are copied to the cells at birth also reset the
+// per-cell value of all cells.
+
+namespace
+{
+  struct override_entry
+  {
+    const char* name;
+    double Model::* value;
+    vector<double> Model::* stored;
+  };
+
+  const override_entry overrides[] = {
+    { "gamma",             &Model::gam,               &Model::stored_gam      },
+    { "omega_cc",          &Model::omega_cc,          &Model::stored_omega_cc },
+    { "omega_cs",          &Model::omega_cs,          &Model::stored_omega_cs },
+    { "alpha",             &Model::alpha,             &Model::stored_alpha    },
+    { "D-pol",             &Model::Dpol,              &Model::stored_dpol     },
+    { "mu",                &Model::mu,                nullptr },
+    { "lambda",            &Model::lambda,            nullptr },
+    { "kappa_cc",          &Model::kappa_cc,          nullptr },
+    { "kappa_cs",          &Model::kappa_cs,          nullptr },
+    { "zetaS",             &Model::zetaS,             nullptr },
+    { "zetaQ",             &Model::zetaQ,             nullptr },
+    { "xi",                &Model::xi,                nullptr },
+    { "K-nem",             &Model::Knem,              nullptr },
+    { "K-pol",             &Model::Kpol,              nullptr },
+    { "S-nem",             &Model::Snem,              nullptr },
+    { "S-pol",             &Model::Spol,              nullptr },
+    { "J-nem",             &Model::Jnem,              nullptr },
+    { "J-pol",             &Model::Jpol,              nullptr },
+    { "W-nem",             &Model::Wnem,              nullptr },
+    { "D-nem",             &Model::Dnem,              nullptr },
+    { "mutation_strength", &Model::mutation_strength, nullptr },
+  };
+
+  const override_entry& find_override(const string& name)
+  {
+    for(const auto& o : overrides)
+      if(name==o.name) return o;
+    throw error_msg("parameter '", name, "' can not be overridden in a branch.");
+  }
+
+  /** Split branch argument in key=value pairs */
+  vector<pair<string, string>> split_branch(const string& arg)
+  {
+    vector<pair<string, string>> kv;
+    size_t start = 0;
+    while(start<arg.size())
+    {
+      auto end = arg.find(',', start);
+      if(end==string::npos) end = arg.size();
+      const string item = arg.substr(start, end-start);
+      start = end+1;
+      if(item.empty()) continue;
+
+      const auto pos = item.find('=');
+      if(pos==string::npos)
+        throw error_msg("branch arguments must be of the form key=value.");
+      kv.emplace_back(item.substr(0, pos), item.substr(pos+1));
+    }
+    return kv;
+  }
+
+  double parse_double(const string& key, const string& value)
+  {
+    try
+    {
+      size_t pos;
+      const double v = stod(value, &pos);
+      if(pos==value.size()) return v;
+    }
+    catch(const logic_error&) {}
+    throw error_msg("invalid value '", value, "' for branch parameter ", key, ".");
+  }
+}
+
+// =============================================================================
+// Branches
+
+void Model::ParseBranchOptions()
+{
+  if(branch_args.empty()) return;
+
+  if(replay)
+    throw error_msg("branches can not be used together with replay.");
+  if(branch_jobs==0)
+    throw error_msg("branch-jobs must be positive.");
+  if(branch_from>=nsteps)
+    throw error_msg("branch-from must be smaller than nsteps.");
+
+  // check all the branches before anything is forked
+  for(const auto& arg : branch_args)
+    for(const auto& kv : split_branch(arg))
+    {
+      if(kv.first=="output") continue;
+      if(kv.first=="seed") { stoul(kv.second); continue; }
+      find_override(kv.first);
+      parse_double(kv.first, kv.second);
+    }
+}
+
+bool Model::ForkBranches()
+{
+  // restore the host state once: it is shared by all branches (copy-on-write)
+  // including the walls and tables. The device random states are not used as
+  // every branch has its own seed stream. Nothing here may open an OpenMP
+  // parallel region: a child forked after the thread pool is created hangs in
+  // its first one (the neighbours are computed by each branch).
+  const string fname = CheckpointName(branch_from);
+  if(verbose) cout << "restore checkpoint " << fname << " ..." << flush;
+  vector<char> rand_states;
+  ReadCheckpoint(fname, rand_states);
+  if(verbose) cout << " done (t = " << start_time << ")" << endl;
+
+  // do not duplicate buffered output
+  cout << flush;
+  cerr << flush;
+
+  map<pid_t, unsigned> running;
+  unsigned& failed = branch_failures;
+
+  const auto wait_one = [&]() {
+    int status;
+    const pid_t pid = wait(&status);
+    if(pid<0) throw error_msg("error while waiting for branches.");
+    const unsigned i = running[pid];
+    running.erase(pid);
+
+    const bool ok = WIFEXITED(status) and WEXITSTATUS(status)==0;
+    if(!ok) ++failed;
+    if(verbose) cout << "branch " << i << (ok ? " done" : " failed") << endl;
+  };
+
+  for(unsigned i=0; i<branch_args.size(); ++i)
+  {
+    while(running.size()>=branch_jobs) wait_one();
+
+    const pid_t pid = fork();
+    if(pid<0) throw error_msg("can not fork branch ", i, ".");
+    // child: continue the set-up with this branch
+    if(pid==0)
+    {
+      ApplyBranch(i);
+      return true;
+    }
+
+    if(verbose) cout << "branch " << i << " started (pid " << pid << ")" << endl;
+    running[pid] = i;
+  }
+  while(!running.empty()) wait_one();
+
+  if(verbose) cout << branch_args.size()-failed << " of " << branch_args.size()
+                   << " branches completed successfully" << endl;
+  branch_parent = true;
+  return false;
+}
+
+void Model::ApplyBranch(unsigned i)
+{
+  branch = i;
+
+  // default output name and seed stream, derived from the base run
+  string base = runname;
+  while(!base.empty() and base.back()=='/') base.pop_back();
+  if(base.empty() or base==".") base = "output";
+  runname = inline_str(base, "_branch", i);
+
+  seed_seq seq { static_cast<unsigned>(seed), static_cast<unsigned>(seed>>32),
+                 i+1 };
+  uint32_t derived;
+  seq.generate(&derived, &derived+1);
+  seed = derived;
+
+  for(const auto& kv : split_branch(branch_args[i]))
+  {
+    if(kv.first=="output") { runname = kv.second; continue; }
+    if(kv.first=="seed") { seed = stoul(kv.second); continue; }
+
+    const auto& o = find_override(kv.first);
+    const double value = parse_double(kv.first, kv.second);
+    this->*o.value = value;
+    if(o.stored)
+    {
+      auto& stored = this->*o.stored;
+      fill(stored.begin(), stored.end(), value);
+    }
+  }
+
+  // secondary values
+  sign_zetaS = zetaS>0. ? 1 : (zetaS<0. ? -1 : 0);
+  sign_zetaQ = zetaQ>0. ? 1 : (zetaQ<0. ? -1 : 0);
+  gen.seed(seed);
+
+  // own checkpoints and output window
+  checkpoint_dir = runname + "_checkpoints";
+  nstart = max(nstart, start_time);
+}
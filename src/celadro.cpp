@@ -0,0 +1,201 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "header.hpp"
+#include "model.hpp"
+#include "celadro.hpp"
+
+using namespace std;
+
+namespace celadro
+{
+  // ===========================================================================
+  // Parameters
+
+  /** Remove leading and trailing blanks */
+  static string trim(const string& s)
+  {
+    const auto first = s.find_first_not_of(" \t\r");
+    if(first==string::npos) return "";
+    return s.substr(first, s.find_last_not_of(" \t\r") - first + 1);
+  }
+
+  parameters parameters::from_runcard(const string& fname)
+  {
+    ifstream file(fname);
+    if(!file.good()) throw error_msg("can not open runcard file ", fname);
+
+    parameters p;
+    string line;
+    while(getline(file, line))
+    {
+      // same syntax as boost's config files (no sections)
+      line = trim(line.substr(0, line.find('#')));
+      if(line.empty()) continue;
+
+      const auto eq = line.find('=');
+      if(eq==string::npos)
+        throw error_msg("invalid line in runcard file ", fname, ": ", line);
+      p.values.emplace(trim(line.substr(0, eq)), trim(line.substr(eq+1)));
+    }
+    return p;
+  }
+
+  string parameters::runcard() const
+  {
+    ostringstream s;
+    for(const auto& v : values) s << v.first << " = " << v.second << '\n';
+    return s.str();
+  }
+
+  // ===========================================================================
+  // Simulation
+
+  simulation::simulation(const parameters& p)
+    : model(new Model)
+  {
+    // the parameters are parsed exactly as the program does, with the
+    // runcard given as text and the generic options on the command line
+    model->runcard = p.runcard();
+    if(model->runcard.empty()) model->runcard = "\n";
+
+    vector<string> args = { "celadro", "--verbose=" + to_string(p.verbose) };
+    if(!p.write) args.push_back("--no-write");
+    if(p.force_delete) args.push_back("--force-delete");
+
+    vector<char*> argv;
+    for(auto& a : args) argv.push_back(&a[0]);
+    model->ParseProgramOptions(argv.size(), argv.data());
+
+    if(model->verbose) model->PrintProgramOptions();
+    // branches fork the process, which is up to the program
+    if(!model->branch_args.empty())
+      throw error_msg("branches can not be used in an embedded simulation.");
+    // see simulation::peak_memory() for the memory actually used
+    if(model->plan)
+      throw error_msg("the memory plan can not be printed by an embedded "
+                      "simulation.");
+    model->SetupModel();
+    // the relaxation is part of the restored state when replaying (as in
+    // Model::Run())
+    if(!model->replay and model->branch<0) model->Pre();
+    model->GetFromDevice();
+  }
+
+  simulation::~simulation()
+  {
+    model->CloseAnalyses();
+    model->Cleanup();
+  }
+
+  void simulation::advance(unsigned nsteps)
+  {
+    model->Advance(nsteps);
+    model->GetFromDevice();
+    t += nsteps;
+  }
+
+  coord simulation::size() const
+  {
+    return { model->Size[0], model->Size[1], model->Size[2] };
+  }
+
+  unsigned simulation::ncells() const
+  {
+    return model->nphases_index.size();
+  }
+
+  vector<unsigned> simulation::cell_ids() const
+  {
+    return model->nphases_index;
+  }
+
+  cell_state simulation::cell(unsigned i) const
+  {
+    if(i>=ncells()) throw error_msg("cell ", i, " does not exist.");
+
+    const auto& m = *model;
+    cell_state c;
+    c.id     = m.nphases_index[i];
+    c.volume = m.vol[i];
+    for(unsigned d=0; d<3; ++d)
+    {
+      c.com[d]          = m.com[i][d];
+      c.velocity[d]     = m.velocity[i][d];
+      c.polarization[d] = m.polarization[i][d];
+    }
+    c.stress   = {{ m.cSxx[i], m.cSxy[i], m.cSxz[i], m.cSyy[i], m.cSyz[i], m.cSzz[i] }};
+    c.omega_cc = m.stored_omega_cc[i];
+    c.omega_cs = m.stored_omega_cs[i];
+    return c;
+  }
+
+  span<const double> simulation::field(const string& name) const
+  {
+    const auto f = Model::FieldByName(name);
+    if(!f) throw error_msg("unknown field ", name, ".");
+    const auto& v = (*model).*f;
+    return { v.data(), v.size() };
+  }
+
+  patch_view simulation::patch(unsigned i) const
+  {
+    if(i>=ncells()) throw error_msg("cell ", i, " does not exist.");
+
+    const auto& m = *model;
+    patch_view p;
+    p.phi = { m.phi[i].data(), m.patch_N };
+    for(unsigned d=0; d<3; ++d)
+    {
+      p.patch_min[d]  = m.patch_min[i][d];
+      p.offset[d]     = m.offset[i][d];
+      p.patch_size[d] = m.patch_size[d];
+      p.Size[d]       = m.Size[d];
+    }
+    return p;
+  }
+
+  unsigned simulation::add_cell(const coord& center)
+  {
+    for(unsigned d=0; d<3; ++d)
+      if(center[d]>=model->Size[d])
+        throw error_msg("cell position is outside of the domain.");
+    return model->InjectCell({ center[0], center[1], center[2] }, model->globalT);
+  }
+
+  void simulation::remove_cell(unsigned i)
+  {
+    model->RemoveCell(i, model->globalT);
+  }
+
+  void simulation::write_frame()
+  {
+    if(!model->no_write) model->WriteFrame(t);
+  }
+
+  map<string, double> simulation::timings() const
+  {
+    map<string, double> times;
+    for(unsigned i=0; i<nstages; ++i)
+      times[stage_name(static_cast<stage>(i))] = model->timers.total[i];
+    return times;
+  }
+
+  array<size_t, 2> simulation::peak_memory() const
+  {
+    return {{ model->memory_high_host, model->memory_high_device }};
+  }
+}
@@ -0,0 +1,193 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CELADRO_HPP_
+#define CELADRO_HPP_
+
+#include <array>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "patch.hpp"
+
+/** Embeddable interface to the simulation (libceladro)
+  *
+  * This header does not depend on cuda or on the model: a simulation is built
+  * from a set of parameters (the same keys as in the runcards), advanced by a
+  * number of time steps and inspected or modified in between. Example:
+  *
+  *   celadro::parameters p = celadro::parameters::from_runcard("runcard.dat");
+  *   p.set("nsteps", 1000);
+  *   celadro::simulation sim(p);
+  *   sim.advance(100);
+  *   const auto press = sim.field("field_press");
+  *
+  * Fields, patches and cell states are read from the host copy of the model,
+  * which is updated after every call to advance(). Spans point directly to
+  * this memory and are invalidated by advance(), add_cell() and remove_cell().
+  * */
+
+struct Model;
+
+namespace celadro
+{
+  /** Non-owning view of a contiguous array */
+  template<class T>
+  class span
+  {
+    T* ptr = nullptr;
+    std::size_t n = 0;
+
+  public:
+    span() = default;
+    span(T* ptr, std::size_t n)
+      : ptr(ptr), n(n)
+    {}
+
+    T* data() const { return ptr; }
+    std::size_t size() const { return n; }
+    bool empty() const { return n==0; }
+    T* begin() const { return ptr; }
+    T* end() const { return ptr+n; }
+    T& operator[](std::size_t i) const { return ptr[i]; }
+  };
+
+  /** Grid coordinate */
+  using coord = std::array<unsigned, 3>;
+
+  /** Parameters of a simulation
+   *
+   * Values are stored as text with the runcard keys, and parsed with the same
+   * options as the program, such that unknown keys or invalid values are
+   * reported in the same way.
+   * */
+  struct parameters
+  {
+    /** Runcard options (key = value, keys can be repeated as in runcards) */
+    std::multimap<std::string, std::string> values;
+    /** Write the usual output files (to the directory given by 'output') */
+    bool write = false;
+    /** Overwrite an existing output */
+    bool force_delete = false;
+    /** Verbosity level (same as --verbose) */
+    unsigned verbose = 0;
+
+    /** Set an option, replacing previous values */
+    template<class T>
+    parameters& set(const std::string& key, const T& value)
+    {
+      values.erase(key);
+      return add(key, value);
+    }
+
+    /** Add a value to an option (for options taking multiple values) */
+    template<class T>
+    parameters& add(const std::string& key, const T& value)
+    {
+      std::ostringstream s;
+      s << value;
+      values.emplace(key, s.str());
+      return *this;
+    }
+
+    /** Read the options from a runcard file */
+    static parameters from_runcard(const std::string& fname);
+    /** Options formatted as a runcard */
+    std::string runcard() const;
+  };
+
+  /** State of a single cell */
+  struct cell_state
+  {
+    /** Persistent index (as in the output files) */
+    unsigned id;
+    double volume;
+    std::array<double, 3> com, velocity, polarization;
+    /** Average stress (xx, xy, xz, yy, yz, zz) */
+    std::array<double, 6> stress;
+    /** Adhesion parameters of the cell */
+    double omega_cc, omega_cs;
+  };
+
+  /** Phase field of a cell on its patch */
+  struct patch_view
+  {
+    /** Values on the patch (patch_N values, circular offset, see patch.hpp) */
+    span<const double> phi;
+    coord patch_min, offset, patch_size, Size;
+
+    /** Domain index of node q of the patch */
+    std::size_t domain_index(std::size_t q) const
+    { return domain_index_from_patch(q, patch_size, offset, patch_min, Size); }
+  };
+
+  /** A running simulation
+   *
+   * Owns the model and the cuda device memory. Only one simulation should be
+   * alive at a time, as the device state is global.
+   * */
+  class simulation
+  {
+    std::unique_ptr<Model> model;
+    unsigned t = 0;
+
+  public:
+    /** Set up the model, the device and the relaxation (as the program) */
+    explicit simulation(const parameters& p);
+    ~simulation();
+
+    simulation(const simulation&) = delete;
+    simulation& operator=(const simulation&) = delete;
+
+    /** Advance the simulation by nsteps time steps */
+    void advance(unsigned nsteps);
+    /** Current time step */
+    unsigned time() const { return t; }
+
+    /** Size of the domain */
+    coord size() const;
+    /** Number of cells */
+    unsigned ncells() const;
+    /** Persistent index of every cell, in memory order */
+    std::vector<unsigned> cell_ids() const;
+    /** State of the cell at memory index i */
+    cell_state cell(unsigned i) const;
+
+    /** Global field from its name (sum_one, field_press, field_sxx, ...) */
+    span<const double> field(const std::string& name) const;
+    /** Phase field of the cell at memory index i */
+    patch_view patch(unsigned i) const;
+
+    /** Add a cell at a given position, returns its persistent index */
+    unsigned add_cell(const coord& center);
+    /** Remove the cell at memory index i */
+    void remove_cell(unsigned i);
+
+    /** Write the current frame to the output (if enabled) */
+    void write_frame();
+
+    /** Time spent in each stage since the creation (seconds, see timer.hpp) */
+    std::map<std::string, double> timings() const;
+    /** Highest memory of the model since the creation (bytes, host and
+     * device, see Model::TrackMemory()) */
+    std::array<std::size_t, 2> peak_memory() const;
+  };
+}
+
+#endif//CELADRO_HPP_
@@ -0,0 +1,596 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "header.hpp"
+#include "model.hpp"
+#include "files.hpp"
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+using namespace std;
+
+/** Magic string at the beginning of the file */
+static const char ck_magic[8] = { 'C', 'E', 'L', 'A', 'D', 'R', 'C', 'K' };
+/** Version of the file format */
+static const uint32_t ck_version = 2;
+/** Magic string at the beginning of a cached relaxed state */
+static const char rx_magic[8] = { 'C', 'E', 'L', 'A', 'D', 'R', 'R', 'X' };
+/** Version of the relaxed state (bump if the relaxation changes) */
+static const uint32_t rx_version = 2;
+
+/** FNV-1a hash of a string */
+static uint64_t fnv1a(const string& s)
+{
+  uint64_t hash = 14695981039346656037ull;
+  for(const char c : s)
+  {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+// =============================================================================
+// Binary i/o
+//
+// All arrays are stored with their size, such that the host state is restored
+// exactly (including spare capacity left by the proliferation).
+
+namespace
+{
+  struct ckwriter
+  {
+    ofstream& stream;
+
+    template<class T>
+    void pod(const T& value)
+    { stream.write(reinterpret_cast<const char*>(&value), sizeof(T)); }
+
+    template<class T>
+    void array(const vector<T>& v)
+    {
+      pod(uint64_t(v.size()));
+      stream.write(reinterpret_cast<const char*>(v.data()), v.size()*sizeof(T));
+    }
+
+    template<class T>
+    void array(const vector<vector<T>>& v)
+    {
+      pod(uint64_t(v.size()));
+      for(const auto& w : v) array(w);
+    }
+
+    void string(const std::string& s)
+    {
+      pod(uint64_t(s.size()));
+      stream.write(s.data(), s.size());
+    }
+  };
+
+  struct ckreader
+  {
+    ifstream& stream;
+
+    template<class T>
+    void pod(T& value)
+    {
+      stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+      if(!stream) throw error_msg("unexpected end of checkpoint file.");
+    }
+
+    template<class T>
+    void array(vector<T>& v)
+    {
+      uint64_t size;
+      pod(size);
+      v.resize(size);
+      stream.read(reinterpret_cast<char*>(v.data()), size*sizeof(T));
+      if(!stream) throw error_msg("unexpected end of checkpoint file.");
+    }
+
+    template<class T>
+    void array(vector<vector<T>>& v)
+    {
+      uint64_t size;
+      pod(size);
+      v.resize(size);
+      for(auto& w : v) array(w);
+    }
+
+    void string(std::string& s)
+    {
+      uint64_t size;
+      pod(size);
+      s.resize(size);
+      stream.read(&s[0], size);
+      if(!stream) throw error_msg("unexpected end of checkpoint file.");
+    }
+  };
+}
+
+/** Read or write the full host state
+ *
+ * The same function is used in both directions to guarantee that the order of
+ * the fields is the same.
+ * */
+template<class IO>
+static void checkpoint_state(IO& io, Model& m)
+{
+  // per-cell quantities
+  io.array(m.nphases_index);
+  io.array(m.phi);
+  io.array(m.phi_dx);
+  io.array(m.phi_dy);
+  io.array(m.phi_dz);
+  io.array(m.phi_old);
+  io.array(m.V);
+  io.array(m.dphi);
+  io.array(m.dphi_old);
+  io.array(m.vol);
+  io.array(m.patch_min);
+  io.array(m.patch_max);
+  io.array(m.offset);
+  io.array(m.com);
+  io.array(m.com_prev);
+  io.array(m.com_x);
+  io.array(m.com_y);
+  io.array(m.com_z);
+  io.array(m.polarization);
+  io.array(m.vorticity);
+  io.array(m.velocity);
+  io.array(m.Fpressure);
+  io.array(m.Fshape);
+  io.array(m.Fnem);
+  io.array(m.Fpol);
+  io.array(m.cSxx);
+  io.array(m.cSxy);
+  io.array(m.cSxz);
+  io.array(m.cSyy);
+  io.array(m.cSyz);
+  io.array(m.cSzz);
+  io.array(m.theta_pol);
+  io.array(m.theta_pol_old);
+  io.array(m.delta_theta_pol);
+  io.array(m.stored_gam);
+  io.array(m.stored_omega_cc);
+  io.array(m.stored_omega_cs);
+  io.array(m.stored_alpha);
+  io.array(m.stored_dpol);
+  io.array(m.timer);
+  io.array(m.divisiontthresh);
+  io.array(m.stored_tmean);
+
+  // global fields
+  io.array(m.sum_one);
+  io.array(m.sum_two);
+  io.array(m.field_polx);
+  io.array(m.field_poly);
+  io.array(m.field_polz);
+  io.array(m.field_velx);
+  io.array(m.field_vely);
+  io.array(m.field_velz);
+  io.array(m.field_press);
+  io.array(m.field_sxx);
+  io.array(m.field_sxy);
+  io.array(m.field_sxz);
+  io.array(m.field_syy);
+  io.array(m.field_syz);
+  io.array(m.field_szz);
+  io.array(m.walls);
+  io.array(m.walls_dx);
+  io.array(m.walls_dy);
+  io.array(m.walls_dz);
+  io.array(m.walls_laplace);
+}
+
+/** Read or write the state of the active cells modified by the relaxation
+ *
+ * The global sums are not stored: they are reset at the end of every substep.
+ * */
+template<class IO>
+static void relaxed_state(IO& io, Model& m)
+{
+  for(size_t n=0; n<m.nphases_index.size(); ++n)
+  {
+    io.array(m.phi[n]);
+    io.array(m.phi_dx[n]);
+    io.array(m.phi_dy[n]);
+    io.array(m.phi_dz[n]);
+    io.array(m.phi_old[n]);
+    io.array(m.V[n]);
+    io.array(m.dphi[n]);
+    io.array(m.dphi_old[n]);
+    io.pod(m.vol[n]);
+    io.pod(m.patch_min[n]);
+    io.pod(m.patch_max[n]);
+    io.pod(m.offset[n]);
+    io.pod(m.com[n]);
+    io.pod(m.com_x[n]);
+    io.pod(m.com_y[n]);
+    io.pod(m.com_z[n]);
+    io.pod(m.velocity[n]);
+    io.pod(m.Fpressure[n]);
+    io.pod(m.Fpol[n]);
+  }
+}
+
+// =============================================================================
+// Checkpoints
+
+uint64_t Model::ParametersHash()
+{
+  // hash the json serialization of the run-invariant parameters (FNV-1a)
+  stringstream buffer;
+  {
+    oarchive ar(buffer, "parameters", 1);
+    SerializeInvariants(ar);
+  }
+
+  return fnv1a(buffer.str());
+}
+
+string Model::CheckpointName(unsigned t) const
+{
+  return inline_str(checkpoint_dir, "/checkpoint", t, ".bin");
+}
+
+void Model::WriteCheckpoint(unsigned t)
+{
+  trace::span span("WriteCheckpoint", "writer");
+  // the device holds the reference state (e.g. walls can be reconfigured on
+  // the host only)
+  GetFromDevice();
+
+  vector<char> rand_states;
+  CopyRandomStates(rand_states, CopyMemory::DeviceToHost);
+
+  create_directory(checkpoint_dir);
+  const string fname = CheckpointName(t);
+  counted_file counted(counters, fname);
+  ofstream stream(fname, ios::out | ios::binary);
+  if(!stream.good())
+    throw error_msg("can not open checkpoint file ", fname, ".");
+
+  ckwriter io { stream };
+  stream.write(ck_magic, sizeof(ck_magic));
+  io.pod(ck_version);
+  io.pod(params_hash);
+  io.pod(uint64_t(seed));
+  io.pod(uint32_t(t));
+  io.pod(uint32_t(globalT));
+  io.pod(uint32_t(nphases));
+  io.pod(uint32_t(nphases_index_head));
+
+  // host random number generator
+  io.string(inline_str(gen));
+
+  // lineage
+  io.pod(uint64_t(cellHist.size()));
+  for(const auto& kv : cellHist)
+  {
+    io.pod(int32_t(kv.first));
+    io.pod(kv.second);
+  }
+
+  checkpoint_state(io, *this);
+  io.array(rand_states);
+
+  if(!stream.good())
+    throw error_msg("error while writing checkpoint file ", fname, ".");
+}
+
+/** Read the state of a checkpoint into m, returns the hash of its parameters */
+static uint64_t read_checkpoint(const string& fname, Model& m,
+                                vector<char>& rand_states)
+{
+  ifstream stream(fname, ios::in | ios::binary);
+  if(!stream.good())
+    throw error_msg("can not open checkpoint file ", fname, ".");
+  ckreader io { stream };
+
+  char magic[sizeof(ck_magic)];
+  stream.read(magic, sizeof(magic));
+  if(!stream or memcmp(magic, ck_magic, sizeof(magic)))
+    throw error_msg("file ", fname, " is not a checkpoint.");
+  uint32_t version;
+  io.pod(version);
+  if(version!=ck_version)
+    throw error_msg("unsupported checkpoint version.");
+
+  // the seed of the original run is used, it might have been picked randomly
+  uint64_t hash, seed_;
+  io.pod(hash);
+  io.pod(seed_);
+  m.seed = seed_;
+
+  uint32_t time_, globalT_, nphases_, head_;
+  io.pod(time_);
+  io.pod(globalT_);
+  io.pod(nphases_);
+  io.pod(head_);
+
+  string gen_state;
+  io.string(gen_state);
+  stringstream(gen_state) >> m.gen;
+
+  uint64_t nhist;
+  io.pod(nhist);
+  m.cellHist.clear();
+  for(uint64_t i=0; i<nhist; ++i)
+  {
+    int32_t id;
+    Model::cellInfo info;
+    io.pod(id);
+    io.pod(info);
+    m.cellHist[id] = info;
+  }
+
+  checkpoint_state(io, m);
+  m.nphases = nphases_;
+  m.nphases_index_head = head_;
+  m.globalT = globalT_;
+  m.start_time = time_;
+
+  io.array(rand_states);
+  return hash;
+}
+
+/** Largest difference between the phase fields and centres of mass of two
+ * states (infinite if the cells or their patches differ) */
+static double state_difference(const Model& a, const Model& b)
+{
+  const double inf = numeric_limits<double>::infinity();
+  if(a.nphases_index!=b.nphases_index) return inf;
+
+  double diff = 0;
+  for(unsigned n=0; n<a.nphases_index.size(); ++n)
+  {
+    if(a.patch_min[n]!=b.patch_min[n] or a.offset[n]!=b.offset[n]
+       or a.phi[n].size()!=b.phi[n].size())
+      return inf;
+
+    for(unsigned q=0; q<a.phi[n].size(); ++q)
+    {
+      const double d = abs(a.phi[n][q] - b.phi[n][q]);
+      if(!isfinite(d)) return inf;
+      diff = max(diff, d);
+    }
+    for(unsigned i=0; i<3; ++i)
+    {
+      // the centres of mass are periodic
+      const double d = abs(a.com[n][i] - b.com[n][i]);
+      if(!isfinite(d)) return inf;
+      diff = max(diff, min(d, a.Size[i] - d));
+    }
+  }
+  return diff;
+}
+
+void Model::ReadCheckpoint(const string& fname, vector<char>& rand_states)
+{
+  // the hash of the set-up, before the checkpoint overwrites the state
+  const uint64_t expected = ParametersHash();
+  if(read_checkpoint(fname, *this, rand_states)!=expected)
+    throw error_msg("checkpoint ", fname, " was written with different "
+                    "model parameters.");
+}
+
+void Model::CheckReplay(unsigned t)
+{
+  const string fname = CheckpointName(t);
+  if(!ifstream(fname).good()) return;
+
+  trace::span span("CheckReplay", "writer");
+  // the state of the original run at the same time
+  unique_ptr<Model> original(new Model());
+  original->Size = Size;
+  vector<char> rand_states;
+  read_checkpoint(fname, *original, rand_states);
+
+  GetFromDevice();
+  const double diff = state_difference(*this, *original);
+  replay_checks += 1;
+  replay_error = max(replay_error, diff);
+
+  if(verbose>1)
+    cout << "replay check at t = " << t << ": difference " << diff << endl;
+  if(!(diff<=replay_tolerance))
+    throw error_msg("the replay differs from the original run by ", diff,
+                    " at t = ", t, " (checkpoint ", fname, "), above the "
+                    "tolerance ", replay_tolerance, ".");
+}
+
+void Model::LoadCheckpoint()
+{
+  // find the nearest checkpoint before the window
+  string fname;
+  unsigned t = replay_from - replay_from%checkpoint_every;
+  for(;; t-=checkpoint_every)
+  {
+    fname = CheckpointName(t);
+    if(ifstream(fname).good()) break;
+    if(t==0) throw error_msg("no checkpoint found in ", checkpoint_dir,
+                             " before time ", replay_from, ".");
+  }
+
+  if(verbose) cout << "... restore checkpoint " << fname << " ..." << flush;
+
+  // device arrays depending on the number of cells must be reallocated
+  FreeDeviceMemoryCellBirth();
+  vector<char> rand_states;
+  ReadCheckpoint(fname, rand_states);
+  AllocDeviceMemoryCellBirth();
+  PutToDevice();
+
+  vector<char> check;
+  CopyRandomStates(check, CopyMemory::DeviceToHost);
+  if(rand_states.size()!=check.size())
+    throw error_msg("checkpoint ", fname, " has wrong number of random states.");
+  CopyRandomStates(rand_states, CopyMemory::HostToDevice);
+
+  if(verbose) cout << " done (t = " << start_time << ")" << endl;
+}
+
+void Model::ParseReplayOptions()
+{
+  replay = !replay_args.empty();
+  if(!replay) return;
+
+  bool has_from = false, has_to = false, has_output = false;
+  for(const auto& arg : replay_args)
+  {
+    const auto pos = arg.find('=');
+    if(pos==string::npos)
+      throw error_msg("replay arguments must be of the form key=value.");
+    const string key = arg.substr(0, pos), value = arg.substr(pos+1);
+
+    if(key=="from")        { replay_from = stoul(value); has_from = true; }
+    else if(key=="to")     { replay_to = stoul(value); has_to = true; }
+    else if(key=="output") { runname = value; has_output = true; }
+    else if(key=="ninfo")  ninfo = stoul(value);
+    else if(key=="tolerance") replay_tolerance = stod(value);
+    else throw error_msg("unknown replay argument '", key, "'.");
+  }
+
+  if(!has_from or !has_to or replay_from>replay_to)
+    throw error_msg("replay needs a window from=T1 to=T2 with T1<=T2.");
+  if(!has_output)
+    throw error_msg("replay needs a new output name output=NAME.");
+  if(checkpoint_every==0)
+    throw error_msg("replay needs checkpoint-every to locate checkpoints.");
+  if(ninfo==0)
+    throw error_msg("replay ninfo must be positive.");
+  // frames are written every ninfo steps from T1: the last one must be T2
+  if((replay_to-replay_from)%ninfo)
+    throw error_msg("replay window from=", replay_from, " to=", replay_to,
+                    " is not a multiple of ninfo=", ninfo, ".");
+
+  // output only within the window, and no new checkpoints
+  nstart = replay_from;
+  nsteps = replay_to;
+}
+
+// =============================================================================
+// Cache of relaxed states
+
+string Model::RelaxationKey() const
+{
+  // initial positions, whether read or generated (only valid before the
+  // relaxation, which moves the centers of mass)
+  string centers;
+  for(size_t n=0; n<nphases_index.size(); ++n)
+    centers.append(reinterpret_cast<const char*>(&com[n]), sizeof(com[n]));
+
+  // passive parameters and length of the relaxation (the seed does not enter:
+  // the polarisation is frozen)
+  stringstream key;
+  key << setprecision(17)
+      << "version "  << rx_version << '\n'
+      << "centers "  << hex << fnv1a(centers) << dec << '\n'
+      << "cells "    << nphases_index.size() << '\n'
+      << "Size "     << Size[0] << ' ' << Size[1] << ' ' << Size[2] << '\n'
+      << "BC "       << BC << '\n'
+      << "margin "   << margin << '\n'
+      << "R "        << R << '\n'
+      << "gamma "    << gam << '\n'
+      << "mu "       << mu << '\n'
+      << "lambda "   << lambda << '\n'
+      << "kappa_cc " << kappa_cc << '\n'
+      << "omega_cc " << omega_cc << '\n'
+      << "kappa_cs " << kappa_cs << '\n'
+      << "omega_cs " << omega_cs << '\n'
+      << "wall-thickness " << wall_thickness << '\n'
+      << "ratios "   << cross_ratio << ' ' << wound_ratio << ' ' << tumor_ratio << '\n'
+      << "xi "       << xi << '\n'
+      << "time_step " << time_step << '\n'
+      << "npc "      << npc << '\n'
+      << "relax "    << relax_time << ' '
+                     << (relax_nsubsteps ? relax_nsubsteps : nsubsteps) << '\n';
+  return key.str();
+}
+
+string Model::RelaxCacheName(const string& key) const
+{
+  stringstream name;
+  name << relax_cache << "/relax-" << hex << setw(16) << setfill('0')
+       << fnv1a(key) << ".bin";
+  return name.str();
+}
+
+bool Model::LoadRelaxedState(const string& key)
+{
+  const string fname = RelaxCacheName(key);
+  ifstream stream(fname, ios::in | ios::binary);
+  if(!stream.good()) return false;
+  ckreader io { stream };
+
+  try
+  {
+    char magic[sizeof(rx_magic)];
+    stream.read(magic, sizeof(magic));
+    if(!stream or memcmp(magic, rx_magic, sizeof(magic)))
+      throw error_msg("file ", fname, " is not a relaxed state.");
+
+    // guards against collisions of the hash
+    string stored_key;
+    io.string(stored_key);
+    if(stored_key!=key)
+      throw error_msg("relaxed state ", fname, " has a different key.");
+
+    relaxed_state(io, *this);
+    for(size_t n=0; n<nphases_index.size(); ++n)
+      if(phi[n].size()!=patch_N or phi_old[n].size()!=patch_N)
+        throw error_msg("relaxed state ", fname, " has wrong patch size.");
+  }
+  catch(const error_msg& e)
+  {
+    // the device still holds the initial state: relax again
+    if(verbose) cerr << "warning: " << e.what() << "\n";
+    return false;
+  }
+
+  PutToDevice();
+  relax_cache_hit = true;
+  if(verbose) cout << " (relaxed state from " << fname << ")" << flush;
+  return true;
+}
+
+void Model::SaveRelaxedState(const string& key)
+{
+  create_directory(relax_cache);
+  const string fname = RelaxCacheName(key);
+
+  // written aside and renamed, such that concurrent runs never read a
+  // partial file
+  const string tmpname = inline_str(fname, ".", getpid());
+  {
+    counted_file counted(counters, tmpname);
+    ofstream stream(tmpname, ios::out | ios::binary);
+    if(!stream.good())
+      throw error_msg("can not open relaxed state file ", tmpname, ".");
+
+    ckwriter io { stream };
+    stream.write(rx_magic, sizeof(rx_magic));
+    io.string(key);
+    relaxed_state(io, *this);
+
+    if(!stream.good())
+      throw error_msg("error while writing relaxed state file ", tmpname, ".");
+  }
+  if(rename(tmpname.c_str(), fname.c_str()))
+    throw error_msg("can not rename ", tmpname, " to ", fname, ".");
+}
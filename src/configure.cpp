@@ -20,56 +20,36 @@
 
 using namespace std;
 
-void Model::AddCellAtNode(unsigned n, unsigned q, const coord& center)
+double Model::AddCellAtNode(unsigned n, unsigned q, const coord& center)
 {
-       /*
-	const auto      k = GetIndexFromPatch(n, q);
-       const coord GlobCoor = GetNodePosOnDomain(n,q); 
-	//const unsigned yk = (k/Size[1])%Size[0];GetXPosition(k);
-	//const unsigned xk = k%Size[1];
-	//const unsigned zk = k/(Size[0]*Size[1]);
-  	const unsigned xk = GlobCoor[0];
-  	const unsigned yk = GlobCoor[1];
-  	const unsigned zk = GlobCoor[2];
-  	*/
-  	
-  const auto      k = GetIndexFromPatch(n, q);
-  const unsigned xk = GetXPosition(k);
-  const unsigned yk = GetYPosition(k);
-  const unsigned zk = GetZPosition(k);
-	const auto radius = max(R/2., 4.);
-	
-	
-
-  // creates spheres 
-  
-  if(
-      (BC==0 and pow(wrap(diff(yk, center[1]), Size[1]), 2)
-       + pow(wrap(diff(xk, center[0]), Size[0]), 2) + pow(wrap(diff(zk, center[2]), Size[2]), 2) <=ceil(radius*radius))
-      or
-      (BC>=1 and pow(diff(yk, center[1]), 2)
-       + pow(diff(xk, center[0]), 2) + pow(diff(zk, center[2]), 2) <=ceil(radius*radius))
-    )
+  const auto  k = GetIndexFromPatch(n, q);
+  const coord p = GetPosition(k);
+  const auto radius = max(R/2., 4.);
 
-    
+  // creates spheres (distances are periodic without walls)
+  double dist2 = 0;
+  for(unsigned d=0; d<3; ++d)
   {
-            
-    phi[n][q]     = 1.;
-    phi_old[n][q] = 1.;
-    vol[n]      += 1.;
-    sum_two[k]    += 1.;
-    //thirdp[k]    += 1.;
-    //fourthp[k]   += 1.;
-    sum_one[k]       += 1.;
-    //sumQ00[k]    += Q00[n];
-    //sumQ01[k]    += Q01[n];    
+    const unsigned delta = BC==0 ? wrap(diff(p[d], center[d]), Size[d])
+                                 : diff(p[d], center[d]);
+    dist2 += double(delta)*delta;
   }
-  else
+
+  if(dist2<=ceil(radius*radius))
   {
-    phi[n][q]     = 0.;
-    phi_old[n][q] = 0.;
+    phi[n][q]     = 1.;
+    phi_old[n][q] = 1.;
+    // the patches of different cells can overlap
+    #pragma omp atomic
+    sum_two[k]   += 1.;
+    #pragma omp atomic
+    sum_one[k]   += 1.;
+    return 1.;
   }
-  
+
+  phi[n][q]     = 0.;
+  phi_old[n][q] = 0.;
+  return 0.;
 }
 
 void Model::AddCell(unsigned n, const coord& center)
@@ -88,8 +68,10 @@ void Model::AddCell(unsigned n, const coord& center)
   //Q01[n] = Snem*sin(2*theta_nem[n]);
 
   // create the cells at the centers we just computed
+  // a single patch, also added at run time (divisions, injected cells): no
+  // parallel region, see AddCells() for the set-up
   for(unsigned q=0; q<patch_N; ++q)
-    AddCellAtNode(n, q, center);
+    vol[n] += AddCellAtNode(n, q, center);
   com[n]   = vec<double, 3>(center);
 
 }
@@ -106,8 +88,10 @@ void Model::AddCellMix(unsigned n, const coord& center)
   //Q00[n] = Snem*cos(2*theta_nem[n]);
   //Q01[n] = Snem*sin(2*theta_nem[n]);
   // create the cells at the centers we just computed
+  // a single patch, also added at run time (divisions, injected cells): no
+  // parallel region, see AddCells() for the set-up
   for(unsigned q=0; q<patch_N; ++q)
-    AddCellAtNode(n, q, center);
+    vol[n] += AddCellAtNode(n, q, center);
 
   com[n]   = vec<double, 3>(center);
   stored_gam[n] = gam;
@@ -118,10 +102,40 @@ void Model::AddCellMix(unsigned n, const coord& center)
 
 }
 
+void Model::AddCells(const vector<coord>& centers)
+{
+  // everything but the patches, in order, such that the random numbers do not
+  // depend on the number of threads
+  for(unsigned n=0; n<centers.size(); ++n)
+  {
+    const auto& center = centers[n];
+    patch_min[n] = (center+Size-patch_margin)%Size;
+    patch_max[n] = (center+patch_margin-1u)%Size;
+    theta_pol[n] = noise*Pi*(1-2*random_real());
+    polarization[n] = { Spol*cos(theta_pol[n]), Spol*sin(theta_pol[n]) };
+    com[n]   = vec<double, 3>(center);
+    stored_gam[n] = gam;
+    stored_omega_cc[n] = omega_cc;
+    stored_omega_cs[n] = omega_cs;
+    stored_alpha[n] = alpha;
+    stored_dpol[n] = Dpol;
+  }
+
+  // one cell per thread (see AddCellAtNode)
+  #pragma omp parallel for schedule(dynamic)
+  for(unsigned n=0; n<centers.size(); ++n)
+  {
+    double volume = 0;
+    for(unsigned q=0; q<patch_N; ++q)
+      volume += AddCellAtNode(n, q, centers[n]);
+    vol[n] += volume;
+  }
+}
+
 void Model::Configure()
 {
+  vector<coord> centers;
 
-  
   if(init_config=="input const" && BC != 3)
   {
     string fname = "input_str.dat";
@@ -129,13 +143,24 @@ void Model::Configure()
     fstream file(fname);
     for (unsigned n = 0 ; n < nphases_init ; n++){
     file >> xcoor >> ycoor >> zcoor;
-     AddCellMix(n,{xcoor,ycoor,zcoor});
+     centers.push_back({xcoor,ycoor,zcoor});
     }
   }  
+  else if(init_config=="random")
+    centers = GenerateRandom([](const vec<double, 3>&) { return true; }, false);
+  else if(init_config=="slab")
+    centers = GenerateRandom([](const vec<double, 3>&) { return true; }, true);
+  else if(init_config=="hexagonal")
+    centers = GenerateLattice(true);
+  else if(init_config=="cubic")
+    centers = GenerateLattice(false);
+  else if(init_config.compare(0, 5, "mask ")==0)
+    centers = GenerateMask(init_config.substr(5));
 
   else throw error_msg("error: initial configuration '",
       init_config, "' unknown.");
-      
+
+  AddCells(centers);
 }
 
 void Model::ConfigureWalls(int BC_)
@@ -144,42 +169,38 @@ void Model::ConfigureWalls(int BC_)
   {
   case 0:
     // no walls (pbc)
-    for(unsigned k=0; k<N; ++k)
-      walls[k] = 0;
+    fill(walls.begin(), walls.end(), 0.);
     break;
       
   case 1:
-    // Exponentially falling phase-field:
+  {
+    // Exponentially falling phase-field: each wall contributes as an
+    // exponentially falling potential and we do not care about overlaps. The
+    // contributions only depend on one coordinate and are tabulated.
+    vector<double> ex(Size[0]), ey(Size[1]), ez(Size[2]);
+    for(unsigned x=0; x<Size[0]; ++x)
+      ex[x] = exp(-double(x)/wall_thickness) + exp(-(Size[0]-1.-x)/wall_thickness);
+    for(unsigned y=0; y<Size[1]; ++y)
+      ey[y] = exp(-double(y)/wall_thickness) + exp(-(Size[1]-1.-y)/wall_thickness);
+    for(unsigned z=0; z<Size[2]; ++z)
+      ez[z] = exp(-double(z)/wall_thickness) + exp(-(Size[2]-1.-z)/wall_thickness);
+
+    #pragma omp parallel for schedule(static)
     for(unsigned k=0; k<N; ++k)
-    {
-      const double x = GetXPosition(k);
-      const double y = GetYPosition(k);
-      const double z = GetZPosition(k);
-      // this is the easiest way: each wall contributes as an exponentially
-      // falling potential and we do not care about overalps
-      walls[k] =   exp(-y/wall_thickness)
-                 + exp(-x/wall_thickness)
-                 + exp(-z/wall_thickness)
-                 + exp(-(Size[0]-1-x)/wall_thickness)
-                 + exp(-(Size[1]-1-y)/wall_thickness)
-                 + exp(-(Size[2]-1-z)/wall_thickness);
-    }
+      walls[k] = ex[GetXPosition(k)] + ey[GetYPosition(k)] + ez[GetZPosition(k)];
     break;
+  }
   
   case 2:
     // constant wall
+    #pragma omp parallel for schedule(static)
     for(unsigned k=0; k<N; ++k)
-    {
-      const double z = GetZPosition(k);
-      
-      if (z < wall_thickness) walls[k] = 1.;
-      else walls[k] = 0.;
-      
-    }
+      walls[k] = GetZPosition(k) < wall_thickness ? 1. : 0.;
     break;
       
   case 3:
     // box
+    #pragma omp parallel for schedule(static)
     for(unsigned k=0; k<N; ++k)
     {
       const double x = GetXPosition(k);
@@ -199,25 +220,16 @@ void Model::ConfigureWalls(int BC_)
     
   case 4:
     // 3d tube  
+    #pragma omp parallel for schedule(static)
     for(unsigned k=0; k<N; ++k)
     {
       const double x = GetXPosition(k);
-      //const double y = GetYPosition(k);
       const double z = GetZPosition(k);
       const double R = 12.;
       
-      walls[k] = 1.;
-      // compute distance from the elliptic wall
-      // ... angle of the current point (from center of the domain)
-      // const auto theta = atan2(Size[2]/2.-z, Size[0]/2.-x);
-      // ... small helper function to compute radius
-      const auto rad = [](auto x, auto z) { return sqrt(x*x + z*z); };
-      // ... distance is the difference between wall and current point
-      const auto d = rad(Size[0]/2.-x, Size[2]/2.-z);
-                    
-      
-      if(d <= R) walls[k] = 0.;
-      
+      // distance from the axis of the tube, in the center of the domain
+      const double dx = Size[0]/2.-x, dz = Size[2]/2.-z;
+      walls[k] = dx*dx + dz*dz <= R*R ? 0. : 1.;
     }
     break;
   
@@ -225,6 +237,7 @@ void Model::ConfigureWalls(int BC_)
     throw error_msg("boundary condition unknown.");
   }
   // pre-compute derivatives
+  #pragma omp parallel for schedule(static)
   for(unsigned k=0; k<N; ++k)
   {
     const auto& s = neighbors[k];
@@ -235,21 +248,3 @@ void Model::ConfigureWalls(int BC_)
     walls_laplace[k] = laplacian(walls, s);
   }
 }
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
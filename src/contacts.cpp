@@ -0,0 +1,139 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "header.hpp"
+#include "contacts.hpp"
+#include <algorithm>
+#include <unordered_map>
+
+using namespace std;
+
+/** Magic string at the beginning of the file */
+static const char cn_magic[8] = { 'C', 'E', 'L', 'A', 'D', 'R', 'C', 'N' };
+/** Version of the file format */
+static const uint32_t cn_version = 1;
+
+/** Write POD value to stream */
+template<class T>
+static void write_pod(ostream& stream, const T& value)
+{
+  stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void sort_edges(vector<contact_edge>& edges)
+{
+  for(auto& e : edges) if(e.j<e.i) swap(e.i, e.j);
+  sort(edges.begin(), edges.end(),
+       [](const contact_edge& a, const contact_edge& b) {
+         return a.i<b.i or (a.i==b.i and a.j<b.j);
+       });
+}
+
+namespace
+{
+  /** Sorted neighbour lists of a contact graph */
+  class adjacency
+  {
+    unordered_map<uint32_t, vector<uint32_t>> neighbours;
+    const vector<uint32_t> none;
+
+  public:
+    explicit adjacency(const vector<contact_edge>& edges)
+    {
+      for(const auto& e : edges)
+      {
+        neighbours[e.i].push_back(e.j);
+        neighbours[e.j].push_back(e.i);
+      }
+      for(auto& n : neighbours) sort(n.second.begin(), n.second.end());
+    }
+
+    const vector<uint32_t>& of(uint32_t i) const
+    {
+      const auto it = neighbours.find(i);
+      return it==neighbours.end() ? none : it->second;
+    }
+
+    bool connected(uint32_t i, uint32_t j) const
+    {
+      const auto& n = of(i);
+      return binary_search(n.begin(), n.end(), j);
+    }
+  };
+}
+
+vector<t1_event> detect_t1(const vector<contact_edge>& before,
+                           const vector<contact_edge>& after)
+{
+  const adjacency old_graph(before), new_graph(after);
+
+  vector<t1_event> events;
+  for(const auto& e : before)
+  {
+    // lost edges only
+    if(new_graph.connected(e.i, e.j)) continue;
+
+    // new edges between common neighbours of i and j
+    const auto& ni = old_graph.of(e.i);
+    const auto& nj = old_graph.of(e.j);
+    vector<uint32_t> common;
+    set_intersection(ni.begin(), ni.end(), nj.begin(), nj.end(),
+                     back_inserter(common));
+
+    for(size_t a=0; a<common.size(); ++a)
+    for(size_t b=a+1; b<common.size(); ++b)
+    {
+      const uint32_t k = common[a], l = common[b];
+      if(old_graph.connected(k, l) or !new_graph.connected(k, l)) continue;
+      if(new_graph.connected(e.i, k) and new_graph.connected(e.i, l)
+         and new_graph.connected(e.j, k) and new_graph.connected(e.j, l))
+        events.push_back({ e.i, e.j, k, l });
+    }
+  }
+  return events;
+}
+
+contact_writer::contact_writer(const string& fname, double threshold)
+  : stream(fname, ios::out | ios::binary)
+{
+  if(!stream.good()) throw error_msg("can not open file ", fname, ".");
+
+  stream.write(cn_magic, sizeof(cn_magic));
+  write_pod(stream, cn_version);
+  write_pod(stream, threshold);
+}
+
+void contact_writer::write(unsigned t, const vector<contact_edge>& edges,
+                           const vector<t1_event>& events)
+{
+  write_pod(stream, uint32_t(t));
+  write_pod(stream, uint32_t(edges.size()));
+  for(const auto& e : edges)
+  {
+    write_pod(stream, e.i);
+    write_pod(stream, e.j);
+    write_pod(stream, e.weight);
+  }
+  write_pod(stream, uint32_t(events.size()));
+  for(const auto& e : events)
+  {
+    write_pod(stream, e.i);
+    write_pod(stream, e.j);
+    write_pod(stream, e.k);
+    write_pod(stream, e.l);
+  }
+  if(!stream) throw error_msg("error while writing the contact graph.");
+}
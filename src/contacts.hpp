@@ -0,0 +1,81 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CONTACTS_HPP_
+#define CONTACTS_HPP_
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/** Cell-cell contact graphs
+  *
+  * Two cells are in contact when the overlap integral of phi_i*phi_j exceeds a
+  * threshold. The graph of every frame is stored as a list of weighted edges
+  * between persistent cell ids, followed by the T1 events since the previous
+  * frame (see detect_t1()).
+  *
+  * Layout (native endianness):
+  *
+  *   header : "CELADRCN" | u32 version | f64 threshold
+  *   frame  : u32 time | u32 nedges | nedges x (u32 i, u32 j, f32 weight)
+  *            | u32 nevents | nevents x (u32 i, u32 j, u32 k, u32 l)
+  *
+  * Edges are sorted with i<j.
+  * */
+
+/** Edge of the contact graph (persistent ids, i<j) */
+struct contact_edge
+{
+  uint32_t i, j;
+  /** Overlap integral */
+  float weight;
+};
+
+/** T1 event: the contact i-j is replaced by the contact k-l */
+struct t1_event
+{
+  uint32_t i, j, k, l;
+};
+
+/** Sort edges and make sure that i<j */
+void sort_edges(std::vector<contact_edge>& edges);
+
+/** T1 events between two sorted contact graphs
+  *
+  * A lost edge i-j and a new edge k-l form a T1 event when k and l were both
+  * in contact with i and j before, and i and j are both in contact with k and
+  * l after (the four cells form a quartet in both graphs).
+  * */
+std::vector<t1_event> detect_t1(const std::vector<contact_edge>& before,
+                                const std::vector<contact_edge>& after);
+
+/** Writer for the contact graphs */
+class contact_writer
+{
+  /** The output file */
+  std::ofstream stream;
+
+public:
+  contact_writer(const std::string& fname, double threshold);
+
+  /** Append a frame */
+  void write(unsigned t, const std::vector<contact_edge>& edges,
+             const std::vector<t1_event>& events);
+};
+
+#endif//CONTACTS_HPP_
@@ -0,0 +1,92 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "header.hpp"
+#include "counters.hpp"
+#include <cstring>
+#include <sys/stat.h>
+
+using namespace std;
+
+/** Version of the stats stream */
+static const uint32_t stats_version = 1;
+
+const char* counter_name(counter c)
+{
+  static const char* names[ncounters] = {
+    "put_calls", "get_calls", "bytes_to_device", "bytes_from_device",
+    "divisions", "detachments", "shm_overwrites", "files_opened", "bytes_written"
+  };
+  return names[static_cast<unsigned>(c)];
+}
+
+void event_counters::open(const string& fname)
+{
+  stream.open(fname, ios::out | ios::binary);
+  if(!stream.good()) throw error_msg("can not open file ", fname, ".");
+
+  stream.write("CELSTATS", 8);
+  const uint32_t header[] = { stats_version, ncounters };
+  stream.write(reinterpret_cast<const char*>(header), sizeof(header));
+  for(unsigned i=0; i<ncounters; ++i)
+  {
+    const char* name = counter_name(static_cast<counter>(i));
+    stream.write(name, strlen(name)+1);
+  }
+}
+
+void event_counters::end_interval(unsigned t)
+{
+  if(stream.is_open())
+  {
+    const uint32_t time = t;
+    stream.write(reinterpret_cast<const char*>(&time), sizeof(time));
+    stream.write(reinterpret_cast<const char*>(interval.data()),
+                 interval.size()*sizeof(uint64_t));
+    stream.flush();
+    if(!stream.good()) throw error_msg("error while writing the stats stream.");
+  }
+  interval.fill(0);
+}
+
+void event_counters::print(ostream& out) const
+{
+  for(unsigned i=0; i<ncounters; ++i)
+    out << "  " << setw(20) << left << counter_name(static_cast<counter>(i))
+        << setw(16) << right << total[i] << '\n';
+}
+
+/** Size of a file (0 if it does not exist) */
+static uint64_t file_size(const string& fname)
+{
+  struct stat st;
+  return stat(fname.c_str(), &st) ? 0 : st.st_size;
+}
+
+counted_file::counted_file(event_counters& counters, const string& fname,
+                           mode m)
+  : counters(counters), fname(fname),
+    before(m==mode::overwrite ? 0 : file_size(fname))
+{
+  // streams kept open are counted once, when they are opened
+  if(m!=mode::stream) counters.add(counter::files_opened);
+}
+
+counted_file::~counted_file()
+{
+  const uint64_t after = file_size(fname);
+  if(after>before) counters.add(counter::bytes_written, after-before);
+}
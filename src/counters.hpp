@@ -0,0 +1,108 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COUNTERS_HPP_
+#define COUNTERS_HPP_
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+/** Counters of transfers and events
+  *
+  * Counts are accumulated over the whole run and over the current output
+  * interval. At the end of every interval, the counts of the interval can be
+  * appended to a binary stats stream:
+  *
+  *   header: "CELSTATS" | version (u32) | ncounters (u32)
+  *           | names (null-terminated strings)
+  *   record: time (u32) | counts of the interval (ncounters x u64)
+  *
+  * in native endianness.
+  * */
+
+/** Counted quantities */
+enum class counter : unsigned
+{
+  put_calls,
+  get_calls,
+  bytes_to_device,
+  bytes_from_device,
+  divisions,
+  detachments,
+  shm_overwrites,
+  files_opened,
+  bytes_written,
+  count
+};
+
+/** Number of counters */
+constexpr unsigned ncounters = static_cast<unsigned>(counter::count);
+
+/** Name of a counter (as in the stats stream) */
+const char* counter_name(counter c);
+
+/** Accumulate counts over the run and over the current interval */
+class event_counters
+{
+  /** Stats stream (closed if not used) */
+  std::ofstream stream;
+
+public:
+  std::array<uint64_t, ncounters> total {}, interval {};
+
+  void add(counter c, uint64_t n = 1)
+  {
+    total[static_cast<unsigned>(c)] += n;
+    interval[static_cast<unsigned>(c)] += n;
+  }
+
+  /** Open the stats stream (the counts are written at every interval) */
+  void open(const std::string& fname);
+  /** End the current interval at time t (written to the stream if open) */
+  void end_interval(unsigned t);
+  /** Print the totals */
+  void print(std::ostream& stream) const;
+};
+
+/** Count a file written in the current scope
+ *
+ * The number of bytes written is the size of the file at the destruction,
+ * minus its size at the construction for files that are appended to or kept
+ * open between frames (buffered data is counted once flushed). Declare it
+ * before the stream, such that the stream is closed first.
+ * */
+class counted_file
+{
+  event_counters& counters;
+  std::string fname;
+  uint64_t before;
+
+public:
+  /** How the file is written */
+  enum class mode { overwrite, append, stream };
+
+  counted_file(event_counters& counters, const std::string& fname,
+               mode m = mode::overwrite);
+  ~counted_file();
+
+  counted_file(const counted_file&) = delete;
+  counted_file& operator=(const counted_file&) = delete;
+};
+
+#endif//COUNTERS_HPP_
@@ -21,6 +21,8 @@
 #include <iostream>
 #include <stdexcept>
 #include <curand_kernel.h> // Required for curandState
+#include <unordered_map>
+#include "memory.hpp"
 
 using namespace std;
 
@@ -41,26 +43,60 @@ void malloc_or_free(T*& ptr, size_t len, Model::ManageMemory which)
 // Typed memcpy to device memory (bidirectional)
 //---------------------------------------------------------------------
 
+/** Number of bytes copied between host and device (see counters.hpp) */
+static size_t copied_bytes = 0;
+
 template<class T, class U>
 void bidirectional_memcpy(T* device, U* host, size_t len, Model::CopyMemory dir) {
+    copied_bytes += len * sizeof(T);
     if (dir == Model::CopyMemory::HostToDevice)
         cudaMemcpy(device, static_cast<const void*>(host), len * sizeof(T), cudaMemcpyHostToDevice);
     else
         cudaMemcpy(static_cast<void*>(host), device, len * sizeof(T), cudaMemcpyDeviceToHost);
 }
 
+//---------------------------------------------------------------------
+// Device memory accounting (see memory.hpp)
+//---------------------------------------------------------------------
+
+/** Size of every live allocation */
+static unordered_map<void*, size_t> device_allocations;
+/** Sum of the sizes of the live allocations */
+static size_t device_bytes = 0;
+
+bool device_malloc(void** ptr, size_t bytes)
+{
+    if (cudaMalloc(ptr, bytes) != cudaSuccess) return false;
+    device_allocations[*ptr] = bytes;
+    device_bytes += bytes;
+    return true;
+}
+
+void device_free(void* ptr)
+{
+    if (!ptr) return;
+    const auto it = device_allocations.find(ptr);
+    if (it != device_allocations.end()) {
+        device_bytes -= it->second;
+        device_allocations.erase(it);
+    }
+    cudaFree(ptr);
+}
+
+size_t device_memory_in_use()
+{
+    return device_bytes;
+}
+
 template<class T>
 void malloc_or_free(T*& ptr, size_t len, Model::ManageMemory which) {
     if (which == Model::ManageMemory::Allocate) {
-        if (cudaMalloc((void**)&ptr, len * sizeof(T)) != cudaSuccess) {
+        if (!device_malloc(ptr, len)) {
             std::cerr << "CUDA malloc failed!" << std::endl;
             exit(EXIT_FAILURE);
         }
     } else {
-        if (ptr) {
-            cudaFree(ptr);
-            ptr = nullptr;
-        }
+        device_free(ptr);
     }
 }
 // -----------------------------------------------------------------------------
@@ -231,7 +267,6 @@ void Model::_copy_device_memory(CopyMemory dir)
 
         
     bidirectional_memcpy(d_field_press, &field_press[0], N, dir);
-    bidirectional_memcpy(d_neighbors, &neighbors[0], N, dir);
     bidirectional_memcpy(d_walls, &walls[0], N, dir);
     bidirectional_memcpy(d_walls_dx, &walls_dx[0], N, dir);
     bidirectional_memcpy(d_walls_dy, &walls_dy[0], N, dir);
@@ -254,11 +289,16 @@ void Model::_copy_device_memory(CopyMemory dir)
     bidirectional_memcpy(d_com_y, &com_y[0], nphases, dir);
     bidirectional_memcpy(d_com_z, &com_z[0], nphases, dir);
     
-    bidirectional_memcpy(d_neighbors_patch, &neighbors_patch[0], patch_N, dir);
-
-    bidirectional_memcpy(d_com_x_table, &com_x_table[0], Size[0], dir);
-    bidirectional_memcpy(d_com_y_table, &com_y_table[0], Size[1], dir);
-    bidirectional_memcpy(d_com_z_table, &com_z_table[0], Size[2], dir);
+    // the neighbours and tables are never modified on the device: they are
+    // not copied back, such that the host pages stay shared between branches
+    if(dir==CopyMemory::HostToDevice)
+    {
+      bidirectional_memcpy(d_neighbors, &neighbors[0], N, dir);
+      bidirectional_memcpy(d_neighbors_patch, &neighbors_patch[0], patch_N, dir);
+      bidirectional_memcpy(d_com_x_table, &com_x_table[0], Size[0], dir);
+      bidirectional_memcpy(d_com_y_table, &com_y_table[0], Size[1], dir);
+      bidirectional_memcpy(d_com_z_table, &com_z_table[0], Size[2], dir);
+    }
 
     for (unsigned i = 0; i < nphases; ++i)
     {
@@ -341,6 +381,7 @@ void Model::visTMP(unsigned t){
 void Model::AllocDeviceMemoryCellBirth()
 {
     _manage_device_memoryCellBirth(ManageMemory::Allocate);
+    TrackMemory("cells");
 }
 
 void Model::FreeDeviceMemoryCellBirth()
@@ -353,21 +394,32 @@ void Model::FreeDeviceMemoryCellBirth()
 void Model::AllocDeviceMemory()
 {
     _manage_device_memory(ManageMemory::Allocate);
+    TrackMemory("model");
 }
 
 void Model::FreeDeviceMemory()
 {
     _manage_device_memory(ManageMemory::Free);
+    malloc_or_free(d_cell_diag, 0, ManageMemory::Free);
+    cell_diag_capacity = 0;
 }
 
 void Model::PutToDevice()
 {
+    scoped_timer stage_timer(timers, stage::transfer);
+    const size_t before = copied_bytes;
     _copy_device_memory(CopyMemory::HostToDevice);
+    counters.add(counter::put_calls);
+    counters.add(counter::bytes_to_device, copied_bytes - before);
 }
 
 void Model::GetFromDevice()
 {
+    scoped_timer stage_timer(timers, stage::transfer);
+    const size_t before = copied_bytes;
     _copy_device_memory(CopyMemory::DeviceToHost);
+    counters.add(counter::get_calls);
+    counters.add(counter::bytes_from_device, copied_bytes - before);
 }
 
 void Model::QueryDeviceProperties()
@@ -422,6 +474,14 @@ void Model::InitializeCUDARandomNumbers()
     }
 }
 
+void Model::CopyRandomStates(std::vector<char>& buffer, CopyMemory dir)
+{
+    // the states are opaque, we store them as raw bytes
+    buffer.resize(N * sizeof(curandState));
+    bidirectional_memcpy(reinterpret_cast<char*>(d_rand_states), buffer.data(),
+                         buffer.size(), dir);
+}
+
 void Model::InitializeCuda()
 {
     n_total   = static_cast<int>(nphases_init * patch_N);
@@ -0,0 +1,394 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "host_header.hpp"
+#include "delta.hpp"
+#include "patch.hpp"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+/** Magic string at the beginning of the file */
+static const char df_magic[8] = { 'C', 'E', 'L', 'A', 'D', 'R', 'D', 'F' };
+/** Version of the file format */
+static const uint32_t df_version = 1;
+/** Control byte marking a run of exact predictions */
+static const unsigned char df_run = 0xff;
+
+/** Write POD value to stream */
+template<class T>
+static void write_pod(ostream& stream, const T& value)
+{
+  stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+/** Read POD value from stream */
+template<class T>
+static T read_pod(istream& stream)
+{
+  T value;
+  stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+  if(!stream) throw error_msg("unexpected end of delta archive.");
+  return value;
+}
+
+// =============================================================================
+// Codec
+
+/** Bits of a double */
+static uint64_t to_bits(double v)
+{
+  uint64_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  return bits;
+}
+
+/** Encode n values XORed with their prediction (previous value if ref is
+ * null) and append the result to buf */
+static void encode(const double* values, const double* ref, size_t n,
+                   vector<char>& buf)
+{
+  uint64_t prev = 0;
+  for(size_t k=0; k<n;)
+  {
+    const uint64_t bits = to_bits(values[k]);
+    const uint64_t x = bits^(ref ? to_bits(ref[k]) : prev);
+
+    if(x==0)
+    {
+      // run of exact predictions: control byte followed by varint length
+      size_t r = 1;
+      prev = bits;
+      while(k+r<n and to_bits(values[k+r])==(ref ? to_bits(ref[k+r]) : prev)) ++r;
+      buf.push_back(static_cast<char>(df_run));
+      for(size_t l=r; ; l>>=7)
+      {
+        if(l<0x80) { buf.push_back(static_cast<char>(l)); break; }
+        buf.push_back(static_cast<char>((l&0x7f)|0x80));
+      }
+      k += r;
+      continue;
+    }
+
+    // count zero bytes on both sides (x!=0 thus lead<8)
+    unsigned lead = 0, trail = 0;
+    while(((x>>(56-8*lead))&0xff)==0) ++lead;
+    while(((x>>(8*trail))&0xff)==0) ++trail;
+
+    buf.push_back(static_cast<char>((lead<<4)|trail));
+    for(unsigned i=trail; i<8-lead; ++i)
+      buf.push_back(static_cast<char>((x>>(8*i))&0xff));
+
+    prev = bits;
+    ++k;
+  }
+}
+
+/** Decode n values encoded with encode(), returns the bytes read */
+static size_t decode(const char* buf, double* values, const double* ref,
+                     size_t n)
+{
+  size_t pos = 0;
+  uint64_t prev = 0;
+  for(size_t k=0; k<n;)
+  {
+    const unsigned char ctrl = buf[pos++];
+
+    if(ctrl==df_run)
+    {
+      size_t r = 0;
+      for(unsigned shift=0; ; shift+=7)
+      {
+        const unsigned char b = buf[pos++];
+        r |= size_t(b&0x7f)<<shift;
+        if(!(b&0x80)) break;
+      }
+      if(k+r>n) throw error_msg("corrupted delta archive.");
+      for(; r>0; --r, ++k)
+      {
+        if(ref) prev = to_bits(ref[k]);
+        memcpy(&values[k], &prev, sizeof(prev));
+      }
+      continue;
+    }
+
+    const unsigned lead = ctrl>>4, trail = ctrl&0x0f;
+    uint64_t x = 0;
+    for(unsigned i=trail; i<8-lead; ++i)
+      x |= uint64_t(static_cast<unsigned char>(buf[pos++]))<<(8*i);
+
+    prev = x^(ref ? to_bits(ref[k]) : prev);
+    memcpy(&values[k], &prev, sizeof(prev));
+    ++k;
+  }
+  return pos;
+}
+
+// =============================================================================
+// Geometry
+
+void delta_geometry::set_geometry(const delta_coord& Size_,
+                                  const delta_coord& patch_size_)
+{
+  Size = Size_;
+  patch_size = patch_size_;
+  patch_N = size_t(patch_size[0])*patch_size[1]*patch_size[2];
+  N = size_t(Size[0])*Size[1]*Size[2];
+}
+
+void delta_geometry::predict_phi(const delta_frame& prev,
+                                 const map<unsigned, unsigned>& prev_index,
+                                 const delta_frame& cur, unsigned n,
+                                 vector<double>& pred) const
+{
+  pred.assign(patch_N, 0.);
+
+  const auto it = prev_index.find(cur.ids[n]);
+  if(it==prev_index.end()) return;
+  const unsigned m = it->second;
+
+  const auto& pmin = cur.patch_min[n];
+  const auto& off  = cur.offset[n];
+  const auto& prev_pmin = prev.patch_min[m];
+  const auto& prev_off  = prev.offset[m];
+  const auto& prev_phi  = prev.phi[m];
+
+  // same memory layout as the model (see patch.hpp)
+  for(size_t q=0; q<patch_N; ++q)
+  {
+    // domain position of node q of the current patch
+    const auto x = domain_position_from_patch(q, patch_size, off, pmin, Size);
+
+    delta_coord p;
+    bool inside = true;
+    for(unsigned d=0; d<3; ++d)
+    {
+      // position relative to the previous patch
+      p[d] = (x[d] + Size[d] - prev_pmin[d])%Size[d];
+      if(p[d]>=patch_size[d]) { inside = false; break; }
+      p[d] = (p[d] + patch_size[d] - prev_off[d])%patch_size[d];
+    }
+
+    if(inside)
+      pred[q] = prev_phi[domain_index(p, patch_size)];
+  }
+}
+
+// =============================================================================
+// Writer
+
+deltawriter::deltawriter(const string& fname, const delta_coord& Size_,
+                         const delta_coord& patch_size_, unsigned interval_)
+  : stream(fname, ios::out | ios::binary),
+    interval(max(interval_, 1u))
+{
+  set_geometry(Size_, patch_size_);
+
+  if(!stream.good())
+    throw error_msg("can not open delta archive ", fname, ".");
+
+  stream.write(df_magic, sizeof(df_magic));
+  write_pod(stream, df_version);
+  for(const auto s : Size) write_pod(stream, s);
+  for(const auto s : patch_size) write_pod(stream, s);
+  write_pod(stream, uint32_t(interval));
+}
+
+void deltawriter::write(delta_frame&& frame)
+{
+  const bool key = count%interval==0;
+  const unsigned ncells = frame.ids.size();
+
+  // encode data
+  vector<char> data;
+  vector<double> pred;
+  for(unsigned n=0; n<ncells; ++n)
+  {
+    if(frame.phi[n].size()!=patch_N)
+      throw error_msg("wrong patch size in delta archive.");
+
+    if(!key and prev_index.count(frame.ids[n]))
+    {
+      predict_phi(prev, prev_index, frame, n, pred);
+      encode(frame.phi[n].data(), pred.data(), patch_N, data);
+    }
+    else encode(frame.phi[n].data(), nullptr, patch_N, data);
+  }
+  for(unsigned k=0; k<frame.stress.size(); ++k)
+  {
+    if(frame.stress[k].size()!=N)
+      throw error_msg("wrong stress field size in delta archive.");
+
+    const bool has_prev = !key and prev.stress[k].size()==N;
+    encode(frame.stress[k].data(), has_prev ? prev.stress[k].data() : nullptr,
+           N, data);
+  }
+
+  // write frame
+  write_pod(stream, uint32_t(frame.time));
+  write_pod(stream, uint8_t(key));
+  write_pod(stream, uint32_t(ncells));
+  write_pod(stream, uint64_t(data.size()));
+  for(unsigned n=0; n<ncells; ++n)
+  {
+    write_pod(stream, uint32_t(frame.ids[n]));
+    for(const auto x : frame.patch_min[n]) write_pod(stream, x);
+    for(const auto x : frame.offset[n]) write_pod(stream, x);
+  }
+  stream.write(data.data(), data.size());
+  stream.flush();
+  if(!stream.good()) throw error_msg("error while writing delta archive.");
+
+  // the frame is the prediction for the next one
+  prev = move(frame);
+  prev_index.clear();
+  for(unsigned n=0; n<ncells; ++n) prev_index[prev.ids[n]] = n;
+  ++count;
+}
+
+// =============================================================================
+// Reader
+
+/** Read coordinate from stream */
+static delta_coord read_coord(istream& stream)
+{
+  delta_coord c;
+  for(auto& x : c) x = read_pod<uint32_t>(stream);
+  return c;
+}
+
+deltareader::deltareader(const string& fname)
+  : stream(fname, ios::in | ios::binary)
+{
+  if(!stream.good())
+    throw error_msg("can not open delta archive ", fname, ".");
+
+  char magic[sizeof(df_magic)];
+  stream.read(magic, sizeof(magic));
+  if(!stream or memcmp(magic, df_magic, sizeof(magic)))
+    throw error_msg("file ", fname, " is not a delta archive.");
+  if(read_pod<uint32_t>(stream)!=df_version)
+    throw error_msg("unsupported delta archive version.");
+
+  const auto Size_ = read_coord(stream);
+  const auto patch_size_ = read_coord(stream);
+  set_geometry(Size_, patch_size_);
+  interval = read_pod<uint32_t>(stream);
+
+  // scan frames, skipping the data sections
+  while(stream.peek()!=char_traits<char>::eof())
+  {
+    frame_index fi;
+    fi.pos  = stream.tellg();
+    fi.time = read_pod<uint32_t>(stream);
+    fi.key  = read_pod<uint8_t>(stream);
+    const auto ncells = read_pod<uint32_t>(stream);
+    const auto size   = read_pod<uint64_t>(stream);
+
+    if(frames.empty() and !fi.key)
+      throw error_msg("delta archive does not start with a keyframe.");
+
+    stream.seekg(ncells*7*sizeof(uint32_t) + size, ios::cur);
+    frames.push_back(fi);
+  }
+  stream.clear();
+}
+
+vector<unsigned> deltareader::times() const
+{
+  vector<unsigned> t;
+  for(const auto& f : frames) t.push_back(f.time);
+  return t;
+}
+
+void deltareader::decode(size_t i)
+{
+  const auto& fi = frames[i];
+  stream.seekg(fi.pos);
+
+  delta_frame frame;
+  frame.time = read_pod<uint32_t>(stream);
+  read_pod<uint8_t>(stream);
+  const auto ncells = read_pod<uint32_t>(stream);
+  const auto size   = read_pod<uint64_t>(stream);
+
+  frame.ids.resize(ncells);
+  frame.patch_min.resize(ncells);
+  frame.offset.resize(ncells);
+  for(unsigned n=0; n<ncells; ++n)
+  {
+    frame.ids[n] = read_pod<uint32_t>(stream);
+    frame.patch_min[n] = read_coord(stream);
+    frame.offset[n] = read_coord(stream);
+  }
+
+  vector<char> data(size);
+  stream.read(data.data(), size);
+  if(!stream) throw error_msg("unexpected end of delta archive.");
+
+  size_t pos = 0;
+  vector<double> pred;
+  frame.phi.resize(ncells);
+  for(unsigned n=0; n<ncells; ++n)
+  {
+    frame.phi[n].resize(patch_N);
+    if(!fi.key and last_index.count(frame.ids[n]))
+    {
+      predict_phi(last, last_index, frame, n, pred);
+      pos += ::decode(&data[pos], frame.phi[n].data(), pred.data(), patch_N);
+    }
+    else pos += ::decode(&data[pos], frame.phi[n].data(), nullptr, patch_N);
+  }
+  for(unsigned k=0; k<frame.stress.size(); ++k)
+  {
+    frame.stress[k].resize(N);
+    const bool has_prev = !fi.key and last.stress[k].size()==N;
+    pos += ::decode(&data[pos], frame.stress[k].data(),
+                    has_prev ? last.stress[k].data() : nullptr, N);
+  }
+  if(pos!=size) throw error_msg("corrupted delta archive.");
+
+  last = move(frame);
+  last_index.clear();
+  for(unsigned n=0; n<ncells; ++n) last_index[last.ids[n]] = n;
+  current = i;
+}
+
+const delta_frame& deltareader::read_frame(size_t i)
+{
+  if(i>=frames.size()) throw error_msg("frame ", i, " does not exist.");
+  if(long(i)==current) return last;
+
+  // find nearest keyframe
+  size_t k = i;
+  while(!frames[k].key) --k;
+
+  // continue from the last decoded frame if possible
+  size_t start = k;
+  if(current>=long(k) and current<long(i)) start = current+1;
+
+  for(size_t j=start; j<=i; ++j) decode(j);
+  return last;
+}
+
+const delta_frame& deltareader::read_time(unsigned t)
+{
+  for(size_t i=0; i<frames.size(); ++i)
+    if(frames[i].time==t) return read_frame(i);
+
+  throw error_msg("no frame at time ", t, " in delta archive.");
+}
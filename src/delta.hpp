@@ -0,0 +1,162 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DELTA_HPP_
+#define DELTA_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <array>
+#include <map>
+#include <fstream>
+
+/** Delta-encoded archive of the phase and stress fields
+  *
+  * Successive frames differ only slightly, so that we store periodic keyframes
+  * followed by frames encoded against a prediction built from the previous
+  * frame. The prediction of phi for a given cell is the phase field of the
+  * same cell (persistent id) in the previous frame, read at the same domain
+  * position: the patch displacement (patch_min and offset) is thus taken into
+  * account. The stress fields are predicted by their previous values.
+  *
+  * Values are XORed with their prediction and stored as a control byte (number
+  * of leading and trailing zero bytes) followed by the remaining significant
+  * bytes. Runs of exact predictions are stored as a single run-length. In
+  * keyframes (and for cells that were not present in the previous frame) the
+  * prediction is the previous value in memory order. The encoding is lossless.
+  *
+  * Layout (native endianness):
+  *
+  *   header : "CELADRDF" | u32 version | u32 Size[3] | u32 patch_size[3]
+  *            | u32 keyframe interval
+  *   frame  : u32 time | u8 keyframe | u32 ncells | u64 data size
+  *            | ncells x (u32 id, u32 patch_min[3], u32 offset[3]) | data
+  *   data   : ncells x phi (patch_N values), then sxx, syy, szz, sxy, sxz, syz
+  * */
+
+/** Grid coordinate */
+using delta_coord = std::array<uint32_t, 3>;
+
+/** Content of a frame of the delta archive */
+struct delta_frame
+{
+  /** Time of the frame */
+  unsigned time = 0;
+  /** Persistent ids of the cells */
+  std::vector<unsigned> ids;
+  /** Patch position and memory offset of each cell */
+  std::vector<delta_coord> patch_min, offset;
+  /** Phase fields, one per cell (patch) */
+  std::vector<std::vector<double>> phi;
+  /** Stress fields sxx, syy, szz, sxy, sxz, syz (domain) */
+  std::array<std::vector<double>, 6> stress;
+};
+
+/** Geometry shared by writer and reader */
+class delta_geometry
+{
+protected:
+  /** Size of the domain and of the patches */
+  delta_coord Size, patch_size;
+  /** Number of nodes in a patch and in the domain */
+  std::size_t patch_N = 0, N = 0;
+
+  /** Set the sizes of the domain and of the patches */
+  void set_geometry(const delta_coord& Size_, const delta_coord& patch_size_);
+
+  /** Build the prediction of phi of cell n of frame cur from frame prev */
+  void predict_phi(const delta_frame& prev, const std::map<unsigned, unsigned>&
+                   prev_index, const delta_frame& cur, unsigned n,
+                   std::vector<double>& pred) const;
+};
+
+/** Writer for the delta archive */
+class deltawriter : delta_geometry
+{
+  /** The output file */
+  std::ofstream stream;
+  /** Number of frames between keyframes */
+  unsigned interval;
+  /** Number of frames written */
+  unsigned count = 0;
+  /** Previous frame and index of its cells */
+  delta_frame prev;
+  std::map<unsigned, unsigned> prev_index;
+
+public:
+  /** Constructor
+   *
+   * Arguments are the file name, the size of the domain and of the patches,
+   * and the number of frames between two keyframes.
+   * */
+  deltawriter(const std::string& fname, const delta_coord& Size,
+              const delta_coord& patch_size, unsigned interval=16);
+
+  /** Append frame (moved into the writer, as it is the next prediction) */
+  void write(delta_frame&& frame);
+};
+
+/** Reader for the delta archive
+  *
+  * Only the frame headers are read at construction. Any frame is then
+  * reconstructed by replaying from the nearest preceding keyframe; the last
+  * decoded frame is kept such that reading frames in order is cheap.
+  * */
+class deltareader : delta_geometry
+{
+  /** Position of a frame in the file */
+  struct frame_index
+  {
+    unsigned time;
+    bool key;
+    uint64_t pos;
+  };
+
+  /** The input file */
+  std::ifstream stream;
+  /** Keyframe interval */
+  unsigned interval;
+  /** Index of all frames */
+  std::vector<frame_index> frames;
+  /** Last decoded frame */
+  delta_frame last;
+  std::map<unsigned, unsigned> last_index;
+  /** Position of the last decoded frame (-1 if none) */
+  long current = -1;
+
+  /** Decode frame i, the previous frame must be the last decoded one */
+  void decode(std::size_t i);
+
+public:
+  /** Open file and read frame headers */
+  explicit deltareader(const std::string& fname);
+
+  /** Number of frames */
+  std::size_t size() const
+  { return frames.size(); }
+
+  /** Times of all the frames */
+  std::vector<unsigned> times() const;
+
+  /** Reconstruct frame i */
+  const delta_frame& read_frame(std::size_t i);
+
+  /** Reconstruct frame at time t */
+  const delta_frame& read_time(unsigned t);
+};
+
+#endif//DELTA_HPP_
@@ -0,0 +1,172 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "header.hpp"
+#include "model.hpp"
+
+using namespace std;
+
+void diagnostics::merge(const diagnostics& d)
+{
+  t      = d.t;
+  ncells = d.ncells;
+  if(abs(d.volume_drift)>abs(volume_drift)) volume_drift = d.volume_drift;
+  if(d.volume_ratio>volume_ratio)
+  {
+    volume_ratio = d.volume_ratio;
+    volume_cell  = d.volume_cell;
+  }
+  phi_min   = min(phi_min, d.phi_min);
+  phi_max   = max(phi_max, d.phi_max);
+  nonfinite = max(nonfinite, d.nonfinite);
+  speed_max = max(speed_max, d.speed_max);
+  if(d.leakage>leakage)
+  {
+    leakage      = d.leakage;
+    leakage_cell = d.leakage_cell;
+  }
+  count += d.count;
+}
+
+void diagnostics::print(ostream& stream) const
+{
+  stream << "  " << setw(20) << left << "cells" << ncells << '\n'
+         << "  " << setw(20) << "volume drift"
+         << 100*volume_drift << " %\n"
+         << "  " << setw(20) << "cell volume / vimp"
+         << volume_ratio << " (cell " << volume_cell << ")\n"
+         << "  " << setw(20) << "phi range"
+         << '[' << phi_min << ", " << phi_max << "]\n"
+         << "  " << setw(20) << "max speed" << speed_max << '\n'
+         << "  " << setw(20) << "patch leakage"
+         << leakage << " (cell " << leakage_cell << ")\n"
+         << "  " << setw(20) << "non-finite values" << nonfinite << '\n'
+         << right;
+}
+
+void Model::Diagnose()
+{
+  ComputeCellDiagnostics();
+
+  diagnostics d;
+  d.t      = globalT/((npc+1)*nsubsteps);
+  d.ncells = cell_diag.size();
+  d.count  = 1;
+
+  double volume = 0;
+  for(unsigned n=0; n<cell_diag.size(); ++n)
+  {
+    const auto& c = cell_diag[n];
+    d.nonfinite += c.nonfinite;
+    if(c.nonfinite) continue;
+
+    volume += c.volume;
+    // vanishing cells are infinitely small
+    const double ratio = c.volume>0 ? max(c.volume/vimp, vimp/c.volume)
+                                    : numeric_limits<double>::infinity();
+    if(ratio>d.volume_ratio)
+    {
+      d.volume_ratio = ratio;
+      d.volume_cell  = n;
+    }
+
+    d.phi_min   = min(d.phi_min, c.phi_min);
+    d.phi_max   = max(d.phi_max, c.phi_max);
+    d.speed_max = max(d.speed_max, c.speed);
+
+    const double leakage = c.mass>0 ? c.edge_mass/c.mass : 0;
+    if(leakage>d.leakage)
+    {
+      d.leakage      = leakage;
+      d.leakage_cell = n;
+    }
+  }
+
+  if(d.ncells)
+  {
+    const double mean = volume/d.ncells;
+    if(diag_volume_ref==0) diag_volume_ref = mean;
+    d.volume_drift = mean/diag_volume_ref - 1;
+  }
+
+  diag_last = d;
+  diag_interval.merge(d);
+  diag_run.merge(d);
+
+  if(!runtime_check) return;
+
+  try
+  {
+    RuntimeChecks();
+  }
+  catch(const warning_msg& e)
+  {
+    if(stop_at_warning) throw;
+    else if(verbose and !no_warning) cerr << "warning: " << e.what() << "\n";
+  }
+}
+
+void Model::PreRunStats()
+{
+  if(!runtime_check and !runtime_stats) return;
+
+  // the initial state is the reference for the volume drift
+  diag_volume_ref = 0;
+  Diagnose();
+
+  if(runtime_stats and verbose)
+  {
+    cout << "Initial state :" << endl;
+    diag_last.print(cout);
+    cout << endl;
+  }
+}
+
+void Model::RuntimeStats()
+{
+  if(diag_interval.count==0) return;
+
+  cout << "runtime stats (worst of " << diag_interval.count << " checks) :\n";
+  diag_interval.print(cout);
+  diag_interval = diagnostics();
+}
+
+void Model::RuntimeChecks()
+{
+  const auto& d = diag_last;
+
+  // no way back
+  if(d.nonfinite)
+    throw error_msg("found ", d.nonfinite, " non-finite values at t = ", d.t,
+                    ".");
+
+  if(d.phi_min<-check_phi or d.phi_max>1+check_phi)
+    throw warning_msg("phi out of range at t = ", d.t, ": [", d.phi_min,
+                      ", ", d.phi_max, "].");
+
+  if(d.volume_ratio>check_volume)
+    throw warning_msg("volume of cell ", d.volume_cell, " is ", d.volume_ratio,
+                      " times off vimp at t = ", d.t, ".");
+
+  if(d.leakage>check_leakage)
+    throw warning_msg("cell ", d.leakage_cell, " leaks out of its patch at t = ",
+                      d.t, " (", 100*d.leakage, " % of phi on the faces).");
+
+  // a cell should not move by more than one node per time step
+  if(d.speed_max*time_step>1)
+    throw warning_msg("velocity too large at t = ", d.t, ": ", d.speed_max,
+                      " (time step ", time_step, ").");
+}
@@ -0,0 +1,133 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "header.hpp"
+#include "model.hpp"
+#include "memory.hpp"
+#include "cuda.h"
+#include <cfloat>
+
+using namespace std;
+
+/** Threads per block of the reduction (one block per cell, power of two) */
+#define DiagnosticsThreads 256
+
+__global__
+void cuCellDiagnostics(const double *phi,
+                       const double *vol,
+                       const vec<double,3> *velocity,
+                       const coord *offset,
+                       coord patch_size,
+                       unsigned patch_N,
+                       cell_diagnostics *out)
+{
+	__shared__ double s_mass[DiagnosticsThreads];
+	__shared__ double s_edge[DiagnosticsThreads];
+	__shared__ double s_min[DiagnosticsThreads];
+	__shared__ double s_max[DiagnosticsThreads];
+	__shared__ unsigned s_bad[DiagnosticsThreads];
+
+	const unsigned n = blockIdx.x;
+	const unsigned i = threadIdx.x;
+
+	double mass = 0, edge = 0, pmin = DBL_MAX, pmax = -DBL_MAX;
+	unsigned bad = 0;
+
+	for(unsigned q=i; q<patch_N; q+=blockDim.x)
+	{
+		const double p = phi[size_t(n)*patch_N + q];
+		if(!isfinite(p)) { ++bad; continue; }
+
+		mass += p;
+		pmin  = fmin(pmin, p);
+		pmax  = fmax(pmax, p);
+
+		// position on the patch, with the memory offset removed
+		const coord qpos = { (q/patch_size[1])%patch_size[0] , q%patch_size[1]  , q/( patch_size[0]*patch_size[1] ) };
+		const coord pos  = ( qpos + offset[n] )%patch_size;
+
+		bool on_edge = false;
+		for(unsigned d=0; d<3; ++d)
+			if(patch_size[d]>1 and (pos[d]==0 or pos[d]==patch_size[d]-1u)) on_edge = true;
+		if(on_edge) edge += fabs(p);
+	}
+
+	s_mass[i] = mass;
+	s_edge[i] = edge;
+	s_min[i]  = pmin;
+	s_max[i]  = pmax;
+	s_bad[i]  = bad;
+	__syncthreads();
+
+	for(unsigned s=blockDim.x/2; s>0; s/=2)
+	{
+		if(i<s)
+		{
+			s_mass[i] += s_mass[i+s];
+			s_edge[i] += s_edge[i+s];
+			s_min[i]   = fmin(s_min[i], s_min[i+s]);
+			s_max[i]   = fmax(s_max[i], s_max[i+s]);
+			s_bad[i]  += s_bad[i+s];
+		}
+		__syncthreads();
+	}
+
+	if(i==0)
+	{
+		// (abs() is the squared norm)
+		const double speed = sqrt(velocity[n].abs());
+		out[n] = { s_mass[0], s_edge[0], s_min[0], s_max[0], vol[n], speed,
+		           s_bad[0] + !isfinite(vol[n]) + !isfinite(speed) };
+	}
+}
+
+void Model::ComputeCellDiagnostics()
+{
+  // all the cells have been removed or killed (a grid of zero blocks is not a
+  // valid launch)
+  if(nphases==0)
+  {
+    cell_diag.clear();
+    return;
+  }
+
+  if(cell_diag_capacity<nphases)
+  {
+    device_free(d_cell_diag);
+    if(!device_malloc(d_cell_diag, nphases))
+      throw error_msg("can not allocate the device memory of the diagnostics.");
+    cell_diag_capacity = nphases;
+    TrackMemory("diagnostics");
+  }
+
+  cuCellDiagnostics<<<nphases, DiagnosticsThreads>>>(d_phi,
+                                                     d_vol,
+                                                     d_velocity,
+                                                     d_offset,
+                                                     patch_size,
+                                                     patch_N,
+                                                     d_cell_diag);
+
+  const cudaError_t err = cudaGetLastError();
+  if(err!=cudaSuccess)
+    throw error_msg("cuCellDiagnostics launch error: ", cudaGetErrorString(err));
+  cudaDeviceSynchronize();
+
+  cell_diag.resize(nphases);
+  cudaMemcpy(cell_diag.data(), d_cell_diag, nphases*sizeof(cell_diagnostics),
+             cudaMemcpyDeviceToHost);
+  counters.add(counter::bytes_from_device, nphases*sizeof(cell_diagnostics));
+}
@@ -0,0 +1,72 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DIAGNOSTICS_HPP_
+#define DIAGNOSTICS_HPP_
+
+#include <iostream>
+#include <limits>
+
+/** Runtime invariants of the model
+  *
+  * The phase fields are reduced on the device, one block per cell, and only the
+  * per-cell results are copied back to the host where they are reduced further.
+  * This is cheap enough to be done every few steps (see --check-every).
+  * */
+
+/** Reductions over the patch of a cell (computed on the device) */
+struct cell_diagnostics
+{
+  /** Sum of phi over the patch and over the faces of the patch */
+  double mass, edge_mass;
+  /** Extrema of phi */
+  double phi_min, phi_max;
+  /** Volume (sum of phi^2, as computed by the update) and speed */
+  double volume, speed;
+  /** Number of non-finite values (phi, volume and velocity) */
+  unsigned nonfinite;
+};
+
+/** Invariants of the whole model at a given time */
+struct diagnostics
+{
+  /** Time and number of cells */
+  unsigned t = 0, ncells = 0;
+  /** Drift of the mean cell volume from its initial value */
+  double volume_drift = 0;
+  /** Largest ratio between a cell volume and vimp (or its inverse) */
+  double volume_ratio = 1;
+  unsigned volume_cell = 0;
+  /** Extrema of phi over all cells */
+  double phi_min = std::numeric_limits<double>::max();
+  double phi_max = std::numeric_limits<double>::lowest();
+  /** Number of non-finite values */
+  unsigned nonfinite = 0;
+  /** Largest speed of a cell */
+  double speed_max = 0;
+  /** Largest fraction of the phi mass of a cell on the faces of its patch */
+  double leakage = 0;
+  unsigned leakage_cell = 0;
+  /** Number of diagnostics merged */
+  unsigned count = 0;
+
+  /** Merge with other diagnostics, keeping the worst values */
+  void merge(const diagnostics& d);
+  /** Print a summary */
+  void print(std::ostream& stream) const;
+};
+
+#endif//DIAGNOSTICS_HPP_
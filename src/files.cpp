@@ -14,7 +14,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include "header.hpp"
+#include "host_header.hpp"
 #include "files.hpp"
 using namespace std;
 
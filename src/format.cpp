@@ -0,0 +1,443 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "format.hpp"
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+// =============================================================================
+// Grisu2
+//
+// See F. Loitsch, Printing Floating-Point Numbers Quickly and Accurately with
+// Integers, PLDI 2010. The implementation follows closely the one found in
+// nlohmann/json (MIT license).
+
+namespace
+{
+  /** Floating point number f*2^e with 64 bits significand */
+  struct diyfp
+  {
+    uint64_t f;
+    int e;
+
+    diyfp(uint64_t f_, int e_) : f(f_), e(e_) {}
+
+    /** x - y, both must have the same exponent and x.f >= y.f */
+    static diyfp sub(const diyfp& x, const diyfp& y)
+    { return { x.f - y.f, x.e }; }
+
+    /** x * y, rounded (ties up) to 64 bits */
+    static diyfp mul(const diyfp& x, const diyfp& y)
+    {
+      const uint64_t u_lo = x.f & 0xFFFFFFFFu, u_hi = x.f >> 32;
+      const uint64_t v_lo = y.f & 0xFFFFFFFFu, v_hi = y.f >> 32;
+
+      const uint64_t p0 = u_lo*v_lo;
+      const uint64_t p1 = u_lo*v_hi;
+      const uint64_t p2 = u_hi*v_lo;
+      const uint64_t p3 = u_hi*v_hi;
+
+      uint64_t Q = (p0 >> 32) + (p1 & 0xFFFFFFFFu) + (p2 & 0xFFFFFFFFu);
+      Q += uint64_t(1) << 31;
+
+      return { p3 + (p2 >> 32) + (p1 >> 32) + (Q >> 32), x.e + y.e + 64 };
+    }
+
+    /** Normalize such that the most significant bit is set */
+    static diyfp normalize(diyfp x)
+    {
+      while((x.f >> 63) == 0)
+      {
+        x.f <<= 1;
+        x.e--;
+      }
+      return x;
+    }
+
+    /** Normalize to given exponent (which must be smaller) */
+    static diyfp normalize_to(const diyfp& x, int e)
+    { return { x.f << (x.e - e), e }; }
+  };
+
+  /** Value and its boundaries m- and m+ */
+  struct boundaries
+  {
+    diyfp w, minus, plus;
+  };
+
+  /** Compute the boundaries of a (positive, finite) floating point value */
+  template<class T>
+  boundaries compute_boundaries(T value)
+  {
+    using bits_type = typename std::conditional<sizeof(T)==8, uint64_t, uint32_t>::type;
+
+    constexpr int precision = std::numeric_limits<T>::digits;
+    constexpr int bias = std::numeric_limits<T>::max_exponent - 1 + (precision - 1);
+    constexpr int min_exp = 1 - bias;
+    constexpr uint64_t hidden_bit = uint64_t(1) << (precision - 1);
+
+    bits_type raw;
+    std::memcpy(&raw, &value, sizeof(raw));
+    const uint64_t bits = raw;
+    const uint64_t E = bits >> (precision - 1);
+    const uint64_t F = bits & (hidden_bit - 1);
+
+    const diyfp v = E==0 ? diyfp(F, min_exp)
+                         : diyfp(F + hidden_bit, static_cast<int>(E) - bias);
+
+    // the lower boundary is closer if the significand is a power of two
+    const bool lower_closer = F==0 and E>1;
+    const diyfp m_plus  = diyfp(2*v.f + 1, v.e - 1);
+    const diyfp m_minus = lower_closer ? diyfp(4*v.f - 1, v.e - 2)
+                                       : diyfp(2*v.f - 1, v.e - 1);
+
+    const diyfp w_plus  = diyfp::normalize(m_plus);
+    const diyfp w_minus = diyfp::normalize_to(m_minus, w_plus.e);
+
+    return { diyfp::normalize(v), w_minus, w_plus };
+  }
+
+  /** Range of binary exponents after multiplication by the cached power */
+  constexpr int alpha = -60;
+
+  /** Cached power of ten c = f*2^e ~= 10^k */
+  struct cached_power
+  {
+    uint64_t f;
+    int e;
+    int k;
+  };
+
+  /** Normalized powers of ten from 10^-300 to 10^324 (step 8) */
+  const cached_power cached_powers[] = {
+  { 0xAB70FE17C79AC6CA, -1060, -300 },
+  { 0xFF77B1FCBEBCDC4F, -1034, -292 },
+  { 0xBE5691EF416BD60C, -1007, -284 },
+  { 0x8DD01FAD907FFC3C,  -980, -276 },
+  { 0xD3515C2831559A83,  -954, -268 },
+  { 0x9D71AC8FADA6C9B5,  -927, -260 },
+  { 0xEA9C227723EE8BCB,  -901, -252 },
+  { 0xAECC49914078536D,  -874, -244 },
+  { 0x823C12795DB6CE57,  -847, -236 },
+  { 0xC21094364DFB5637,  -821, -228 },
+  { 0x9096EA6F3848984F,  -794, -220 },
+  { 0xD77485CB25823AC7,  -768, -212 },
+  { 0xA086CFCD97BF97F4,  -741, -204 },
+  { 0xEF340A98172AACE5,  -715, -196 },
+  { 0xB23867FB2A35B28E,  -688, -188 },
+  { 0x84C8D4DFD2C63F3B,  -661, -180 },
+  { 0xC5DD44271AD3CDBA,  -635, -172 },
+  { 0x936B9FCEBB25C996,  -608, -164 },
+  { 0xDBAC6C247D62A584,  -582, -156 },
+  { 0xA3AB66580D5FDAF6,  -555, -148 },
+  { 0xF3E2F893DEC3F126,  -529, -140 },
+  { 0xB5B5ADA8AAFF80B8,  -502, -132 },
+  { 0x87625F056C7C4A8B,  -475, -124 },
+  { 0xC9BCFF6034C13053,  -449, -116 },
+  { 0x964E858C91BA2655,  -422, -108 },
+  { 0xDFF9772470297EBD,  -396, -100 },
+  { 0xA6DFBD9FB8E5B88F,  -369,  -92 },
+  { 0xF8A95FCF88747D94,  -343,  -84 },
+  { 0xB94470938FA89BCF,  -316,  -76 },
+  { 0x8A08F0F8BF0F156B,  -289,  -68 },
+  { 0xCDB02555653131B6,  -263,  -60 },
+  { 0x993FE2C6D07B7FAC,  -236,  -52 },
+  { 0xE45C10C42A2B3B06,  -210,  -44 },
+  { 0xAA242499697392D3,  -183,  -36 },
+  { 0xFD87B5F28300CA0E,  -157,  -28 },
+  { 0xBCE5086492111AEB,  -130,  -20 },
+  { 0x8CBCCC096F5088CC,  -103,  -12 },
+  { 0xD1B71758E219652C,   -77,   -4 },
+  { 0x9C40000000000000,   -50,    4 },
+  { 0xE8D4A51000000000,   -24,   12 },
+  { 0xAD78EBC5AC620000,     3,   20 },
+  { 0x813F3978F8940984,    30,   28 },
+  { 0xC097CE7BC90715B3,    56,   36 },
+  { 0x8F7E32CE7BEA5C70,    83,   44 },
+  { 0xD5D238A4ABE98068,   109,   52 },
+  { 0x9F4F2726179A2245,   136,   60 },
+  { 0xED63A231D4C4FB27,   162,   68 },
+  { 0xB0DE65388CC8ADA8,   189,   76 },
+  { 0x83C7088E1AAB65DB,   216,   84 },
+  { 0xC45D1DF942711D9A,   242,   92 },
+  { 0x924D692CA61BE758,   269,  100 },
+  { 0xDA01EE641A708DEA,   295,  108 },
+  { 0xA26DA3999AEF774A,   322,  116 },
+  { 0xF209787BB47D6B85,   348,  124 },
+  { 0xB454E4A179DD1877,   375,  132 },
+  { 0x865B86925B9BC5C2,   402,  140 },
+  { 0xC83553C5C8965D3D,   428,  148 },
+  { 0x952AB45CFA97A0B3,   455,  156 },
+  { 0xDE469FBD99A05FE3,   481,  164 },
+  { 0xA59BC234DB398C25,   508,  172 },
+  { 0xF6C69A72A3989F5C,   534,  180 },
+  { 0xB7DCBF5354E9BECE,   561,  188 },
+  { 0x88FCF317F22241E2,   588,  196 },
+  { 0xCC20CE9BD35C78A5,   614,  204 },
+  { 0x98165AF37B2153DF,   641,  212 },
+  { 0xE2A0B5DC971F303A,   667,  220 },
+  { 0xA8D9D1535CE3B396,   694,  228 },
+  { 0xFB9B7CD9A4A7443C,   720,  236 },
+  { 0xBB764C4CA7A44410,   747,  244 },
+  { 0x8BAB8EEFB6409C1A,   774,  252 },
+  { 0xD01FEF10A657842C,   800,  260 },
+  { 0x9B10A4E5E9913129,   827,  268 },
+  { 0xE7109BFBA19C0C9D,   853,  276 },
+  { 0xAC2820D9623BF429,   880,  284 },
+  { 0x80444B5E7AA7CF85,   907,  292 },
+  { 0xBF21E44003ACDD2D,   933,  300 },
+  { 0x8E679C2F5E44FF8F,   960,  308 },
+  { 0xD433179D9C8CB841,   986,  316 },
+  { 0x9E19DB92B4E31BA9,  1013,  324 }
+  };
+
+  /** Return cached power such that alpha <= e + c.e + 64 <= gamma */
+  cached_power get_cached_power(int e)
+  {
+    const int min_dec_exp = -300;
+    const int dec_step = 8;
+
+    const int f = alpha - e - 1;
+    const int k = (f * 78913) / (1 << 18) + static_cast<int>(f > 0);
+    const int index = (-min_dec_exp + k + (dec_step - 1)) / dec_step;
+
+    return cached_powers[index];
+  }
+
+  /** Largest power of ten smaller than n, returns the number of digits */
+  int find_largest_pow10(uint32_t n, uint32_t& pow10)
+  {
+    int digits = 10;
+    pow10 = 1000000000;
+    while(pow10>n and digits>1)
+    {
+      pow10 /= 10;
+      --digits;
+    }
+    return digits;
+  }
+
+  /** Move the last digit towards w */
+  void grisu2_round(char* buf, int len, uint64_t dist, uint64_t delta,
+                    uint64_t rest, uint64_t ten_k)
+  {
+    while(rest < dist
+          and delta - rest >= ten_k
+          and (rest + ten_k < dist or dist - rest > rest + ten_k - dist))
+    {
+      buf[len - 1]--;
+      rest += ten_k;
+    }
+  }
+
+  /** Generate the digits of M+, stop as soon as we are within [M-, M+] */
+  void grisu2_digit_gen(char* buf, int& len, int& dec_exp,
+                        diyfp M_minus, diyfp w, diyfp M_plus)
+  {
+    uint64_t delta = diyfp::sub(M_plus, M_minus).f;
+    uint64_t dist  = diyfp::sub(M_plus, w).f;
+
+    const diyfp one(uint64_t(1) << -M_plus.e, M_plus.e);
+
+    // integral and fractional parts
+    uint32_t p1 = static_cast<uint32_t>(M_plus.f >> -one.e);
+    uint64_t p2 = M_plus.f & (one.f - 1);
+
+    uint32_t pow10;
+    int n = find_largest_pow10(p1, pow10);
+
+    while(n > 0)
+    {
+      const uint32_t d = p1/pow10;
+      p1 %= pow10;
+      buf[len++] = static_cast<char>('0' + d);
+      --n;
+
+      const uint64_t rest = (uint64_t(p1) << -one.e) + p2;
+      if(rest <= delta)
+      {
+        dec_exp += n;
+        grisu2_round(buf, len, dist, delta, rest, uint64_t(pow10) << -one.e);
+        return;
+      }
+
+      pow10 /= 10;
+    }
+
+    int m = 0;
+    for(;;)
+    {
+      p2 *= 10;
+      const uint64_t d = p2 >> -one.e;
+      p2 &= one.f - 1;
+      buf[len++] = static_cast<char>('0' + d);
+      ++m;
+
+      delta *= 10;
+      dist  *= 10;
+      if(p2 <= delta) break;
+    }
+
+    dec_exp -= m;
+    grisu2_round(buf, len, dist, delta, p2, one.f);
+  }
+
+  /** Compute digits and decimal exponent of a positive finite value */
+  template<class T>
+  void grisu2(char* buf, int& len, int& dec_exp, T value)
+  {
+    const boundaries b = compute_boundaries(value);
+    const cached_power cached = get_cached_power(b.plus.e);
+    const diyfp c(cached.f, cached.e);
+
+    const diyfp w       = diyfp::mul(b.w, c);
+    const diyfp w_minus = diyfp::mul(b.minus, c);
+    const diyfp w_plus  = diyfp::mul(b.plus, c);
+
+    // account for the rounding error in the multiplication
+    const diyfp M_minus(w_minus.f + 1, w_minus.e);
+    const diyfp M_plus (w_plus.f - 1, w_plus.e);
+
+    dec_exp = -cached.k;
+    grisu2_digit_gen(buf, len, dec_exp, M_minus, w, M_plus);
+  }
+
+  /** Write exponent e in the form e-X, eX, e-XY, eXY, ... */
+  char* append_exponent(char* buf, int e)
+  {
+    *buf++ = 'e';
+    if(e < 0)
+    {
+      e = -e;
+      *buf++ = '-';
+    }
+    if(e >= 100) *buf++ = static_cast<char>('0' + e/100);
+    if(e >= 10)  *buf++ = static_cast<char>('0' + (e/10)%10);
+    *buf++ = static_cast<char>('0' + e%10);
+    return buf;
+  }
+
+  /** Write digits d1...dk with decimal exponent as a json number */
+  char* format_digits(char* buf, int k, int dec_exp, int max_exp)
+  {
+    // the value is d1.d2...dk * 10^(n-1)
+    const int n = k + dec_exp;
+
+    // d1d2...dk[000]
+    if(k <= n and n <= max_exp)
+    {
+      std::memset(buf + k, '0', n - k);
+      return buf + n;
+    }
+    // d1...dn.dn+1...dk
+    if(0 < n and n <= max_exp)
+    {
+      std::memmove(buf + n + 1, buf + n, k - n);
+      buf[n] = '.';
+      return buf + k + 1;
+    }
+    // 0.[000]d1...dk
+    if(-4 < n and n <= 0)
+    {
+      std::memmove(buf + 2 - n, buf, k);
+      buf[0] = '0';
+      buf[1] = '.';
+      std::memset(buf + 2, '0', -n);
+      return buf + 2 - n + k;
+    }
+    // d1.d2...dke(n-1)
+    if(k == 1) buf += 1;
+    else
+    {
+      std::memmove(buf + 2, buf + 1, k - 1);
+      buf[1] = '.';
+      buf += k + 1;
+    }
+    return append_exponent(buf, n - 1);
+  }
+
+  template<class T>
+  std::size_t format_float(char* buf, T value)
+  {
+    char* first = buf;
+
+    if(std::isnan(value))
+    {
+      std::memcpy(buf, "nan", 3);
+      return 3;
+    }
+    if(std::signbit(value))
+    {
+      value = -value;
+      *buf++ = '-';
+    }
+    if(std::isinf(value))
+    {
+      std::memcpy(buf, "inf", 3);
+      return buf + 3 - first;
+    }
+    if(value == 0)
+    {
+      // write 0 for both signs
+      first[0] = '0';
+      return 1;
+    }
+
+    int len = 0, dec_exp = 0;
+    grisu2(buf, len, dec_exp, value);
+    return format_digits(buf, len, dec_exp, std::numeric_limits<T>::digits10)
+           - first;
+  }
+}
+
+std::size_t format_number(char* buf, double value)
+{
+  return format_float(buf, value);
+}
+
+std::size_t format_number(char* buf, float value)
+{
+  return format_float(buf, value);
+}
+
+std::size_t format_number(char* buf, unsigned long long value)
+{
+  // write digits in reverse order
+  char tmp[format_buffer_size];
+  std::size_t n = 0;
+  do
+  {
+    tmp[n++] = static_cast<char>('0' + value%10);
+    value /= 10;
+  }
+  while(value);
+
+  for(std::size_t i=0; i<n; ++i) buf[i] = tmp[n-1-i];
+  return n;
+}
+
+std::size_t format_number(char* buf, long long value)
+{
+  if(value >= 0)
+    return format_number(buf, static_cast<unsigned long long>(value));
+
+  buf[0] = '-';
+  // avoid overflow for the smallest value
+  return 1 + format_number(buf+1, 0ull - static_cast<unsigned long long>(value));
+}
@@ -0,0 +1,54 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FORMAT_HPP_
+#define FORMAT_HPP_
+
+#include <cstddef>
+
+/** Fast locale-independent number formatting
+  *
+  * These functions write the decimal representation of a number to a buffer
+  * (which must be at least format_buffer_size long) and return the number of
+  * characters written. No terminating null character is added.
+  *
+  * Floating point numbers are written using the Grisu2 algorithm, which gives
+  * the shortest (or very close to shortest) representation that round-trips,
+  * i.e. that is read back to the exact same value.
+  * */
+constexpr std::size_t format_buffer_size = 32;
+
+std::size_t format_number(char* buf, double value);
+std::size_t format_number(char* buf, float value);
+std::size_t format_number(char* buf, long long value);
+std::size_t format_number(char* buf, unsigned long long value);
+
+inline std::size_t format_number(char* buf, int value)
+{ return format_number(buf, static_cast<long long>(value)); }
+inline std::size_t format_number(char* buf, long value)
+{ return format_number(buf, static_cast<long long>(value)); }
+inline std::size_t format_number(char* buf, short value)
+{ return format_number(buf, static_cast<long long>(value)); }
+inline std::size_t format_number(char* buf, unsigned value)
+{ return format_number(buf, static_cast<unsigned long long>(value)); }
+inline std::size_t format_number(char* buf, unsigned long value)
+{ return format_number(buf, static_cast<unsigned long long>(value)); }
+inline std::size_t format_number(char* buf, unsigned short value)
+{ return format_number(buf, static_cast<unsigned long long>(value)); }
+inline std::size_t format_number(char* buf, unsigned char value)
+{ return format_number(buf, static_cast<unsigned long long>(value)); }
+
+#endif//FORMAT_HPP_
@@ -0,0 +1,221 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "header.hpp"
+#include "model.hpp"
+
+using namespace std;
+
+/** Largest number of trials to place a single cell at random */
+static const unsigned MaxPlacementTrials = 100000;
+
+namespace
+{
+  /** Uniform grid of buckets over the domain holding the accepted centers
+   *
+   * The buckets are at least as large as the minimal distance, such that only
+   * the 27 buckets around a point need to be checked for overlaps.
+   * */
+  class spatial_hash
+  {
+    vec<double, 3> size;
+    double distance;
+    bool periodic;
+    array<int, 3> nb;
+    vector<vector<vec<double, 3>>> buckets;
+
+    int bucket(double x, unsigned d) const
+    { return min(nb[d]-1, int(x/size[d]*nb[d])); }
+
+  public:
+    spatial_hash(const coord& Size, double distance, bool periodic)
+      : size { double(Size[0]), double(Size[1]), double(Size[2]) },
+        distance(distance), periodic(periodic)
+    {
+      for(unsigned d=0; d<3; ++d)
+        nb[d] = max(1, int(Size[d]/max(distance, 1.)));
+      buckets.resize(size_t(nb[0])*nb[1]*nb[2]);
+    }
+
+    /** Is p further than the minimal distance from all centers? */
+    bool free(const vec<double, 3>& p) const
+    {
+      const int bx = bucket(p[0], 0), by = bucket(p[1], 1), bz = bucket(p[2], 2);
+
+      for(int i=-1; i<=1; ++i)
+      for(int j=-1; j<=1; ++j)
+      for(int k=-1; k<=1; ++k)
+      {
+        int b[3] = { bx+i, by+j, bz+k };
+        bool inside = true;
+        for(unsigned d=0; d<3; ++d)
+        {
+          if(periodic) b[d] = (b[d] + nb[d])%nb[d];
+          else inside = inside and b[d]>=0 and b[d]<nb[d];
+        }
+        if(!inside) continue;
+
+        for(const auto& c : buckets[b[0] + nb[0]*(b[1] + size_t(nb[1])*b[2])])
+        {
+          double dist2 = 0;
+          for(unsigned d=0; d<3; ++d)
+          {
+            double delta = abs(p[d] - c[d]);
+            if(periodic) delta = min(delta, size[d] - delta);
+            dist2 += delta*delta;
+          }
+          if(dist2<distance*distance) return false;
+        }
+      }
+      return true;
+    }
+
+    void insert(const vec<double, 3>& p)
+    {
+      const int bx = bucket(p[0], 0), by = bucket(p[1], 1), bz = bucket(p[2], 2);
+      buckets[bx + nb[0]*(by + size_t(nb[1])*bz)].push_back(p);
+    }
+  };
+}
+
+double Model::InitDistance() const
+{
+  return init_distance>0 ? init_distance : 2*R;
+}
+
+bool Model::AllowedCenter(const vec<double, 3>& p) const
+{
+  for(unsigned d=0; d<3; ++d)
+    if(p[d]<birth_bdries[2*d] or p[d]>=birth_bdries[2*d+1]) return false;
+
+  // not inside the walls (computed before the cells)
+  const coord c = GridCenter(p);
+  return walls[GetIndex(c)]<.5;
+}
+
+coord Model::GridCenter(const vec<double, 3>& p) const
+{
+  coord c;
+  for(unsigned d=0; d<3; ++d)
+    c[d] = unsigned(lround(p[d]) + Size[d])%Size[d];
+  return c;
+}
+
+vector<coord> Model::GenerateRandom(const function<bool(const vec<double, 3>&)>& allowed,
+                                    bool slab)
+{
+  const double d = InitDistance();
+  const double height = init_height>0 ? init_height : wall_thickness + R;
+  spatial_hash hash(Size, d, BC==0);
+
+  vector<coord> centers;
+  centers.reserve(nphases_init);
+  while(centers.size()<nphases_init)
+  {
+    unsigned trials = 0;
+    for(;; ++trials)
+    {
+      if(trials==MaxPlacementTrials)
+        throw error_msg("could only place ", centers.size(), " cells out of ",
+                        nphases_init, ": reduce init-distance or nphases_init.");
+
+      const vec<double, 3> p = {
+        random_real(birth_bdries[0], birth_bdries[1]),
+        random_real(birth_bdries[2], birth_bdries[3]),
+        slab ? height : random_real(birth_bdries[4], birth_bdries[5])
+      };
+      if(!AllowedCenter(p) or !allowed(p) or !hash.free(p)) continue;
+
+      hash.insert(p);
+      centers.push_back(GridCenter(p));
+      break;
+    }
+  }
+  return centers;
+}
+
+vector<coord> Model::GenerateLattice(bool hexagonal)
+{
+  const double d = InitDistance();
+  spatial_hash hash(Size, d*(1-1e-9), BC==0);
+
+  // hexagonal close packing: triangular layers stacked ABAB
+  const double dy = hexagonal ? d*sqrt(3.)/2. : d;
+  const double dz = hexagonal ? d*sqrt(2./3.) : d;
+
+  // layers from the bottom of the birth region, the first sites are kept
+  vector<coord> centers;
+  centers.reserve(nphases_init);
+  for(unsigned k=0; ; ++k)
+  {
+    const double z = birth_bdries[4] + d/2 + k*dz;
+    if(z>=birth_bdries[5]) break;
+
+    for(unsigned j=0; ; ++j)
+    {
+      const double y = birth_bdries[2] + d/2 + j*dy
+                       + (hexagonal and k%2 ? d*sqrt(3.)/6. : 0.);
+      if(y>=birth_bdries[3]) break;
+
+      for(unsigned i=0; ; ++i)
+      {
+        const double x = birth_bdries[0] + d/2 + i*d
+                         + (hexagonal and (j+k)%2 ? d/2 : 0.);
+        if(x>=birth_bdries[1]) break;
+
+        // periodic images might be too close
+        const vec<double, 3> p = { x, y, z };
+        if(!AllowedCenter(p) or !hash.free(p)) continue;
+
+        hash.insert(p);
+        centers.push_back(GridCenter(p));
+        if(centers.size()==nphases_init) return centers;
+      }
+    }
+  }
+
+  throw error_msg("the ", hexagonal ? "hexagonal" : "cubic", " lattice only "
+                  "has ", centers.size(), " sites for ", nphases_init, " cells: "
+                  "reduce init-distance or nphases_init.");
+}
+
+vector<coord> Model::GenerateMask(const string& fname)
+{
+  ifstream file(fname);
+  if(!file.good())
+    throw error_msg("can not open mask file ", fname, ".");
+
+  // nx ny nz, then the voxels, x first
+  unsigned nx, ny, nz;
+  if(!(file >> nx >> ny >> nz) or nx==0 or ny==0 or nz==0)
+    throw error_msg("mask file ", fname, " has a wrong header.");
+  vector<char> mask(size_t(nx)*ny*nz);
+  for(auto& m : mask)
+  {
+    int v;
+    if(!(file >> v)) throw error_msg("mask file ", fname, " is too short.");
+    m = v!=0;
+  }
+
+  // the mask is stretched over the whole domain
+  const auto inside = [&](const vec<double, 3>& p) {
+    const unsigned i = min(nx-1, unsigned(p[0]*nx/Size[0]));
+    const unsigned j = min(ny-1, unsigned(p[1]*ny/Size[1]));
+    const unsigned k = min(nz-1, unsigned(p[2]*nz/Size[2]));
+    return mask[i + nx*(j + size_t(ny)*k)]!=0;
+  };
+  return GenerateRandom(inside, false);
+}
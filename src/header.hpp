@@ -21,48 +21,12 @@
 // defines project-wide header list to be precompiled
 // this allows us to reduce the compile time considerably
 
-#include <iostream>
-#include <fstream>
-#include <iomanip>
-#include <string>
-#include <exception>
-#include <sstream>
-#include <utility>
-#include <limits>
-#include <random>
-#include <map>
-#include <vector>
-#include <complex>
-#include <array>
-#include <stack>
-#include <functional>
-#include <memory>
-#include <type_traits>
-#include <chrono>
+#include "host_header.hpp"
 
 #include "cuda.h"
 #include <cuComplex.h>
 #include <curand.h>
 #include <curand_kernel.h>
 #include "vec_cuda.h"
-#include "error_msg.hpp"
-//#include "threads.hpp"
-#include "tools.hpp"
-
-#include "error_msg.hpp"
-//#include "threads.hpp"
-#include "tools.hpp"
-
-// boost program_options
-#include <boost/program_options.hpp>
-namespace opt = boost::program_options;
-
-// =============================================================================
-// Constants
-
-/** display width (change it directly here) */
-constexpr unsigned width = 70;
-/** An infmaous constant */
-constexpr double Pi = 3.14159265358979323846;
 
 #endif//HEADER_HPP_
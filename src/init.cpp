@@ -30,26 +30,9 @@ void Model::Initialize()
   }
   
 
-  if (BC == 4){
-  Size[0] = Size[0] + 4.*wall_thickness;
-  Size[1] = Size[1] + 4.*wall_thickness;
-  cout<<"box adjusted for BC == 4"<<endl;
-  }
-  
-  N = Size[0]*Size[1]*Size[2];
+  ComputeSizes();
   sqrt_time_step = sqrt(time_step);
 
-  // rectifies margin in case it is bigger than domain
-  // and compensate for the boundary layer
-  patch_margin = {
-    min(margin, Size[0]/2 - 1 + (Size[0]%2)),
-    min(margin, Size[1]/2 - 1 + (Size[1]%2)),
-    min(margin, Size[2]/2 - 1 + (Size[2]%2))
-  };
-  // total size including bdry layer
-  patch_size = 2u*patch_margin + 1u;
-  
-  patch_N = patch_size[0]*patch_size[1]*patch_size[2];
   // initialize memory for global fields
   walls.resize(N, 0.);
   walls_dx.resize(N, 0.);
@@ -110,7 +93,9 @@ void Model::Initialize()
   // check birth boundaries
   if(birth_bdries.size()==0)
     birth_bdries = {0, Size[0], 0, Size[1], 0, Size[2]};
-  else if(birth_bdries.size()!=4)
+  else if(birth_bdries.size()==4)
+    birth_bdries.insert(birth_bdries.end(), {0, Size[2]});
+  else if(birth_bdries.size()!=6)
     throw error_msg("Birth boundaries have wrong format, see help.");
 
   //if(wall_omega!=0)
@@ -120,6 +105,29 @@ void Model::Initialize()
 
 }
 
+void Model::ComputeSizes()
+{
+  if (BC == 4){
+  Size[0] = Size[0] + 4.*wall_thickness;
+  Size[1] = Size[1] + 4.*wall_thickness;
+  cout<<"box adjusted for BC == 4"<<endl;
+  }
+  
+  N = Size[0]*Size[1]*Size[2];
+
+  // rectifies margin in case it is bigger than domain
+  // and compensate for the boundary layer
+  patch_margin = {
+    min(margin, Size[0]/2 - 1 + (Size[0]%2)),
+    min(margin, Size[1]/2 - 1 + (Size[1]%2)),
+    min(margin, Size[2]/2 - 1 + (Size[2]%2))
+  };
+  // total size including bdry layer
+  patch_size = 2u*patch_margin + 1u;
+  
+  patch_N = patch_size[0]*patch_size[1]*patch_size[2];
+}
+
 void Model::SetCellNumber(unsigned new_nphases)
 {
   nphases = new_nphases;
@@ -185,43 +193,46 @@ void Model::InitializeNeighbors()
   neighbors_patch.resize(patch_N);
 
   // define the neighbours, accounting for the periodic boundaries
+  #pragma omp parallel for schedule(static)
   for(unsigned k=0; k<N; ++k)
   {
-    const unsigned x = GetXPosition(k);
-    const unsigned y = GetYPosition(k);
-    const unsigned z = GetZPosition(k);
+    const coord p = GetPosition(k);
+
+    // wrapped coordinates of the neighbours along each axis
+    unsigned u[3], v[3], w[3];
+    for(int d=-1; d<=1; ++d)
+    {
+      u[d+1] = (p[0]+Size[0]+d)%Size[0];
+      v[d+1] = (p[1]+Size[1]+d)%Size[1];
+      w[d+1] = (p[2]+Size[2]+d)%Size[2];
+    }
+
     for(int dx=-1; dx<=1; ++dx)
-      for(int dy=-1; dy<=1; ++dy){
-        for(int dz=-1; dz<=1; ++dz){        
-          neighbors[k][dx][dy][dz] = GetIndex({ (x+Size[0]+dx)%Size[0], (y+Size[1]+dy)%Size[1], (z+Size[2]+dz)%Size[2] });
-  
-        }
-      }
+      for(int dy=-1; dy<=1; ++dy)
+        for(int dz=-1; dz<=1; ++dz)
+          neighbors[k][dx][dy][dz] = v[dy+1] + Size[1]*u[dx+1] + Size[0]*Size[1]*w[dz+1];
   }
 
   // define the neighbours, accounting for the boundary layer
   const unsigned lx = patch_size[0];
   const unsigned ly = patch_size[1];
   const unsigned lz = patch_size[2];
+  #pragma omp parallel for schedule(static)
   for(unsigned k=0; k<patch_N; ++k)
   {
-    const unsigned x = (k/ly)%lx;
-    const unsigned y = k%ly;
-    const unsigned z = k/(ly*lz);
-    
-    for(int dx=-1; dx<=1; ++dx)
+    const coord p = patch_position(k, patch_size);
+
+    unsigned u[3], v[3], w[3];
+    for(int d=-1; d<=1; ++d)
     {
+      u[d+1] = (p[0]+lx+d)%lx;
+      v[d+1] = (p[1]+ly+d)%ly;
+      w[d+1] = (p[2]+lz+d)%lz;
+    }
+
+    for(int dx=-1; dx<=1; ++dx)
       for(int dy=-1; dy<=1; ++dy)
-      {
         for(int dz=-1; dz<=1; ++dz)
-        {
-        const unsigned u = (x+lx+dx)%lx;
-        const unsigned v = (y+ly+dy)%ly;
-        const unsigned w = (z+lz+dz)%lz;
-        neighbors_patch[k][dx][dy][dz] = v + u*ly + w * lx * ly;
-          
-        }
-      }
-    }
+          neighbors_patch[k][dx][dy][dz] = v[dy+1] + u[dx+1]*ly + w[dz+1]*lx*ly;
   }
 }
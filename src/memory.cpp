@@ -0,0 +1,172 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "header.hpp"
+#include "model.hpp"
+#include "memory.hpp"
+
+using namespace std;
+
+/** Human readable size */
+static string format_bytes(size_t bytes)
+{
+  const char* units[] = { "B", "kB", "MB", "GB", "TB" };
+  double v = bytes;
+  unsigned u = 0;
+  while(v>=1024 and u<4) { v /= 1024; ++u; }
+
+  ostringstream s;
+  s << fixed << setprecision(u ? 1 : 0) << v << ' ' << units[u];
+  return s.str();
+}
+
+vector<Model::memory_usage> Model::MemoryPlan(unsigned n) const
+{
+  // the counts follow Initialize(), SetCellNumber() and the device memory
+  // management in cuda.cu
+  const size_t d = sizeof(double);
+  const size_t v3 = sizeof(vec<double, 3>);
+  const size_t c = sizeof(coord);
+
+  // patch fields: phi, phi_old, V, phi_dx, phi_dy, phi_dz, dphi, dphi_old
+  const size_t patch = 8*size_t(n)*patch_N*d;
+  // global fields: walls (5), sums (2), pressure, polarisation (3),
+  // velocity (3) and stress (6)
+  const size_t global = 20*size_t(N)*d;
+
+  // per-cell properties on the device: com, polarization, velocity, Fpol,
+  // Fpressure, vorticity (vectors), patch_min, patch_max, offset, vol,
+  // stored parameters (5), cell stress (6), theta_pol (3) and com_x,y,z
+  const size_t cells_device = size_t(n)*(6*v3 + 3*c + 15*d
+                                         + 3*sizeof(cuDoubleComplex));
+  // the host also stores com_prev, Fshape, Fnem, timer, divisiontthresh,
+  // stored_tmean and one vector per patch field
+  const size_t cells_host = cells_device
+                          + size_t(n)*(3*v3 + 3*d + 8*sizeof(field));
+
+  const size_t stencils = (size_t(N) + patch_N)*sizeof(stencil);
+  const size_t tables = size_t(Size[0] + Size[1] + Size[2])
+                        *sizeof(cuDoubleComplex);
+
+  return {
+    { "patch fields",    patch,         patch },
+    { "global fields",   global,        global },
+    { "cell properties", cells_host,    cells_device },
+    { "stencils",        stencils,      stencils },
+    { "random states",   0,             size_t(N)*sizeof(curandState) },
+    { "com tables",      tables,        tables }
+  };
+}
+
+void Model::PrintMemoryPlan()
+{
+  ComputeSizes();
+
+  const auto init = MemoryPlan(nphases_init);
+  const auto max  = MemoryPlan(nphases_max);
+
+  cout << "Memory plan (N = " << N << " nodes, patch_N = " << patch_N
+       << " nodes per cell)" << endl;
+  cout << string(width, '=') << endl;
+  cout << setw(18) << left << "subsystem"
+       << setw(14) << right << "host" << setw(14) << "device"
+       << setw(14) << "host" << setw(14) << "device" << '\n'
+       << setw(18) << ""
+       << setw(28) << right << "nphases_init = " + to_string(nphases_init)
+       << setw(28) << "nphases_max = " + to_string(nphases_max) << '\n';
+
+  size_t totals[4] = {};
+  for(unsigned i=0; i<init.size(); ++i)
+  {
+    cout << setw(18) << left << init[i].subsystem << right
+         << setw(14) << format_bytes(init[i].host)
+         << setw(14) << format_bytes(init[i].device)
+         << setw(14) << format_bytes(max[i].host)
+         << setw(14) << format_bytes(max[i].device) << '\n';
+    totals[0] += init[i].host;
+    totals[1] += init[i].device;
+    totals[2] += max[i].host;
+    totals[3] += max[i].device;
+  }
+  cout << setw(18) << left << "total" << right;
+  for(const auto t : totals) cout << setw(14) << format_bytes(t);
+  cout << endl;
+}
+
+/** Bytes held by a vector */
+template<class T>
+static size_t held(const vector<T>& v)
+{
+  return v.capacity()*sizeof(T);
+}
+
+/** Bytes held by a vector of vectors */
+template<class T>
+static size_t held(const vector<vector<T>>& v)
+{
+  size_t bytes = v.capacity()*sizeof(vector<T>);
+  for(const auto& w : v) bytes += held(w);
+  return bytes;
+}
+
+static size_t held_all()
+{
+  return 0;
+}
+
+template<class T, class... Rest>
+static size_t held_all(const T& v, const Rest&... rest)
+{
+  return held(v) + held_all(rest...);
+}
+
+size_t Model::HostMemory() const
+{
+  return held_all(
+    // patch fields
+    phi, phi_dx, phi_dy, phi_dz, phi_old, V, dphi, dphi_old,
+    // global fields
+    sum_one, sum_two, field_polx, field_poly, field_polz,
+    field_velx, field_vely, field_velz, field_press,
+    field_sxx, field_sxy, field_sxz, field_syy, field_syz, field_szz,
+    walls, walls_dx, walls_dy, walls_dz, walls_laplace,
+    // cell properties
+    Fpol, Fnem, Fshape, Fpressure, cSxx, cSxy, cSxz, cSyy, cSyz, cSzz,
+    velocity, vol, polarization, delta_theta_pol, vorticity,
+    theta_pol, theta_pol_old, com, com_prev,
+    stored_gam, stored_omega_cc, stored_omega_cs, stored_alpha, stored_dpol,
+    patch_min, patch_max, offset, com_x, com_y, com_z,
+    timer, divisiontthresh, stored_tmean, nphases_index, birth_bdries,
+    // stencils, tables and diagnostics
+    neighbors, neighbors_patch, com_x_table, com_y_table, com_z_table,
+    cell_diag);
+}
+
+void Model::TrackMemory(const char* what)
+{
+  const size_t host = HostMemory();
+  const size_t device = device_memory_in_use();
+  if(host<=memory_high_host and device<=memory_high_device) return;
+
+  memory_high_host    = max(memory_high_host, host);
+  memory_high_device  = max(memory_high_device, device);
+  memory_high_nphases = max(memory_high_nphases, nphases);
+
+  if(verbose)
+    cout << "memory: " << what << " allocated, host " << format_bytes(host)
+         << ", device " << format_bytes(device) << " (" << nphases
+         << " cells)" << endl;
+}
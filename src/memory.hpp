@@ -0,0 +1,54 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MEMORY_HPP_
+#define MEMORY_HPP_
+
+#include <cstddef>
+
+/** Device memory accounting
+  *
+  * Every device buffer of the model, of the diagnostics and of the analyses is
+  * allocated with device_malloc() and released with device_free(), which keep
+  * count of the bytes in use (see Model::TrackMemory()). Implemented in
+  * cuda.cu.
+  * */
+
+/** Allocate bytes on the device, returns false on failure */
+bool device_malloc(void** ptr, std::size_t bytes);
+
+/** Release a buffer allocated with device_malloc() (nullptr is ignored) */
+void device_free(void* ptr);
+
+/** Bytes currently allocated with device_malloc() */
+std::size_t device_memory_in_use();
+
+/** Allocate len values of type T on the device, returns false on failure */
+template<class T>
+bool device_malloc(T*& ptr, std::size_t len)
+{
+  return device_malloc(reinterpret_cast<void**>(&ptr), len*sizeof(T));
+}
+
+/** Release a typed buffer and reset the pointer */
+template<class T>
+void device_free(T*& ptr)
+{
+  device_free(static_cast<void*>(ptr));
+  ptr = nullptr;
+}
+
+#endif//MEMORY_HPP_
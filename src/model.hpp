@@ -19,9 +19,16 @@
 
 #include <vector>
 #include <array>
+#include <functional>
 #include "vec_cuda.h"
 #include "stencil.hpp"
 #include "serialization.hpp"
+#include "precision.hpp"
+#include "patch.hpp"
+#include "timer.hpp"
+#include "counters.hpp"
+#include "diagnostics.hpp"
+#include "roofline.hpp"
 #include "cuComplex.h"
 #include <curand_kernel.h>
 
@@ -30,6 +37,11 @@ using field = std::vector<double>;
 /** Grid coordinate */
 using coord = vec<unsigned, 3>;
 
+class tswriter;
+class deltawriter;
+class shm_publisher;
+class analysis;
+
 
 
 /** Model class
@@ -177,10 +189,24 @@ enum class ManageMemory {
   bool runtime_check = false;
   /** shall we print some runtime stats ? */
   bool runtime_stats = false;
+  /** Time steps between runtime checks and stats (0: every ninfo steps) */
+  unsigned check_every = 0;
+  /** Tolerances of the runtime checks: largest ratio between the cell volumes
+   * and vimp, largest fraction of phi on the faces of a patch, and margin of
+   * phi outside of [0, 1] */
+  double check_volume = 4, check_leakage = 0.05, check_phi = 0.5;
+  /** Last diagnostics and worst values over the current interval and the run */
+  diagnostics diag_last, diag_interval, diag_run;
+  /** Initial mean cell volume (reference of the volume drift) */
+  double diag_volume_ref = 0;
+  /** Per-cell reductions copied from the device */
+  std::vector<cell_diagnostics> cell_diag;
   /** padding for onscreen output */
   unsigned pad;
   /** name of the inpute file */
   std::string inputname = "";
+  /** Content of the runcard, used instead of the input file if not empty */
+  std::string runcard;
   /** Delete output? */
   bool force_delete;
   /** The random number seed */
@@ -193,8 +219,97 @@ enum class ManageMemory {
   unsigned relax_time = 0;
   /** Value of nsubstep to use for initialization */
   unsigned relax_nsubsteps = 0;
+  /** Directory of the cache of relaxed states (none if empty) */
+  std::string relax_cache;
+  /** Was the relaxed state restored from the cache? */
+  bool relax_cache_hit = false;
   /** Total time spent writing output */
   std::chrono::duration<double> write_duration;
+  /** Only print the memory plan, nothing is set up (--plan) */
+  bool plan = false;
+  /** Highest memory used so far (bytes, see TrackMemory()), and number of
+   * cells then */
+  unsigned memory_high_nphases = 0;
+  std::size_t memory_high_host = 0, memory_high_device = 0;
+  /** Transfer and event counters (see counters.hpp) */
+  event_counters counters;
+  /** File to which the counters are written at every output (none if empty) */
+  std::string counters_file;
+  /** Time spent in each stage of the computation (see timer.hpp) */
+  stage_timers timers;
+  /** File to which the stage times are exported (none if empty) */
+  std::string timings_file;
+  /** File to which the trace is written at the end (none if empty) */
+  std::string trace_file;
+  /** Number of spans kept per thread in the trace */
+  unsigned trace_size = 1u<<20;
+  /** Report the efficiency of the stages (see roofline.hpp) */
+  bool roofline = false;
+  /** Analytic cost of the stages, and measured peak of the device */
+  stage_costs costs;
+  device_peak peak;
+  /** write per-cell time series? */
+  bool write_timeseries = false;
+  /** Number of frames per chunk of the time-series store */
+  unsigned timeseries_chunk = 64;
+  /** Output precision of phi (name and parsed value) */
+  std::string phi_precision_name = "double";
+  output_precision phi_precision;
+  /** Output precision of the stress fields (name and parsed value) */
+  std::string stress_precision_name = "double";
+  output_precision stress_precision;
+  /** write phi and stress fields to the delta archive instead of frames? */
+  bool delta_frames = false;
+  /** Number of frames between two keyframes of the delta archive */
+  unsigned keyframe_interval = 16;
+  /** Name of the shared memory segment for live frames (empty for none) */
+  std::string shm_name;
+  /** Number of slots of the shared memory ring buffer */
+  unsigned shm_slots = 4;
+  /** Maximum number of cells in the shared memory (0 for nphases_max) */
+  unsigned shm_max_cells = 0;
+  /** Publish the patches (phi) in shared memory? */
+  bool shm_patches = false;
+  /** Global fields published in shared memory */
+  std::vector<std::string> shm_fields;
+  /** Time interval between checkpoints (0 for none) */
+  unsigned checkpoint_every = 0;
+  /** Directory of the checkpoints */
+  std::string checkpoint_dir;
+  /** Replay options (key=value) */
+  std::vector<std::string> replay_args;
+  /** Are we replaying a window from a checkpoint? */
+  bool replay = false;
+  /** Window to replay */
+  unsigned replay_from = 0, replay_to = 0;
+  /** Largest difference of the phase fields and centres of mass between a
+   * replay and the checkpoints of the original run
+   *
+   * The device sums are not ordered, such that a replay is not bit-for-bit
+   * identical to the original run: it is checked against every checkpoint of
+   * the original run within the window instead (see CheckReplay()).
+   * */
+  double replay_tolerance = 1e-6;
+  /** Number of checks of the replay and largest difference found */
+  unsigned replay_checks = 0;
+  double replay_error = 0;
+  /** Branch options (one list of key=value overrides per branch) */
+  std::vector<std::string> branch_args;
+  /** Time of the checkpoint from which the branches are started */
+  unsigned branch_from = 0;
+  /** Maximum number of branches running at the same time */
+  unsigned branch_jobs = 1;
+  /** Index of this branch (-1 if this run is not a branch) */
+  int branch = -1;
+  /** Is this the process which forked the branches (and has nothing else to
+   * run)? */
+  bool branch_parent = false;
+  /** Number of branches which failed (in the parent process) */
+  unsigned branch_failures = 0;
+  /** In-situ analyses (one NAME [every=T] [key=value ...] per analysis) */
+  std::vector<std::string> analysis_args;
+  /** Time at which the main loop starts (non-zero after a restart) */
+  unsigned start_time = 0;
   /** @} */
 
   /** Simulation parameters
@@ -306,9 +421,20 @@ enum class ManageMemory {
   void initDivision(unsigned n, unsigned i, double angle, unsigned t);
   void BirthCellMemories(unsigned new_nphases);
   void DivideCell(unsigned n, unsigned nphases_current, double angle, double cellProp);
+  /** Split the phase field of cell n between cells idx and idx-1
+   *
+   * The interface goes through the center of mass of n, perpendicular to the
+   * given direction in the xy plane.
+   * */
+  void SplitCell(unsigned n, unsigned idx, double direction);
   void BirthCell(unsigned n);
   void ComputeBirthCellCOM(unsigned n, unsigned nbirth);
   void KillCell(unsigned n, unsigned i);
+  /** Add a cell at a given position, returns its persistent index (t counts
+   * the substeps as in proliferate) */
+  unsigned InjectCell(const coord& center, unsigned t);
+  /** Remove the cell at memory index i */
+  void RemoveCell(unsigned i, unsigned t);
   void BirthCellAtNode(unsigned n, unsigned q);
   void print_new_cell_props();
   void AllocDeviceMemoryCellBirth();
@@ -334,20 +460,107 @@ enum class ManageMemory {
   void PrintProgramOptions();
 
   // =========================================================================
-  // Program managment. Implemented in main.cpp
+  // Program managment. Implemented in algorithm.cpp
 
   /** The main loop */
   void Algorithm();
 
-  /** Setup computation */
+  /** Advance the simulation by a number of time steps */
+  void Advance(unsigned);
+
+  /** Setup computation (returns after printing the memory plan with --plan) */
   void Setup(int, char**);
 
+  /** Setup computation once the options are parsed */
+  void SetupModel();
+
+  // =========================================================================
+  // Memory accounting. Implemented in memory.cpp
+
+  /** Memory used by a subsystem, in bytes */
+  struct memory_usage
+  {
+    const char* subsystem;
+    std::size_t host, device;
+  };
+
+  /** Memory needed for a given number of cells (sizes must be computed)
+   *
+   * This is an estimate of the arrays of the model only, used for --plan:
+   * the memory actually used is tracked by TrackMemory().
+   * */
+  std::vector<memory_usage> MemoryPlan(unsigned nphases) const;
+
+  /** Print the memory needed at nphases_init and nphases_max (--plan) */
+  void PrintMemoryPlan();
+
+  /** Bytes held by the host arrays of the model (capacities) */
+  std::size_t HostMemory() const;
+
+  /** Update and log the high-water mark after a device allocation
+   *
+   * Counts the host arrays and every device buffer allocated with
+   * device_malloc() (model, diagnostics and analyses, see memory.hpp). Every
+   * growth is logged, what names the buffers that were allocated.
+   * */
+  void TrackMemory(const char* what);
+
   /** Do the computation */
   void Run();
 
   /** Clean after you */
   void Cleanup();
 
+  // ===========================================================================
+  // Checkpoints. Implemented in checkpoint.cpp
+
+  /** Hash of the run-invariant parameters (see SerializeInvariants()), used
+   * to check checkpoint compatibility */
+  uint64_t ParametersHash();
+  /** Hash of the parameters at set-up */
+  uint64_t params_hash = 0;
+  /** Name of the checkpoint file at time t */
+  std::string CheckpointName(unsigned t) const;
+  /** Write full state of the simulation */
+  void WriteCheckpoint(unsigned t);
+  /** Restore host state from a checkpoint (device random states are returned
+   * as raw bytes) */
+  void ReadCheckpoint(const std::string& fname, std::vector<char>& rand_states);
+  /** Restore state from the nearest checkpoint before the replay window */
+  void LoadCheckpoint();
+  /** Compare the replayed state with the checkpoint of the original run at
+   * time t, if any (throws above replay_tolerance) */
+  void CheckReplay(unsigned t);
+  /** Parse --replay key=value arguments */
+  void ParseReplayOptions();
+  /** Everything the relaxed state depends on, as text */
+  std::string RelaxationKey() const;
+  /** Name of the cache file for a given key */
+  std::string RelaxCacheName(const std::string& key) const;
+  /** Restore the relaxed state from the cache, returns false if not found
+   *
+   * The key must be computed before the relaxation (see RelaxationKey()).
+   * */
+  bool LoadRelaxedState(const std::string& key);
+  /** Store the relaxed state (host memory) in the cache under key */
+  void SaveRelaxedState(const std::string& key);
+
+  // ===========================================================================
+  // Branches. Implemented in branch.cpp
+
+  /** Check the --branch arguments */
+  void ParseBranchOptions();
+  /** Restore the branching checkpoint and fork one process per branch
+   *
+   * Returns true in the child processes, which continue with their branch.
+   * The parent waits for all branches and returns false, with branch_parent
+   * set and the number of failed branches in branch_failures. Must be called
+   * before any OpenMP parallel region (see SetupModel()).
+   * */
+  bool ForkBranches();
+  /** Apply the overrides of a branch (in the child process) */
+  void ApplyBranch(unsigned i);
+
   // ===========================================================================
   // Configuration. Implemented in configure.cpp
 
@@ -368,6 +581,10 @@ enum class ManageMemory {
   double wound_ratio = .50;
   /** Ratio of the tumor vs size of the domain (BC=6) */
   double tumor_ratio = .80;
+  /** Minimal distance between generated cells (0 for 2R) */
+  double init_distance = 0;
+  /** Height of the slab (0 for wall_thickness + R) */
+  double init_height = 0;
 
   /** @} */
 
@@ -375,8 +592,39 @@ enum class ManageMemory {
   void AddCell(unsigned n, const coord& center);
   void AddCellMix(unsigned n, const coord& center);
 
-  /** Subfunction for AddCell() */
-  void AddCellAtNode(unsigned n, unsigned q, const coord& center);
+  /** Add cells 0, 1, ... at the given positions (same as AddCellMix) */
+  void AddCells(const std::vector<coord>& centers);
+
+  /** Subfunction for AddCell(), returns the value of phi at the node
+   *
+   * Safe to call in parallel for any nodes and cells (vol is left to the
+   * caller, the sums are updated atomically).
+   * */
+  double AddCellAtNode(unsigned n, unsigned q, const coord& center);
+
+  /** Minimal distance between generated cells */
+  double InitDistance() const;
+
+  /** Is p in the birth region and outside of the walls? */
+  bool AllowedCenter(const vec<double, 3>& p) const;
+
+  /** Nearest node of the domain */
+  coord GridCenter(const vec<double, 3>& p) const;
+
+  /** Random sequential packing of nphases_init cells
+   *
+   * Cells are placed uniformly in the allowed part of the birth region, at
+   * InitDistance() of each other. Slabs are monolayers at height init_height.
+   * Implemented in generate.cpp.
+   * */
+  std::vector<coord> GenerateRandom(
+      const std::function<bool(const vec<double, 3>&)>& allowed, bool slab);
+
+  /** First nphases_init sites of a cubic or hexagonal close-packed lattice */
+  std::vector<coord> GenerateLattice(bool hexagonal);
+
+  /** Random packing inside the non-zero voxels of a mask file */
+  std::vector<coord> GenerateMask(const std::string& fname);
 
   /** Set initial condition for the fields */
   void Configure();
@@ -401,7 +649,57 @@ enum class ManageMemory {
   void Write_Density(unsigned);
   void visTMP(unsigned);
   void Write_OU(unsigned,unsigned);
+
+  /** Columnar store for the per-cell time series (see timeseries.hpp) */
+  std::shared_ptr<tswriter> timeseries;
+  /** Names of the columns written to the time-series store */
+  static const std::vector<std::string> timeseries_columns;
+  /** Append current per-cell quantities to the time-series store */
+  void Write_timeseries(unsigned);
+  /** Flush and close the time-series store */
+  void CloseTimeSeries();
+
+  /** Delta-encoded archive of phi and the stress fields (see delta.hpp) */
+  std::shared_ptr<deltawriter> delta_archive;
+  /** Append phi and the stress fields to the delta archive */
+  void WriteDeltaFrame(unsigned);
+  /** Close the delta archive */
+  void CloseDeltaFrames();
+
+  /** Current per-cell quantities (one value per time-series column) */
+  void GetCellScalars(unsigned i, double* values) const;
+
+  /** Publisher of live frames in shared memory (see shm.hpp) */
+  std::shared_ptr<shm_publisher> publisher;
+  /** Global field from its name (nullptr if unknown) */
+  static field Model::* FieldByName(const std::string&);
+  /** Check the shared memory options */
+  void CheckPublishOptions();
+  /** Publish current frame in shared memory */
+  void PublishFrame(unsigned);
+  /** Mark the shared memory segment as closed and remove it */
+  void ClosePublisher();
   
+  /** Selected in-situ analysis (see analysis.hpp) */
+  struct analysis_slot
+  {
+    std::string name;
+    /** Name of the trace spans (interned, see trace::span) */
+    const char* span_name;
+    /** Time steps between two evaluations */
+    unsigned every;
+    std::shared_ptr<analysis> plugin;
+    /** Columnar store of the results (opened at the first evaluation) */
+    std::shared_ptr<tswriter> out;
+  };
+  std::vector<analysis_slot> analyses;
+  /** Create the analyses selected in the runcard. Implemented in analysis.cpp */
+  void ParseAnalysisOptions();
+  /** Evaluate the analyses due at time t */
+  void Analyse(unsigned t);
+  /** Flush and close the stores of the analyses */
+  void CloseAnalyses();
+
   /** Write run parameters */
   void WriteParams();
 
@@ -417,6 +715,9 @@ enum class ManageMemory {
   /** Initialize memory for field */
   void Initialize();
 
+  /** Compute the size of the domain and of the patches */
+  void ComputeSizes();
+
   /** Allocate memory for individual cells */
   void SetCellNumber(unsigned new_nphases);
 
@@ -510,12 +811,19 @@ enum class ManageMemory {
   /** Random states on the device */
   curandState *d_rand_states;
 
+  /** Per-cell reductions on the device (allocated on first use) */
+  cell_diagnostics *d_cell_diag = nullptr;
+  unsigned cell_diag_capacity = 0;
+
   /** Initialization function */
   void InitializeCuda();
 
   /** Initialization function for random numbers */
   void InitializeCUDARandomNumbers();
 
+  /** Copy the device random states from or to a byte buffer */
+  void CopyRandomStates(std::vector<char>&, CopyMemory);
+
   /** @} */
   /** CUDA device memory managment
     * @{ */
@@ -568,6 +876,13 @@ enum class ManageMemory {
   /** Prepare before run */
   void Pre();
 
+  /** Relax the initial configuration
+   *
+   * Passive substeps only (see UpdateDevice), without proliferation nor copies
+   * to the host until the end.
+   * */
+  void Relax();
+
   /** Prints some stats before running */
   void PreRunStats();
 
@@ -577,6 +892,18 @@ enum class ManageMemory {
   /** Performs punctual check at runtime */
   void RuntimeChecks();
 
+  /** Reduce the phase fields of every cell on the device (see diagnostics.hpp)
+   *
+   * Fills cell_diag. Implemented in diagnostics.cu.
+   * */
+  void ComputeCellDiagnostics();
+
+  /** Compute the diagnostics, accumulate them and check them if required
+   *
+   * Warnings are handled according to --no-warning and --stop-at-warning.
+   * */
+  void Diagnose();
+
   /** Post run function */
   void Post();
 
@@ -625,6 +952,29 @@ enum class ManageMemory {
    * */
   void Update(bool, bool, unsigned t);
 
+  /** Run the kernels of one substep
+   *
+   * Passive substeps leave out everything that needs activity: polarisation,
+   * stress, vorticity and torques. The state is not copied back to the host.
+   * */
+  void UpdateDevice(bool store, bool passive);
+
+  // ===========================================================================
+  // Reference. Implemented in reference.cpp
+
+  /** Scalar reference implementation of Update() (without proliferation)
+   *
+   * Performs the same substep as the kernels on the host memory, one cell and
+   * one node at a time. Slow: only meant to check the device code.
+   * */
+  void ReferenceUpdate(bool store);
+
+  /** Daughter phase fields of cell n split along direction (see SplitCell) */
+  std::array<field, 2> ReferenceSplit(unsigned n, double direction) const;
+
+  /** Named copy of the state modified by an update (host memory) */
+  std::vector<std::pair<std::string, field>> ReferenceState() const;
+
   // ===========================================================================
   // Serialization
 
@@ -665,19 +1015,150 @@ enum class ManageMemory {
        & auto_name(patch_size);
   }
 
+  /** Serialization of the parameters that do not change during a run
+   *
+   * Used for the hash of the checkpoints (see ParametersHash()). Leaves out
+   * everything that is part of the state: the number of cells (divisions,
+   * injected and removed cells), the walls (reconfigured by Pre()) and the
+   * seed (picked at random if not given).
+   * */
+  template<class Archive>
+  void SerializeInvariants(Archive& ar)
+  {
+    ar & auto_name(Size)
+       & auto_name(BC)
+       & auto_name(nsubsteps)
+       & auto_name(gam)
+       & auto_name(mu)
+       & auto_name(lambda)
+       & auto_name(kappa_cc)
+       & auto_name(xi)
+       & auto_name(R)
+       & auto_name(alpha)
+       & auto_name(zetaS)
+       & auto_name(zetaQ)
+       & auto_name(omega_cc)
+       & auto_name(wall_thickness)
+       & auto_name(kappa_cs)
+       & auto_name(omega_cs)
+       & auto_name(patch_margin)
+       & auto_name(relax_time)
+       & auto_name(relax_nsubsteps)
+       & auto_name(npc)
+       & auto_name(Knem)
+       & auto_name(Kpol)
+       & auto_name(Snem)
+       & auto_name(Spol)
+       & auto_name(Jnem)
+       & auto_name(Jpol)
+       & auto_name(Wnem)
+       & auto_name(Dpol)
+       & auto_name(Dnem)
+       & auto_name(margin)
+       & auto_name(patch_size);
+  }
+
   /** Serialization of parameters (in and out) */
   template<class Archive>
   void SerializeFrame(Archive& ar)
   {
+    // only selected cells and region
+    if(OutputSelection()) return SerializeSelection(ar);
+
+    ar & auto_name(nphases);
+    // fields are written with reduced precision if requested, or to the
+    // delta archive
+    if(!delta_frames)
+    {
+      serialize_with_precision(ar, "phi", phi, phi_precision);
+      serialize_with_precision(ar, "field_sxx", field_sxx, stress_precision);
+      serialize_with_precision(ar, "field_syy", field_syy, stress_precision);
+      serialize_with_precision(ar, "field_szz", field_szz, stress_precision);
+      serialize_with_precision(ar, "field_sxy", field_sxy, stress_precision);
+      serialize_with_precision(ar, "field_sxz", field_sxz, stress_precision);
+      serialize_with_precision(ar, "field_syz", field_syz, stress_precision);
+    }
+    ar & auto_name(stored_gam)
+       & auto_name(stored_omega_cc)
+       & auto_name(stored_omega_cs)
+       & auto_name(stored_alpha)
+       & auto_name(stored_dpol)
+       & auto_name(cSxx)
+       & auto_name(cSxy)
+       & auto_name(cSxz)
+       & auto_name(cSyy)
+       & auto_name(cSyz)
+       & auto_name(cSzz)
+       & auto_name(offset)
+       & auto_name(com)
+       & auto_name(velocity)
+       & auto_name(Fpol)
+       & auto_name(Fpressure)
+       & auto_name(theta_pol)
+       & auto_name(patch_min)
+       & auto_name(patch_max);
+  }
+
+  /** Serialization of the selected cells and region only
+   *
+   * Same as SerializeFrame() but per-cell quantities are restricted to the
+   * selected cells (whose persistent indices are written in cell_index) and
+   * the global fields to the region of interest.
+   * */
+  template<class Archive>
+  void SerializeSelection(Archive& ar)
+  {
+    const auto cells = SelectedCells();
+    const auto pick = [&cells](const auto& v) {
+      std::vector<typename std::decay<decltype(v[0])>::type> ret;
+      ret.reserve(cells.size());
+      for(const auto i : cells) ret.push_back(v[i]);
+      return ret;
+    };
+
+    auto nphases = unsigned(cells.size());
+    auto cell_index = pick(nphases_index);
     ar & auto_name(nphases)
-       & auto_name(phi)
-       & auto_name(field_sxx)
-       & auto_name(field_syy)
-       & auto_name(field_szz)
-       & auto_name(field_sxy)
-       & auto_name(field_sxz)
-       & auto_name(field_syz)
-       & auto_name(stored_gam)
+       & auto_name(cell_index);
+    if(!delta_frames)
+    {
+      auto phi = pick(this->phi);
+      serialize_with_precision(ar, "phi", phi, phi_precision);
+      phi.clear();
+
+      auto field_sxx = CropToRegion(this->field_sxx);
+      serialize_with_precision(ar, "field_sxx", field_sxx, stress_precision);
+      auto field_syy = CropToRegion(this->field_syy);
+      serialize_with_precision(ar, "field_syy", field_syy, stress_precision);
+      auto field_szz = CropToRegion(this->field_szz);
+      serialize_with_precision(ar, "field_szz", field_szz, stress_precision);
+      auto field_sxy = CropToRegion(this->field_sxy);
+      serialize_with_precision(ar, "field_sxy", field_sxy, stress_precision);
+      auto field_sxz = CropToRegion(this->field_sxz);
+      serialize_with_precision(ar, "field_sxz", field_sxz, stress_precision);
+      auto field_syz = CropToRegion(this->field_syz);
+      serialize_with_precision(ar, "field_syz", field_syz, stress_precision);
+    }
+    auto stored_gam = pick(this->stored_gam);
+    auto stored_omega_cc = pick(this->stored_omega_cc);
+    auto stored_omega_cs = pick(this->stored_omega_cs);
+    auto stored_alpha = pick(this->stored_alpha);
+    auto stored_dpol = pick(this->stored_dpol);
+    auto cSxx = pick(this->cSxx);
+    auto cSxy = pick(this->cSxy);
+    auto cSxz = pick(this->cSxz);
+    auto cSyy = pick(this->cSyy);
+    auto cSyz = pick(this->cSyz);
+    auto cSzz = pick(this->cSzz);
+    auto offset = pick(this->offset);
+    auto com = pick(this->com);
+    auto velocity = pick(this->velocity);
+    auto Fpol = pick(this->Fpol);
+    auto Fpressure = pick(this->Fpressure);
+    auto theta_pol = pick(this->theta_pol);
+    auto patch_min = pick(this->patch_min);
+    auto patch_max = pick(this->patch_max);
+    ar & auto_name(stored_gam)
        & auto_name(stored_omega_cc)
        & auto_name(stored_omega_cs)
        & auto_name(stored_alpha)
@@ -697,7 +1178,29 @@ enum class ManageMemory {
        & auto_name(patch_min)
        & auto_name(patch_max);
   }
-  
+
+  // ===========================================================================
+  // Output selection. Implemented in select.cpp
+
+  /** Region of interest for the global fields {min x, max x, min y, max y,
+   * min z, max z} (max excluded), empty for the full domain */
+  std::vector<unsigned> output_region;
+  /** Persistent indices of the cells to write (empty for all) */
+  std::vector<unsigned> output_cells;
+  /** Write only the descendants of these cells (empty for all) */
+  std::vector<unsigned> output_lineage;
+  /** Write only the cells with omega_cc in this range {min, max} */
+  std::vector<double> output_omega_range;
+
+  /** Is any output selection active? */
+  bool OutputSelection() const;
+  /** Indices (not persistent) of the cells selected for output */
+  std::vector<unsigned> SelectedCells() const;
+  /** Restrict a global field to the region of interest */
+  field CropToRegion(const field&) const;
+  /** Check selection options */
+  void CheckOutputSelection() const;
+
   // ===========================================================================
   // Tools
   
@@ -740,19 +1243,14 @@ enum class ManageMemory {
   /** Get domain index from patch index */
   unsigned GetIndexFromPatch(unsigned n, unsigned q) const
   {
-    // position on the patch
-    const coord qpos = { (q/patch_size[1])%patch_size[0] , q%patch_size[1]  , q/( patch_size[0]*patch_size[1] ) };
-    // position on the domain
-    const coord dpos = ( (qpos + offset[n])%patch_size + patch_min[n] )%Size;
-    // return domain index
-    return GetIndex(dpos);
+    // see patch.hpp
+    return domain_index_from_patch(q, patch_size, offset[n], patch_min[n], Size);
   }
   
   coord GetNodePosOnPatch(unsigned n, unsigned q) const
   {
     // position on the patch
-    const coord qpos = { (q/patch_size[1])%patch_size[0] , q%patch_size[1]  , q/( patch_size[0]*patch_size[1] ) };
-    return qpos;
+    return patch_position(q, patch_size);
   }  
   
   coord GetNodePosOnDomain(unsigned n, unsigned q) const
@@ -35,6 +35,17 @@ void Model::ParseProgramOptions(int ac, char **av)
      "input file")
     ("force-delete,f", opt::bool_switch(&force_delete),
      "force deletion of existing output file")
+    ("replay", opt::value<vector<string>>(&replay_args)->multitoken(),
+     "re-simulate a window from the checkpoints with a different output. "
+     "Format: from=T1 to=T2 output=NAME [ninfo=N] [tolerance=TOL]")
+    ("branch", opt::value<vector<string>>(&branch_args)->multitoken(),
+     "fork one run per argument from the checkpoint at branch-from, each with "
+     "its own parameters. Format: key=value,... (keys: model parameters as "
+     "in the runcard, seed, output)")
+    ("branch-from", opt::value<unsigned>(&branch_from)->default_value(0u),
+     "time of the checkpoint from which the branches are started")
+    ("branch-jobs", opt::value<unsigned>(&branch_jobs)->default_value(1u),
+     "maximum number of branches running at the same time")
 //#ifdef _OPENMP
 //    ("threads,t",
 //     opt::value<unsigned>(&nthreads)->default_value(0)->implicit_value(1),
@@ -46,7 +57,9 @@ void Model::ParseProgramOptions(int ac, char **av)
     ("compress-full", opt::bool_switch(&compress_full),
      "compress full output using zip (might be slow)")
     ("no-write", opt::bool_switch(&no_write),
-     "disable file output (for testing purposes)");
+     "disable file output (for testing purposes)")
+    ("plan", opt::bool_switch(&plan),
+     "print the memory needed by the runcard and exit (nothing is allocated)");
 
   // options allowed both in the command line and config file
   opt::options_description config("Program options");
@@ -63,6 +76,64 @@ void Model::ParseProgramOptions(int ac, char **av)
      "perform runtime checks")
     ("stat", opt::bool_switch(&runtime_stats),
      "print runtime stats")
+    ("check-every", opt::value<unsigned>(&check_every)->default_value(0u),
+     "time steps between runtime checks and stats (0 for every ninfo steps)")
+    ("check-volume", opt::value<double>(&check_volume)->default_value(4.),
+     "largest ratio between a cell volume and vimp (runtime checks)")
+    ("check-leakage", opt::value<double>(&check_leakage)->default_value(.05),
+     "largest fraction of phi on the faces of a patch (runtime checks)")
+    ("check-phi", opt::value<double>(&check_phi)->default_value(.5),
+     "largest excursion of phi outside of [0, 1] (runtime checks)")
+    ("counters", opt::value<string>(&counters_file),
+     "write the transfer and event counters of every ninfo streak to a binary file")
+    ("timings", opt::value<string>(&timings_file),
+     "export the time spent in each stage (per ninfo streak) to a json file")
+    ("trace", opt::value<string>(&trace_file),
+     "write a timeline of the stages and writers to a Chrome trace file")
+    ("trace-size", opt::value<unsigned>(&trace_size)->default_value(1u<<20),
+     "number of spans kept per thread in the trace (oldest are dropped)")
+    ("roofline", opt::bool_switch(&roofline),
+     "measure the peak of the device and report the efficiency of each stage")
+    ("timeseries", opt::bool_switch(&write_timeseries),
+     "write per-cell time series to a binary columnar store")
+    ("timeseries-chunk", opt::value<unsigned>(&timeseries_chunk)->default_value(64u),
+     "number of frames per chunk of the time-series store")
+    ("phi-precision", opt::value<string>(&phi_precision_name)->default_value("double"),
+     "output precision of phi (double, float32, float16, q16, q8)")
+    ("stress-precision", opt::value<string>(&stress_precision_name)->default_value("double"),
+     "output precision of the stress fields (double, float32, float16, bounded)")
+    ("stress-tolerance", opt::value<double>(&stress_precision.tolerance),
+     "maximal absolute error of the stress fields for --stress-precision=bounded")
+    ("delta-frames", opt::bool_switch(&delta_frames),
+     "write phi and the stress fields to a delta-encoded archive")
+    ("keyframe-interval", opt::value<unsigned>(&keyframe_interval)->default_value(16u),
+     "number of frames between two keyframes of the delta archive")
+    ("shm-name", opt::value<string>(&shm_name),
+     "publish live frames in the POSIX shared memory segment with this name")
+    ("shm-slots", opt::value<unsigned>(&shm_slots)->default_value(4u),
+     "number of frames in the shared memory ring buffer")
+    ("shm-max-cells", opt::value<unsigned>(&shm_max_cells)->default_value(0u),
+     "maximum number of cells in shared memory (0=nphases_max)")
+    ("shm-patches", opt::bool_switch(&shm_patches),
+     "publish the phase field patches in shared memory")
+    ("shm-fields", opt::value<vector<string>>(&shm_fields)->multitoken(),
+     "global fields published in shared memory (e.g. field_press field_sxx)")
+    ("output-region", opt::value<vector<unsigned>>(&output_region)->multitoken(),
+     "region of interest for the global fields in the frames. "
+     "Format: {min x, max x, min y, max y, min z, max z} (max excluded)")
+    ("output-cells", opt::value<vector<unsigned>>(&output_cells)->multitoken(),
+     "write only the cells with these persistent indices")
+    ("output-lineage", opt::value<vector<unsigned>>(&output_lineage)->multitoken(),
+     "write only the descendants of the cells with these persistent indices")
+    ("output-omega-range", opt::value<vector<double>>(&output_omega_range)->multitoken(),
+     "write only the cells with omega_cc in this range. Format: {min, max}")
+    ("analysis", opt::value<vector<string>>(&analysis_args)->composing(),
+     "in-situ analysis 'NAME [every=T] [key=value ...]' (one per line), "
+     "e.g. contact_area, density, msd or contacts")
+    ("checkpoint-every", opt::value<unsigned>(&checkpoint_every)->default_value(0u),
+     "time interval between checkpoints of the full state (0=none)")
+    ("checkpoint-dir", opt::value<string>(&checkpoint_dir),
+     "directory of the checkpoints (default: output name + _checkpoints)")
     ("nstart", opt::value<unsigned>(&nstart)->default_value(0u),
      "time at which to start the output")
     ("bc", opt::value<unsigned>(&BC)->default_value(0u),
@@ -173,7 +244,8 @@ void Model::ParseProgramOptions(int ac, char **av)
   opt::options_description init("Initial configuration options");
   init.add_options()
     ("config", opt::value<string>(&init_config),
-      "Initial configuration")
+      "Initial configuration: 'input const' (input_str.dat), 'random', "
+      "'slab', 'hexagonal', 'cubic' or 'mask FILE'")
     ("relax-time", opt::value<unsigned>(&relax_time)->default_value(0u),
       "Relaxation time steps at initialization.")
     ("noise", opt::value<double>(&noise),
@@ -186,10 +258,16 @@ void Model::ParseProgramOptions(int ac, char **av)
       "Ratio of the size of the tumor compared to the domain size (for BC=6)")
     ("birth-boundaries", opt::value<vector<unsigned>>(&birth_bdries)->multitoken(),
      "Boundaries in which the cells are created "
-     "when the initial configuration 'random' is choosed. "
-     "Format: {min x, max, x, min y, max y}")
+     "when the initial configuration is generated. "
+     "Format: {min x, max x, min y, max y[, min z, max z]}")
+    ("init-distance", opt::value<double>(&init_distance),
+      "Minimal distance between generated cells (default 2R).")
+    ("init-height", opt::value<double>(&init_height),
+      "Height of the generated slab (default wall-thickness + R).")
     ("relax-nsubsteps", opt::value<unsigned>(&relax_nsubsteps)->default_value(0u),
-      "Value of nsubsteps to use at initial relaxation (0 means use nsubsteps).");
+      "Value of nsubsteps to use at initial relaxation (0 means use nsubsteps).")
+    ("relax-cache", opt::value<string>(&relax_cache),
+      "Directory of the cache of relaxed initial states (none if empty).");
 
   // ===========================================================================
   // Parsing
@@ -225,7 +303,14 @@ void Model::ParseProgramOptions(int ac, char **av)
 
   // parse input file (values are not erased, such that cmd line args
   // are 'stronger')
-  if(inputname.empty())
+  if(!runcard.empty())
+  {
+    // runcard given directly (library)
+    std::istringstream stream(runcard);
+    opt::store(opt::parse_config_file(stream, config_file_options), vm);
+    opt::notify(vm);
+  }
+  else if(inputname.empty())
     throw error_msg("please provide an input file / type -h for help.");
   else
   {
@@ -249,6 +334,40 @@ void Model::ParseProgramOptions(int ac, char **av)
     else runname = "./";
   }
 
+  // output precision
+  phi_precision.mode = parse_precision(phi_precision_name);
+  if(phi_precision.mode==precision::bounded)
+    throw error_msg("phi can not be written with bounded precision, use q16 or q8.");
+  stress_precision.mode = parse_precision(stress_precision_name);
+  if(stress_precision.mode==precision::q16 or stress_precision.mode==precision::q8)
+    throw error_msg("stress fields can not be written with precision ",
+                    stress_precision_name, ", use bounded.");
+  if(stress_precision.mode==precision::bounded and !(stress_precision.tolerance>0))
+    throw error_msg("bounded stress precision requires a positive stress-tolerance.");
+
+  // output selection
+  CheckOutputSelection();
+  // live frames
+  CheckPublishOptions();
+
+  // checkpoints are stored next to the output by default
+  if(vm.count("checkpoint-dir")==0)
+  {
+    string base = runname;
+    while(!base.empty() and base.back()=='/') base.pop_back();
+    checkpoint_dir = (base.empty() or base==".") ? "checkpoints"
+                                                 : base + "_checkpoints";
+  }
+  if(checkpoint_every and checkpoint_every%ninfo)
+    throw error_msg("checkpoint-every must be a multiple of ninfo.");
+
+  // replay mode (overwrites output name and window)
+  ParseReplayOptions();
+  // branches (checked before anything is forked)
+  ParseBranchOptions();
+  // in-situ analyses (after the replay, which can change ninfo)
+  ParseAnalysisOptions();
+
   // init random numbers?
   set_seed = vm.count("seed");
 
@@ -268,8 +387,9 @@ void Model::ParseProgramOptions(int ac, char **av)
   prolif_freq_mean *= nsubsteps * npc;
   prolif_start *= nsubsteps * npc;
 
-  // set nstart to the next correct frame (round above)
-  if(nstart%ninfo) nstart = (1u+nstart/ninfo)*ninfo;
+  // set nstart to the next correct frame (round above), a replay writes
+  // frames from the beginning of the window
+  if(!replay and nstart%ninfo) nstart = (1u+nstart/ninfo)*ninfo;
 }
 
 /** Print variables from variables_map
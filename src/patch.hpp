@@ -0,0 +1,87 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PATCH_HPP_
+#define PATCH_HPP_
+
+#include <cstddef>
+
+/** Memory layout of the patches and of the domain
+  *
+  * These functions are shared by the model, the archive codecs and the tools.
+  * They are templated on the coordinate type, which can be any type with three
+  * unsigned components accessed with operator[] (coord, std::array, ...).
+  *
+  * The domain index of node (x, y, z) is y + Ly*x + Lx*Ly*z, i.e. the memory
+  * order is (z, x, y) with y running fastest. Patches use the same layout, and
+  * are stored with a circular memory offset: node q of the patch of a cell
+  * sits at position ((q + offset)%patch_size + patch_min)%Size on the domain.
+  * */
+
+/** Position of node q on a patch (without offset) */
+template<class C>
+inline C patch_position(std::size_t q, const C& patch_size)
+{
+  return { static_cast<unsigned>((q/patch_size[1])%patch_size[0]),
+           static_cast<unsigned>(q%patch_size[1]),
+           static_cast<unsigned>(q/(std::size_t(patch_size[0])*patch_size[1])) };
+}
+
+/** Index of a position on the domain (or on a patch, with Size=patch_size) */
+template<class C>
+inline std::size_t domain_index(const C& p, const C& Size)
+{
+  return p[1] + std::size_t(Size[1])*p[0] + std::size_t(Size[0])*Size[1]*p[2];
+}
+
+/** Position of node q of a patch relative to patch_min (offset removed)
+  *
+  * This position is not wrapped around the domain and can thus be used to
+  * compute extents of cells crossing periodic boundaries.
+  * */
+template<class C>
+inline C unwrapped_patch_position(std::size_t q, const C& patch_size,
+                                  const C& offset)
+{
+  const C qpos = patch_position(q, patch_size);
+  return { (qpos[0]+offset[0])%patch_size[0],
+           (qpos[1]+offset[1])%patch_size[1],
+           (qpos[2]+offset[2])%patch_size[2] };
+}
+
+/** Domain position of node q of a patch */
+template<class C>
+inline C domain_position_from_patch(std::size_t q, const C& patch_size,
+                                    const C& offset, const C& patch_min,
+                                    const C& Size)
+{
+  const C p = unwrapped_patch_position(q, patch_size, offset);
+  return { (p[0]+patch_min[0])%Size[0],
+           (p[1]+patch_min[1])%Size[1],
+           (p[2]+patch_min[2])%Size[2] };
+}
+
+/** Domain index of node q of a patch */
+template<class C>
+inline std::size_t domain_index_from_patch(std::size_t q, const C& patch_size,
+                                           const C& offset, const C& patch_min,
+                                           const C& Size)
+{
+  return domain_index(domain_position_from_patch(q, patch_size, offset,
+                                                 patch_min, Size), Size);
+}
+
+#endif//PATCH_HPP_
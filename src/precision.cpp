@@ -0,0 +1,158 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "host_header.hpp"
+#include "precision.hpp"
+#include <cstring>
+
+using namespace std;
+
+precision parse_precision(const string& name)
+{
+  if(name=="double")  return precision::full;
+  if(name=="float32") return precision::float32;
+  if(name=="float16") return precision::float16;
+  if(name=="q16")     return precision::q16;
+  if(name=="q8")      return precision::q8;
+  if(name=="bounded") return precision::bounded;
+
+  throw error_msg("output precision '", name, "' unknown.");
+}
+
+uint16_t float_to_half(float value)
+{
+  uint32_t x;
+  memcpy(&x, &value, sizeof(x));
+
+  const uint16_t sign = (x>>16)&0x8000u;
+  const uint32_t abs = x&0x7fffffffu;
+
+  // nan and inf
+  if(abs>=0x7f800000u)
+    return sign | 0x7c00u | (abs>0x7f800000u ? 0x200u : 0u);
+  // overflow (rounds to inf)
+  if(abs>=0x477ff000u)
+    return sign | 0x7c00u;
+  // subnormal half: shift the significand (with hidden bit) into place
+  if(abs<0x38800000u)
+  {
+    // too small, rounds to zero
+    if(abs<0x33000000u) return sign;
+
+    const unsigned e = abs>>23;
+    const uint32_t m = (abs&0x7fffffu) | 0x800000u;
+    const unsigned shift = 126-e;
+    uint32_t h = m>>shift;
+    // round to nearest even
+    const uint32_t rem = m&((1u<<shift)-1);
+    const uint32_t half = 1u<<(shift-1);
+    if(rem>half or (rem==half and (h&1u))) ++h;
+    return sign | h;
+  }
+
+  // normal: rebias exponent and round the significand to nearest even
+  uint32_t h = ((abs>>13) - ((127-15)<<10));
+  const uint32_t rem = abs&0x1fffu;
+  if(rem>0x1000u or (rem==0x1000u and (h&1u))) ++h;
+  return sign | h;
+}
+
+float half_to_float(uint16_t bits)
+{
+  const uint32_t sign = uint32_t(bits&0x8000u)<<16;
+  const uint32_t e = (bits>>10)&0x1fu;
+  const uint32_t m = bits&0x3ffu;
+
+  float value;
+  if(e==0)
+    // zero and subnormals
+    value = ldexp(static_cast<float>(m), -24);
+  else if(e==31)
+    value = m ? numeric_limits<float>::quiet_NaN()
+              : numeric_limits<float>::infinity();
+  else
+  {
+    const uint32_t x = ((e+127-15)<<23) | (m<<13);
+    memcpy(&value, &x, sizeof(value));
+  }
+
+  return sign ? -value : value;
+}
+
+/** Alphabet of base64 */
+static const char base64_chars[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+string base64_encode(const void* data, size_t size)
+{
+  const auto bytes = static_cast<const unsigned char*>(data);
+  string text;
+  text.reserve(4*((size+2)/3));
+
+  for(size_t i=0; i<size; i+=3)
+  {
+    // 3 bytes to 4 characters, padded with '='
+    const unsigned n = size-i;
+    const uint32_t w = (uint32_t(bytes[i])<<16)
+                     | (n>1 ? uint32_t(bytes[i+1])<<8 : 0u)
+                     | (n>2 ? uint32_t(bytes[i+2]) : 0u);
+    text += base64_chars[(w>>18)&63];
+    text += base64_chars[(w>>12)&63];
+    text += n>1 ? base64_chars[(w>>6)&63] : '=';
+    text += n>2 ? base64_chars[w&63] : '=';
+  }
+  return text;
+}
+
+vector<unsigned char> base64_decode(const string& text)
+{
+  if(text.size()%4) throw error_msg("invalid base64 data.");
+
+  const auto digit = [](char c) -> uint32_t {
+    if(c>='A' and c<='Z') return c-'A';
+    if(c>='a' and c<='z') return c-'a'+26;
+    if(c>='0' and c<='9') return c-'0'+52;
+    if(c=='+') return 62;
+    if(c=='/') return 63;
+    throw error_msg("invalid base64 data.");
+  };
+
+  vector<unsigned char> bytes;
+  bytes.reserve(3*(text.size()/4));
+  for(size_t i=0; i<text.size(); i+=4)
+  {
+    const bool last = i+4==text.size();
+    const unsigned pad = last ? (text[i+3]=='=') + (text[i+2]=='=') : 0;
+    if(pad==1 and text[i+2]=='=') throw error_msg("invalid base64 data.");
+
+    uint32_t w = digit(text[i])<<18 | digit(text[i+1])<<12;
+    if(pad<2) w |= digit(text[i+2])<<6;
+    if(pad<1) w |= digit(text[i+3]);
+
+    bytes.push_back((w>>16)&255);
+    if(pad<2) bytes.push_back((w>>8)&255);
+    if(pad<1) bytes.push_back(w&255);
+  }
+  return bytes;
+}
+
+string detail::fixed_type_name(double offset, double step, const string& word)
+{
+  char off[format_buffer_size], stp[format_buffer_size];
+  const auto n = format_number(off, offset);
+  const auto m = format_number(stp, step);
+  return "fixed(" + string(off, n) + "," + string(stp, m) + "," + word + ")";
+}
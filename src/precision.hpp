@@ -0,0 +1,257 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PRECISION_HPP_
+#define PRECISION_HPP_
+
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <utility>
+#include "serialization.hpp"
+
+/** Reduced-precision output of fields
+  *
+  * Fields can be written in full precision (double), as single or half
+  * precision floats, or as fixed-point integers q such that the value is
+  * offset + q*step. Half precision and fixed-point values are packed in
+  * binary words (native byte order) and every innermost array is written as
+  * a single base64 string. The type name written to the archive carries all
+  * the information needed to decode the values, e.g. array(base64(float16)):
+  *
+  *   float                       single precision (json numbers)
+  *   base64(float16)             IEEE 754 half precision values
+  *   base64(fixed(off,step,W))   fixed-point integers of type W (uint8,
+  *                               uint16 or int32), value is off + q*step
+  *
+  * Values which can not be encoded (nans, or beyond the range of the words)
+  * mark the archive as bad, see oarchive::bad_value().
+  * */
+enum class precision
+{
+  full,     ///< double
+  float32,  ///< single precision
+  float16,  ///< half precision
+  q16,      ///< 16 bits fixed-point over the range of the data
+  q8,       ///< 8 bits fixed-point over the range of the data
+  bounded   ///< fixed-point with absolute error bound
+};
+
+/** Output precision of a field */
+struct output_precision
+{
+  /** Encoding */
+  precision mode = precision::full;
+  /** Maximal absolute error (mode bounded only) */
+  double tolerance = 0;
+};
+
+/** Parse precision from its option name (double, float32, float16, q16, q8,
+ * bounded) */
+precision parse_precision(const std::string& name);
+
+/** Convert float to the bits of a half precision float (round to nearest) */
+uint16_t float_to_half(float value);
+/** Convert bits of a half precision float to float */
+float half_to_float(uint16_t bits);
+
+/** Encode bytes in base64 (RFC 4648, with padding) */
+std::string base64_encode(const void* data, std::size_t size);
+/** Decode base64 text (throws if the text is not valid base64) */
+std::vector<unsigned char> base64_decode(const std::string& text);
+
+namespace detail
+{
+  /** Nested vector of Out with the same structure as T */
+  template<class T, class Out>
+  struct leaves_as
+  { using type = Out; };
+
+  template<class T, class Out>
+  struct leaves_as<std::vector<T>, Out>
+  { using type = std::vector<typename leaves_as<T, Out>::type>; };
+
+  /** Apply function to every value of a (nested) vector and collect result */
+  template<class Out, class F>
+  std::vector<Out> transform_leaves(const std::vector<double>& v, F f)
+  {
+    std::vector<Out> ret(v.size());
+    for(std::size_t i=0; i<v.size(); ++i) ret[i] = f(v[i]);
+    return ret;
+  }
+
+  template<class Out, class F, class T>
+  typename leaves_as<std::vector<std::vector<T>>, Out>::type
+  transform_leaves(const std::vector<std::vector<T>>& v, F f)
+  {
+    typename leaves_as<std::vector<std::vector<T>>, Out>::type ret;
+    ret.reserve(v.size());
+    for(const auto& w : v) ret.emplace_back(transform_leaves<Out>(w, f));
+    return ret;
+  }
+
+  /** Range of the values of a (nested) vector */
+  inline void leaves_range(const std::vector<double>& v, double& lo, double& hi)
+  {
+    for(const auto x : v)
+    {
+      lo = std::min(lo, x);
+      hi = std::max(hi, x);
+    }
+  }
+
+  template<class T>
+  void leaves_range(const std::vector<std::vector<T>>& v, double& lo, double& hi)
+  {
+    for(const auto& w : v) leaves_range(w, lo, hi);
+  }
+
+  /** Nested vector with the innermost vectors of doubles as strings */
+  template<class T>
+  struct encoded;
+
+  template<>
+  struct encoded<std::vector<double>>
+  { using type = std::string; };
+
+  template<class T>
+  struct encoded<std::vector<std::vector<T>>>
+  { using type = std::vector<typename encoded<std::vector<T>>::type>; };
+
+  /** Encode every innermost vector as base64 of the words f(x, bad) */
+  template<class Word, class F>
+  std::string encode_leaves(const std::vector<double>& v, F f, bool& bad)
+  {
+    std::vector<Word> words(v.size());
+    for(std::size_t i=0; i<v.size(); ++i) words[i] = f(v[i], bad);
+    return base64_encode(words.data(), words.size()*sizeof(Word));
+  }
+
+  template<class Word, class F, class T>
+  typename encoded<std::vector<std::vector<T>>>::type
+  encode_leaves(const std::vector<std::vector<T>>& v, F f, bool& bad)
+  {
+    typename encoded<std::vector<std::vector<T>>>::type ret;
+    ret.reserve(v.size());
+    for(const auto& w : v) ret.emplace_back(encode_leaves<Word>(w, f, bad));
+    return ret;
+  }
+
+  /** Type name of the encoded data, e.g. array(base64(float16)) */
+  template<class T>
+  std::string encoded_type_name(const std::string& leaf)
+  {
+    const std::string plain = "array(double)";
+    std::string name = type_name<T>::name();
+    const auto pos = name.rfind(plain);
+    return name.replace(pos, plain.size(), "base64(" + leaf + ")");
+  }
+
+  /** Type name of fixed-point values stored in words of a given type */
+  std::string fixed_type_name(double offset, double step,
+                              const std::string& word);
+
+  /** Write fixed-point data to archive */
+  template<class Word, class Archive, class T>
+  void serialize_fixed(Archive& ar, const std::string& name, const T& data,
+                       double offset, double step, const std::string& word)
+  {
+    bool bad = false;
+    auto value = encode_leaves<Word>(data, [offset, step](double x, bool& invalid) {
+        const double q = std::round((x-offset)/step);
+        // nans fail both comparisons
+        if(!(q>=std::numeric_limits<Word>::min()
+             and q<=std::numeric_limits<Word>::max()))
+        {
+          invalid = true;
+          return Word(0);
+        }
+        return static_cast<Word>(q);
+      }, bad);
+    auto v = make_typed_value(std::move(value),
+                              encoded_type_name<T>(fixed_type_name(offset, step, word)),
+                              bad);
+    ar & std::pair<decltype(v)&, std::string>(v, name);
+  }
+}
+
+/** Serialize (nested vector of) doubles with given output precision */
+template<class Archive, class T>
+void serialize_with_precision(Archive& ar, const std::string& name, T& data,
+                              const output_precision& p)
+{
+  switch(p.mode)
+  {
+    case precision::full:
+    {
+      ar & std::pair<T&, std::string>(data, name);
+      break;
+    }
+    case precision::float32:
+    {
+      auto v = detail::transform_leaves<float>(data, [](double x) {
+        return static_cast<float>(x);
+      });
+      ar & std::pair<decltype(v)&, std::string>(v, name);
+      break;
+    }
+    case precision::float16:
+    {
+      bool bad = false;
+      auto value = detail::encode_leaves<uint16_t>(data, [](double x, bool& invalid) {
+          const uint16_t h = float_to_half(static_cast<float>(x));
+          // nans, infinities and values beyond the largest half
+          if((h&0x7c00u)==0x7c00u) invalid = true;
+          return h;
+        }, bad);
+      auto v = make_typed_value(std::move(value),
+                                detail::encoded_type_name<T>("float16"), bad);
+      ar & std::pair<decltype(v)&, std::string>(v, name);
+      break;
+    }
+    case precision::q16:
+    case precision::q8:
+    {
+      // map the range of the data onto the available integers
+      double lo = HUGE_VAL, hi = -HUGE_VAL;
+      detail::leaves_range(data, lo, hi);
+      if(lo>hi) lo = hi = 0;
+      if(p.mode==precision::q16)
+      {
+        const double step = hi>lo ? (hi-lo)/65535. : 1.;
+        detail::serialize_fixed<uint16_t>(ar, name, data, lo, step, "uint16");
+      }
+      else
+      {
+        const double step = hi>lo ? (hi-lo)/255. : 1.;
+        detail::serialize_fixed<uint8_t>(ar, name, data, lo, step, "uint8");
+      }
+      break;
+    }
+    case precision::bounded:
+    {
+      // rounding to the nearest multiple of step gives error <= step/2
+      detail::serialize_fixed<int32_t>(ar, name, data, 0., 2*p.tolerance,
+                                       "int32");
+      break;
+    }
+  }
+}
+
+#endif//PRECISION_HPP_
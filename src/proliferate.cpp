@@ -92,10 +92,6 @@ void Model::BirthCellMemories(unsigned new_nphases){
 
 void Model::DivideCell(unsigned n, unsigned idx, double division_orientation, double cellProp){
 
-  double px = com[n][0];
-  double py = com[n][1];
-  double pz = com[n][2];
-  
   stored_gam[idx] = stored_gam[n];
   stored_gam[idx-1] = stored_gam[n];
   
@@ -129,11 +125,19 @@ void Model::DivideCell(unsigned n, unsigned idx, double division_orientation, do
 	divisiontthresh[idx-1] = 0.;
 
   
-  double rndir = random_uniform();
-  double px1 = px + (R)*cos(rndir);
-  double py1 = py + (R)*sin(rndir);
-  double px2 = px + (R)*cos(rndir+M_PI);
-  double py2 = py + (R)*sin(rndir+M_PI);
+  SplitCell(n, idx, random_uniform());
+}
+
+void Model::SplitCell(unsigned n, unsigned idx, double direction){
+
+  double px = com[n][0];
+  double py = com[n][1];
+  double pz = com[n][2];
+
+  double px1 = px + (R)*cos(direction);
+  double py1 = py + (R)*sin(direction);
+  double px2 = px + (R)*cos(direction+M_PI);
+  double py2 = py + (R)*sin(direction+M_PI);
 
   for(unsigned q=0; q<patch_N; ++q){
   
@@ -325,6 +329,54 @@ void Model::initDivisionOU(unsigned n, unsigned i, double division_orientation,
 
 
 
+unsigned Model::InjectCell(const coord& center, unsigned t)
+{
+  const double relt = static_cast<double>(t) / (nsubsteps * ninfo);
+  const unsigned n = nphases_index.size();
+  if(n>=nphases_max)
+    throw error_msg("can not add a cell: nphases_max is reached.");
+
+  GetFromDevice();
+  FreeDeviceMemoryCellBirth();
+
+  // drop the spare memory left by the divisions and add the new cell
+  BirthCellMemories(n);
+  BirthCellMemories(n+1);
+
+  nphases_index_head = nphases_index_head + 1;
+  nphases_index.push_back(nphases_index_head);
+  cellLineage(/*cell_id=*/nphases_index_head,/*parent_id=*/-1,/*birth_time=*/relt,/*death_time=*/-1,/*physicalprop=*/omega_cc,/*generation=*/0);
+
+  AddCellMix(n, center);
+  timer[n] = 0.;
+  stored_tmean[n] = relax_time + random_exponential(1./prolif_freq_mean);// mean = 1/lambda
+  divisiontthresh[n] = 0.;
+
+  nphases = nphases_index.size();
+  AllocDeviceMemoryCellBirth();
+  PutToDevice();
+
+  return nphases_index_head;
+}
+
+void Model::RemoveCell(unsigned i, unsigned t)
+{
+  const double relt = static_cast<double>(t) / (nsubsteps * ninfo);
+  if(i>=nphases_index.size())
+    throw error_msg("can not remove cell ", i, ": out of range.");
+
+  GetFromDevice();
+  FreeDeviceMemoryCellBirth();
+
+  const unsigned n = nphases_index[i];
+  cellLineage(/*cell_id=*/n,/*parent_id=*/-1,/*birth_time=*/-1,/*death_time=*/relt,/*physicalprop=*/stored_omega_cc[i],/*generation=*/0);
+  KillCell(n, i);
+
+  nphases = nphases_index.size();
+  AllocDeviceMemoryCellBirth();
+  PutToDevice();
+}
+
 std::vector<double> Model::compute_eigen(double sxx, double sxy, double syy){
 
         double trace = sxx + syy;
@@ -441,6 +493,8 @@ double Model::compute_percentile(double p, vector<double>& fdata) {
 
 void Model::proliferate_stress_based(unsigned t) {
 
+	scoped_timer stage_timer(timers, stage::proliferation);
+
 	double pcompglobal = 0.;
 	double ptensglobal = 0.;
 	double wcompglobal = 0.;
@@ -511,6 +565,7 @@ void Model::proliferate_stress_based(unsigned t) {
 		
 		// stress_based_prolif_criterion =  (pglobal * (plocal - pglobal)) > 0;
               if (proliferate_bool && (t > prolif_start) && nphases_index.size() < nphases_max && timer[i] >= divisiontthresh[i] && (com[i][2]-wall_thickness) < 3.*R) {
+		scoped_timer division_timer(timers, stage::division);
 		cout<<"dividing cell "<<i<<" "<<n<<" "<<timer[i]<<" "<<divisiontthresh[i]<<endl;
 		
 		bool mutate = false;
@@ -527,12 +582,14 @@ void Model::proliferate_stress_based(unsigned t) {
 		GetFromDevice();
 		FreeDeviceMemoryCellBirth();
 		initDivisionOU(n, i, angle, t, mutate);
+		counters.add(counter::divisions);
 
 		while (!detached.empty()) {
 		unsigned j = detached.back();
 		detached.pop_back();
 		cout<<"removing :"<<j<<" "<<nphases_index[j]<<endl;
 		KillCell(nphases_index[j], j);
+		counters.add(counter::detachments);
 		}
 		print_new_cell_props();
 		nphases = nphases_index.size();
@@ -602,6 +659,7 @@ void Model::write_cellHist_binary(const std::string &filename,
                                   unsigned currentTime,
                                   const std::map<int, cellInfo> &hist)
 {
+    counted_file counted(counters, filename, counted_file::mode::append);
     std::ofstream out(filename, std::ios::binary | std::ios::app);
     if (!out) {
         std::cerr << "Could not open file " << filename << " for binary write.\n";
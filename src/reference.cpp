@@ -0,0 +1,360 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** Scalar reference implementation of the update
+  *
+  * Plain loops over the cells and the nodes of their patches, in the same
+  * order of stages as the kernels of Update() (see run.cu). Nothing here is
+  * meant to be fast: this is the baseline against which the device code is
+  * checked, see tools/oracle.cpp.
+  * */
+
+#include "header.hpp"
+#include "model.hpp"
+#include "derivatives.hpp"
+
+using namespace std;
+
+void Model::ReferenceUpdate(bool store)
+{
+  const unsigned ncells = nphases_index.size();
+
+  // ---------------------------------------------------------------------------
+  // sums
+
+  for(unsigned n=0; n<ncells; ++n)
+    for(unsigned q=0; q<patch_N; ++q)
+    {
+      const auto   k = GetIndexFromPatch(n, q);
+      const double p = phi[n][q];
+
+      sum_one[k]    += p;
+      sum_two[k]    += p*p;
+      field_polx[k] += p*polarization[n][0];
+      field_poly[k] += p*polarization[n][1];
+      field_polz[k] += p*polarization[n][2];
+      field_velx[k] += p*velocity[n][0];
+      field_vely[k] += p*velocity[n][1];
+      field_velz[k] += p*velocity[n][2];
+    }
+
+  // ---------------------------------------------------------------------------
+  // potential, pressure and stress
+
+  for(unsigned n=0; n<ncells; ++n)
+    for(unsigned q=0; q<patch_N; ++q)
+    {
+      const auto   k = GetIndexFromPatch(n, q);
+      const double p = phi[n][q];
+
+      const double ll = laplacian(phi[n], neighbors_patch[q]);
+      const double ls = laplacian(sum_one, neighbors[k]);
+
+      const double internal =
+        + stored_gam[n]*(8*p*(1-p)*(1-2*p)/lambda - 2*lambda*ll)
+        - 4*mu/vimp*(1-vol[n]/vimp)*p;
+
+      const double interactions =
+        // repulsion and adhesion between cells
+        + 2*kappa_cc/lambda*p*(sum_two[k]-p*p)
+        - 2*stored_omega_cc[n]*lambda*(ls-ll)
+        // repulsion and adhesion with the walls
+        + 2*kappa_cs/lambda*p*walls[k]*walls[k]
+        - 2*stored_omega_cs[n]*lambda*walls_laplace[k];
+
+      V[n][q]         = internal + interactions;
+      field_press[k] += p*interactions;
+
+      // stress integrated over the voxel of the 2x2x2 nodes starting at k,
+      // wrapped periodically (see integrate_stress() for the device)
+      const coord x = GetPosition(k);
+      double sxx = 0, sxy = 0, sxz = 0, syy = 0, syz = 0, szz = 0;
+      for(unsigned dz=0; dz<2; ++dz)
+      for(unsigned dy=0; dy<2; ++dy)
+      for(unsigned dx=0; dx<2; ++dx)
+      {
+        const unsigned j = GetIndex({ (x[0]+dx)%Size[0], (x[1]+dy)%Size[1],
+                                      (x[2]+dz)%Size[2] });
+        // unit vector from the centre of the voxel to the node
+        const vec<double, 3> u = vec<double, 3> { .5-dx, .5-dy, .5-dz }/sqrt(.75);
+        const vec<double, 3> U = { field_velx[j], field_vely[j], field_velz[j] };
+        sxx += xi*u[0]*U[0];
+        sxy += xi*(u[0]*U[1] + u[1]*U[0]);
+        sxz += xi*(u[0]*U[2] + u[2]*U[0]);
+        syy += xi*u[1]*U[1];
+        syz += xi*(u[1]*U[2] + u[2]*U[1]);
+        szz += xi*u[2]*U[2];
+      }
+      field_sxx[k] = (field_sxx[k] + sxx)/8;
+      field_sxy[k] = (field_sxy[k] + sxy)/16;
+      field_sxz[k] = (field_sxz[k] + sxz)/16;
+      field_syy[k] = (field_syy[k] + syy)/8;
+      field_syz[k] = (field_syz[k] + syz)/16;
+      field_szz[k] = (field_szz[k] + szz)/8;
+    }
+
+  // ---------------------------------------------------------------------------
+  // forces and torques
+
+  for(unsigned n=0; n<ncells; ++n)
+  {
+    Fpol[n] = Fpressure[n] = vorticity[n] = { 0., 0., 0. };
+    delta_theta_pol[n] = 0;
+  }
+
+  for(unsigned n=0; n<ncells; ++n)
+    for(unsigned q=0; q<patch_N; ++q)
+    {
+      const auto   k = GetIndexFromPatch(n, q);
+      const double p = phi[n][q];
+      const auto& s  = neighbors[k];
+      const auto& sq = neighbors_patch[q];
+
+      const vec<double, 3> grad = { derivX(phi[n], sq),
+                                    derivY(phi[n], sq),
+                                    derivZ(phi[n], sq) };
+      const vec<double, 3> grad_sum = { derivX(sum_one, s),
+                                        derivY(sum_one, s),
+                                        derivZ(sum_one, s) };
+      const vec<double, 3> U = { field_velx[k], field_vely[k], field_velz[k] };
+
+      phi_dx[n][q] = grad[0];
+      phi_dy[n][q] = grad[1];
+      phi_dz[n][q] = grad[2];
+
+      Fpressure[n] += field_press[k]*grad;
+
+      cSxx[n] += p*field_sxx[k];
+      cSxy[n] += p*field_sxy[k];
+      cSxz[n] += p*field_sxz[k];
+      cSyy[n] += p*field_syy[k];
+      cSyz[n] += p*field_syz[k];
+      cSzz[n] += p*field_szz[k];
+
+      // vorticity: U x grad(phi)
+      vorticity[n] += vec<double, 3> { U[1]*grad[2] - U[2]*grad[1],
+                                       U[2]*grad[0] - U[0]*grad[2],
+                                       U[0]*grad[1] - U[1]*grad[0] };
+
+      // polarisation torque: angle between the polarisation of the cell and
+      // the one of its neighbours, weighted by the overlap
+      const auto& pol = polarization[n];
+      const vec<double, 3> P = { field_polx[k] - p*pol[0],
+                                 field_poly[k] - p*pol[1],
+                                 field_polz[k] - p*pol[2] };
+      const vec<double, 3> cross = { P[1]*pol[0] - P[0]*pol[1],
+                                     P[2]*pol[0] - P[0]*pol[2],
+                                     P[2]*pol[1] - P[1]*pol[2] };
+      const double ovlap = -(grad*(grad_sum - grad));
+      delta_theta_pol[n] += ovlap*atan2(sqrt(cross*cross), P*pol);
+    }
+
+  // ---------------------------------------------------------------------------
+  // polarisation force and velocity
+
+  for(unsigned n=0; n<ncells; ++n)
+  {
+    Fpol[n]     = stored_alpha[n]*polarization[n];
+    velocity[n] = (Fpressure[n] + Fpol[n])/xi;
+  }
+
+  // ---------------------------------------------------------------------------
+  // integration of the phase fields
+
+  for(unsigned n=0; n<ncells; ++n)
+  {
+    com_x[n] = com_y[n] = com_z[n] = 0.;
+    vol[n] = 0;
+  }
+
+  for(unsigned n=0; n<ncells; ++n)
+    for(unsigned q=0; q<patch_N; ++q)
+    {
+      const auto k = GetIndexFromPatch(n, q);
+
+      dphi[n][q] = - V[n][q] - velocity[n]*vec<double, 3> { phi_dx[n][q],
+                                                            phi_dy[n][q],
+                                                            phi_dz[n][q] };
+      if(store)
+      {
+        dphi_old[n][q] = dphi[n][q];
+        phi_old[n][q]  = phi[n][q];
+      }
+
+      // predictor-corrector
+      const double p = phi_old[n][q] + time_step*.5*(dphi[n][q] + dphi_old[n][q]);
+      phi[n][q] = p;
+
+      com_x[n] += com_x_table[GetXPosition(k)]*p;
+      com_y[n] += com_y_table[GetYPosition(k)]*p;
+      com_z[n] += com_z_table[GetZPosition(k)]*p;
+      vol[n]   += p*p;
+
+      sum_one[k]     = 0;
+      sum_two[k]     = 0;
+      field_press[k] = 0;
+      field_velx[k]  = 0;
+      field_vely[k]  = 0;
+      field_velz[k]  = 0;
+    }
+
+  // ---------------------------------------------------------------------------
+  // polarisation, center of mass and patch of every cell
+
+  for(unsigned n=0; n<ncells; ++n)
+  {
+    // euler-maruyama
+    if(store)
+      theta_pol_old[n] = theta_pol[n] + sqrt(time_step)*stored_dpol[n]*random_normal();
+
+    // (abs() is the squared norm)
+    const auto& ff  = Fpressure[n];
+    const auto& pol = polarization[n];
+    const vec<double, 3> cross = { ff[1]*pol[0] - ff[0]*pol[1],
+                                   ff[2]*pol[0] - ff[0]*pol[2],
+                                   ff[2]*pol[1] - ff[1]*pol[2] };
+    theta_pol[n] = theta_pol_old[n] - time_step*(
+        + Kpol*delta_theta_pol[n]
+        + Jpol*ff.abs()*atan2(sqrt(cross*cross), ff*pol) );
+    polarization[n] = { Spol*cos(theta_pol[n]), Spol*sin(theta_pol[n]), 0. };
+
+    // the center of mass is the phase of the periodic moments
+    com[n] = { (arg(com_x[n]/double(N)) + Pi)/2./Pi*Size[0],
+               (arg(com_y[n]/double(N)) + Pi)/2./Pi*Size[1],
+               (arg(com_z[n]/double(N)) + Pi)/2./Pi*Size[2] };
+
+    // move the patch such that it stays centered on the cell
+    const coord com_grd { unsigned(round(com[n][0])),
+                          unsigned(round(com[n][1])),
+                          unsigned(round(com[n][2])) };
+    const coord new_min = ( com_grd + Size - patch_margin ) % Size;
+    const coord new_max = ( com_grd + patch_margin - coord {1u, 1u} ) % Size;
+    coord displacement  = ( Size + new_min - patch_min[n] ) % Size;
+    for(unsigned d=0; d<3; ++d)
+      if(displacement[d]==Size[d]-1u) displacement[d] = patch_size[d]-1u;
+
+    offset[n]    = ( offset[n] + patch_size - displacement ) % patch_size;
+    patch_min[n] = new_min;
+    patch_max[n] = new_max;
+  }
+}
+
+array<field, 2> Model::ReferenceSplit(unsigned n, double direction) const
+{
+  // the interface between the daughters goes through the center of mass,
+  // perpendicular to the division direction in the xy plane
+  const double epsilon = 75.;
+  const vec<double, 3> u = { cos(direction), sin(direction), 0. };
+
+  array<field, 2> daughters = {{ field(patch_N), field(patch_N) }};
+  for(unsigned q=0; q<patch_N; ++q)
+  {
+    const coord r = GetPosition(GetIndexFromPatch(n, q));
+    const vec<double, 3> dr = { r[0] - com[n][0], r[1] - com[n][1], r[2] - com[n][2] };
+    const double chi = .5*(1 + tanh(u*dr/epsilon));
+
+    daughters[0][q] = phi[n][q]*chi;
+    daughters[1][q] = phi[n][q]*(1-chi);
+  }
+  return daughters;
+}
+
+vector<pair<string, field>> Model::ReferenceState() const
+{
+  const unsigned ncells = nphases_index.size();
+  vector<pair<string, field>> state;
+
+  const auto add_global = [&](const char *name, const field& f) {
+    state.emplace_back(name, f);
+  };
+  const auto add_patches = [&](const char *name, const vector<field>& f) {
+    field flat;
+    for(unsigned n=0; n<ncells; ++n) flat.insert(flat.end(), f[n].begin(), f[n].end());
+    state.emplace_back(name, flat);
+  };
+  const auto add_scalars = [&](const char *name, const field& f) {
+    state.emplace_back(name, field(f.begin(), f.begin()+ncells));
+  };
+  const auto add_vectors = [&](const char *name, const vector<vec<double, 3>>& f) {
+    field flat;
+    for(unsigned n=0; n<ncells; ++n) flat.insert(flat.end(), { f[n][0], f[n][1], f[n][2] });
+    state.emplace_back(name, flat);
+  };
+  const auto add_complex = [&](const char *name, const vector<complex<double>>& f) {
+    field flat;
+    for(unsigned n=0; n<ncells; ++n) flat.insert(flat.end(), { f[n].real(), f[n].imag() });
+    state.emplace_back(name, flat);
+  };
+  const auto add_coords = [&](const char *name, const vector<coord>& f) {
+    field flat;
+    for(unsigned n=0; n<ncells; ++n)
+      flat.insert(flat.end(), { double(f[n][0]), double(f[n][1]), double(f[n][2]) });
+    state.emplace_back(name, flat);
+  };
+
+  add_global("sum_one", sum_one);
+  add_global("sum_two", sum_two);
+  add_global("field_press", field_press);
+  add_global("field_polx", field_polx);
+  add_global("field_poly", field_poly);
+  add_global("field_polz", field_polz);
+  add_global("field_velx", field_velx);
+  add_global("field_vely", field_vely);
+  add_global("field_velz", field_velz);
+  add_global("field_sxx", field_sxx);
+  add_global("field_sxy", field_sxy);
+  add_global("field_sxz", field_sxz);
+  add_global("field_syy", field_syy);
+  add_global("field_syz", field_syz);
+  add_global("field_szz", field_szz);
+
+  add_patches("phi", phi);
+  add_patches("phi_old", phi_old);
+  add_patches("V", V);
+  add_patches("dphi", dphi);
+  add_patches("dphi_old", dphi_old);
+  add_patches("phi_dx", phi_dx);
+  add_patches("phi_dy", phi_dy);
+  add_patches("phi_dz", phi_dz);
+
+  add_scalars("vol", vol);
+  add_scalars("delta_theta_pol", delta_theta_pol);
+  add_scalars("theta_pol", theta_pol);
+  add_scalars("theta_pol_old", theta_pol_old);
+  add_scalars("cSxx", cSxx);
+  add_scalars("cSxy", cSxy);
+  add_scalars("cSxz", cSxz);
+  add_scalars("cSyy", cSyy);
+  add_scalars("cSyz", cSyz);
+  add_scalars("cSzz", cSzz);
+
+  add_vectors("com", com);
+  add_vectors("velocity", velocity);
+  add_vectors("polarization", polarization);
+  add_vectors("Fpressure", Fpressure);
+  add_vectors("Fpol", Fpol);
+  add_vectors("vorticity", vorticity);
+
+  add_complex("com_x", com_x);
+  add_complex("com_y", com_y);
+  add_complex("com_z", com_z);
+
+  add_coords("patch_min", patch_min);
+  add_coords("patch_max", patch_max);
+  add_coords("offset", offset);
+
+  return state;
+}
@@ -0,0 +1,106 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "header.hpp"
+#include "roofline.hpp"
+
+using namespace std;
+
+stage_cost update_cost(stage s, size_t patch_N, size_t ncells)
+{
+  // sizes of a value and of a stencil index
+  const double d = sizeof(double), i = sizeof(unsigned);
+  // values and indices read by a derivative and a laplacian
+  const double deriv = 2*d + 2*i, lapl = 7*d + 7*i;
+  // per-cell quantities read by the node kernels are assumed to be cached
+  const double nodes = double(ncells)*patch_N, cells = ncells;
+
+  switch(s)
+  {
+    case stage::sums:
+      // phi, read-modify-write of sum_one, sum_two, field_pol* and field_vel*
+      return { nodes*(d + 8*2*d), nodes*15 };
+    case stage::potential:
+      // phi, two laplacians, sum_two, walls, walls_laplace, V, field_press,
+      // and the stress: 8 velocities and 6 components updated
+      return { nodes*(d + 2*lapl + 3*d + d + 2*d + 8*3*d + 6*2*d),
+               nodes*(2*8 + 40 + 2 + 8*45 + 16) };
+    case stage::fields:
+      // phi, six derivatives, field_press, field_s*, phi_d* written, field_vel*
+      // and field_pol*
+      return { nodes*(d + 6*deriv + d + 6*d + 3*d + 3*d + 3*d),
+               nodes*80 };
+    case stage::polvel:
+      // alpha, polarization, Fpressure, Fpol and velocity written
+      return { cells*(d + 3*d + 3*d + 2*3*d), cells*9 };
+    case stage::phase_field:
+      // V, phi_d*, dphi written, phi_old, dphi_old, phi, and six fields reset
+      return { nodes*(d + 3*d + d + 2*d + 2*d + 6*d), nodes*24 };
+    case stage::cells:
+      // angles and torque, Fpressure, polarization, moments, com, and the
+      // patch coordinates
+      return { cells*(4*d + 3*d + 2*3*d + 6*d + 3*d + 3*2*3*i), cells*80 };
+    default:
+      return {};
+  }
+}
+
+void stage_costs::add_update(size_t patch_N, size_t ncells)
+{
+  for(const auto s : { stage::sums, stage::potential, stage::fields,
+                       stage::polvel, stage::phase_field, stage::cells })
+    total[static_cast<unsigned>(s)] += update_cost(s, patch_N, ncells);
+}
+
+void stage_costs::print(ostream& stream, const stage_times& times,
+                        const device_peak& peak) const
+{
+  stream << "  " << setw(16) << left << "stage" << right
+         << setw(10) << "GB/s" << setw(10) << "GFlop/s"
+         << setw(10) << "flop/B";
+  if(peak.bandwidth>0)
+    stream << setw(10) << "% bw" << setw(10) << "% flops" << "  bound";
+  stream << '\n';
+
+  for(unsigned k=0; k<nstages; ++k)
+  {
+    const auto& c = total[k];
+    if(c.bytes==0 or times[k]==0) continue;
+
+    const double bandwidth = c.bytes/times[k], flops = c.flops/times[k];
+    stream << "  " << setw(16) << left << stage_name(static_cast<stage>(k))
+           << right << fixed << setprecision(2)
+           << setw(10) << bandwidth/1e9 << setw(10) << flops/1e9
+           << setw(10) << c.flops/c.bytes;
+    if(peak.bandwidth>0)
+    {
+      // the ridge point of the roofline separates the two regimes
+      const double ridge = peak.flops/peak.bandwidth;
+      stream << setprecision(1)
+             << setw(10) << 100*bandwidth/peak.bandwidth
+             << setw(10) << 100*flops/peak.flops
+             << "  " << (c.flops/c.bytes<ridge ? "memory" : "compute");
+    }
+    stream << '\n';
+  }
+
+  if(peak.bandwidth>0)
+    stream << "  device peak: " << fixed << setprecision(1)
+           << peak.bandwidth/1e9 << " GB/s, " << peak.flops/1e9
+           << " GFlop/s (ridge at " << setprecision(2)
+           << peak.flops/peak.bandwidth << " flop/B)\n";
+  stream << defaultfloat << setprecision(6);
+}
@@ -0,0 +1,127 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "header.hpp"
+#include "roofline.hpp"
+#include "cuda.h"
+
+using namespace std;
+
+/** Number of elements of the arrays of the triad (3 x 64 MB) */
+#define PeakTriadSize (1u<<23)
+/** Number of iterations of every chain of the fma probe */
+#define PeakFmaIterations 4096
+/** Number of repetitions of each probe (the best one is kept) */
+#define PeakRepeat 10
+
+__global__
+void cuPeakTriad(double *a, const double *b, const double *c, double s,
+                 unsigned n)
+{
+	const unsigned m = blockIdx.x*blockDim.x + threadIdx.x;
+	if(m>=n) return;
+	a[m] = b[m] + s*c[m];
+}
+
+__global__
+void cuPeakFma(double *out, double s)
+{
+	const unsigned m = blockIdx.x*blockDim.x + threadIdx.x;
+
+	// independent chains to hide the latency of the fma
+	double x0 = m, x1 = m+1, x2 = m+2, x3 = m+3,
+	       x4 = m+4, x5 = m+5, x6 = m+6, x7 = m+7;
+	for(unsigned k=0; k<PeakFmaIterations; ++k)
+	{
+		x0 = fma(x0, s, s); x1 = fma(x1, s, s);
+		x2 = fma(x2, s, s); x3 = fma(x3, s, s);
+		x4 = fma(x4, s, s); x5 = fma(x5, s, s);
+		x6 = fma(x6, s, s); x7 = fma(x7, s, s);
+	}
+	// never true, such that nothing is optimised away
+	const double x = x0+x1+x2+x3+x4+x5+x6+x7;
+	if(x==-1.) out[m] = x;
+}
+
+/** Best time (in s) of PeakRepeat launches */
+template<class F>
+static double best_time(F launch)
+{
+  cudaEvent_t start, stop;
+  cudaEventCreate(&start);
+  cudaEventCreate(&stop);
+
+  // warm-up
+  launch();
+  cudaDeviceSynchronize();
+
+  float best = numeric_limits<float>::max();
+  for(unsigned r=0; r<PeakRepeat; ++r)
+  {
+    cudaEventRecord(start);
+    launch();
+    cudaEventRecord(stop);
+    cudaEventSynchronize(stop);
+    float ms = 0;
+    cudaEventElapsedTime(&ms, start, stop);
+    best = min(best, ms);
+  }
+
+  cudaEventDestroy(start);
+  cudaEventDestroy(stop);
+
+  const cudaError_t err = cudaGetLastError();
+  if(err != cudaSuccess)
+    throw error_msg("peak probe failed: ", cudaGetErrorString(err), ".");
+  return best/1e3;
+}
+
+device_peak measure_device_peak()
+{
+  const unsigned n = PeakTriadSize;
+  double *a, *b, *c;
+  if(cudaMalloc((void**)&a, n*sizeof(double)) != cudaSuccess)
+    throw error_msg("can not allocate the device memory of the peak probe.");
+  if(cudaMalloc((void**)&b, n*sizeof(double)) != cudaSuccess or
+     cudaMalloc((void**)&c, n*sizeof(double)) != cudaSuccess)
+  {
+    cudaFree(a);
+    cudaFree(b);
+    throw error_msg("can not allocate the device memory of the peak probe.");
+  }
+  cudaMemset(b, 0, n*sizeof(double));
+  cudaMemset(c, 0, n*sizeof(double));
+
+  const unsigned blocks = (n + ThreadsPerBlock - 1)/ThreadsPerBlock;
+  device_peak peak;
+
+  // triad: two arrays read, one written
+  const double t_triad = best_time([&] {
+    cuPeakTriad<<<blocks, ThreadsPerBlock>>>(a, b, c, 3., n);
+  });
+  peak.bandwidth = 3.*n*sizeof(double)/t_triad;
+
+  // fma: two flops each, on as many threads as the triad
+  const double t_fma = best_time([&] {
+    cuPeakFma<<<blocks, ThreadsPerBlock>>>(a, .999);
+  });
+  peak.flops = 2.*8*PeakFmaIterations*double(blocks)*ThreadsPerBlock/t_fma;
+
+  cudaFree(a);
+  cudaFree(b);
+  cudaFree(c);
+  return peak;
+}
@@ -0,0 +1,83 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ROOFLINE_HPP_
+#define ROOFLINE_HPP_
+
+#include <array>
+#include <cstddef>
+#include <iostream>
+#include "timer.hpp"
+
+/** Efficiency of the stages of the update
+  *
+  * Every kernel of Update() has an analytic model of the bytes it moves to and
+  * from device memory and of the floating point operations it performs, as a
+  * function of the patch size patch_N and the number of cells (all kernels
+  * work on the patches: the size of the domain does not enter). The model
+  * counts every access once (no cache), stencil indices included, and every
+  * arithmetic operation or function call as one flop: it is a nominal cost
+  * meant to compare stages and implementations, not a hardware counter.
+  *
+  * Combined with the stage times, it gives the bandwidth and flop rate
+  * achieved by each stage, to be compared with the peak of the device as
+  * measured by a STREAM-like triad and a chain of fused multiply-adds.
+  * */
+
+/** Bytes moved and floating point operations */
+struct stage_cost
+{
+  double bytes = 0, flops = 0;
+
+  stage_cost& operator+=(const stage_cost& c)
+  {
+    bytes += c.bytes;
+    flops += c.flops;
+    return *this;
+  }
+};
+
+/** Peak bandwidth (bytes/s) and flop rate (flop/s) of the device */
+struct device_peak
+{
+  double bandwidth = 0, flops = 0;
+};
+
+/** Analytic cost of one call to the kernel of stage s (zero for the stages
+ * that are not part of the update) */
+stage_cost update_cost(stage s, std::size_t patch_N, std::size_t ncells);
+
+/** Measure the peak of the current device (implemented in roofline.cu) */
+device_peak measure_device_peak();
+
+/** Accumulated cost of each stage */
+class stage_costs
+{
+public:
+  std::array<stage_cost, nstages> total {};
+
+  /** Add the cost of one call to Update() */
+  void add_update(std::size_t patch_N, std::size_t ncells);
+
+  /** Print achieved rates and, if the peak is known, fractions of the peak
+   *
+   * The time of each stage is taken from the stage timers.
+   * */
+  void print(std::ostream& stream, const stage_times& times,
+             const device_peak& peak) const;
+};
+
+#endif//ROOFLINE_HPP_
@@ -18,6 +18,7 @@
 #include "header.hpp"
 #include "model.hpp"
 #include "derivatives.hpp"
+#include "stress.hpp"
 #include "tools.hpp"
 #include "cuda.h"
 //#include "reduce.h"
@@ -40,54 +41,38 @@ void Model::Pre()
 
   if(relax_time>0)
   {
-
-    double save_alpha  = 0; swap(alpha,  save_alpha);
-    double save_zetaS  = 0; swap(zetaS,  save_zetaS);
-    double save_zetaQ  = 0; swap(zetaQ,  save_zetaQ);
-    double save_Dnem  = 0; swap(Dnem,  save_Dnem);
-    double save_Dpol  = 0; swap(Dpol,  save_Dpol);
-    double save_Jnem  = 0; swap(Jnem,  save_Jnem);
-    double save_Jpol  = 0; swap(Jpol,  save_Jpol);
-    double save_Kpol  = 0; swap(Kpol,  save_Kpol);
-    double save_Knem  = 0; swap(Knem,  save_Knem);
-    double save_Wnem  = 0; swap(Wnem,  save_Wnem);
-
-    if(relax_nsubsteps) swap(nsubsteps, relax_nsubsteps);
-
-    for(unsigned i=0; i<relax_time*nsubsteps; ++i)
-      for(unsigned j=0; j<=npc; ++j) Update(0,0,j==0);
-
-    if(relax_nsubsteps) swap(nsubsteps, relax_nsubsteps);
-
-    swap(alpha, save_alpha);
-    swap(zetaS, save_zetaS);
-    swap(zetaQ, save_zetaQ);
-    swap(Jnem, save_Jnem);
-    swap(Jpol, save_Jpol);
-    swap(Dnem, save_Dnem);
-    swap(Dpol, save_Dpol);
-    swap(Kpol, save_Kpol);
-    swap(Knem, save_Knem);
-    swap(Wnem, save_Wnem);
-
+    // the stages of the relaxation are not timed separately
+    scoped_timer stage_timer(timers, stage::relax);
+    // the key depends on the initial positions: computed before relaxing
+    const string key = relax_cache.empty() ? string() : RelaxationKey();
+    if(relax_cache.empty() or !LoadRelaxedState(key))
+    {
+      Relax();
+      if(!relax_cache.empty()) SaveRelaxedState(key);
+    }
   }
 
   if(BC==5 || BC==7) ConfigureWalls(1);
   if(BC==6) ConfigureWalls(0);
 }
 
-void Model::Post()
-{}
+void Model::Relax()
+{
+  // relax_nsubsteps only changes the number of iterations, not the time step
+  const unsigned n = relax_nsubsteps ? relax_nsubsteps : nsubsteps;
 
-void Model::PreRunStats()
-{}
+  timers.paused = true;
+  for(unsigned i=0; i<relax_time*n; ++i)
+    for(unsigned j=0; j<=npc; ++j) UpdateDevice(j==0, true);
+  timers.paused = false;
 
-void Model::RuntimeStats()
-{}
+  GetFromDevice();
+}
 
-void Model::RuntimeChecks()
+void Model::Post()
 {}
 
+
 __global__
 void cuUpdateSumsAtNode(	   double *phi,
 				   double *sum_one, 
@@ -105,7 +90,8 @@ void cuUpdateSumsAtNode(	   double *phi,
 				   coord patch_size,
 				   coord *patch_min,
 				   coord Size,
-				   coord *offset)
+				   coord *offset,
+				   bool passive)
 
 				   
 {
@@ -137,13 +123,15 @@ void cuUpdateSumsAtNode(	   double *phi,
 	//sum_two[k] += p*p;
 	atomicAdd(&sum_one[k], p);
 	atomicAdd(&sum_two[k], p * p);
-
-	field_polx[k] += p*polarization[n][0];
-	field_poly[k] += p*polarization[n][1];
-	field_polz[k] += p*polarization[n][2];
-	field_velx[k] += p*velocity[n][0];
-	field_vely[k] += p*velocity[n][1];
-	field_velz[k] += p*velocity[n][2];
+	// the polarisation and velocity fields only enter the active terms
+	if(passive) return;
+
+	atomicAdd(&field_polx[k], p*polarization[n][0]);
+	atomicAdd(&field_poly[k], p*polarization[n][1]);
+	atomicAdd(&field_polz[k], p*polarization[n][2]);
+	atomicAdd(&field_velx[k], p*velocity[n][0]);
+	atomicAdd(&field_vely[k], p*velocity[n][1]);
+	atomicAdd(&field_velz[k], p*velocity[n][2]);
 	
 	
 }
@@ -187,7 +175,8 @@ void cuUpdatePotAtNode(stencil *neighbors,
 				  double xi,
 				  double *field_velx,
 				  double *field_vely,
-				  double *field_velz)
+				  double *field_velz,
+				  bool passive)
 {
 
 	// build indices with cuda!!
@@ -226,57 +215,17 @@ void cuUpdatePotAtNode(stencil *neighbors,
 	// delta F / delta phi_i
 	V[m] = internal + interactions;
 	// pressure
-	// atomicAdd(&field_press[k],p*interactions);
-	field_press[k] += p*interactions;
+	// cells overlapping at k add their contributions concurrently
+	atomicAdd(&field_press[k], p*interactions);
 	
 	
 	// -----------------------------------------------------------------------------
 	// compute stress field 
 	// -----------------------------------------------------------------------------
 	
-	// const int nsite = 2;
-	double factor = 8;
-	int nvx = Size[0]-1;
-	int nvy = Size[1]-1;
-	int nvz = Size[2]-1;
-       double cx = (k/Size[1])%Size[0] + 0.5;
-       double cy = k%Size[1] + 0.5;
-       double cz = k/(Size[0]*Size[1]) + 0.5;
-       // Loop over the 2×2×2 integration points (unrolled for clarity)
-       for (int dz = 0; dz < 2; dz++) {
-       	for (int dy = 0; dy < 2; dy++) {
-              	for (int dx = 0; dx < 2; dx++) {
-              		double ix = (cx-0.5)+dx;
-              		double iy = (cy-0.5)+dy;
-              		double iz = (cz-0.5)+dz;
-              		double diff_x = cx - ix;
-              		double diff_y = cy - iy;
-              		double diff_z = cz - iz;
-              		double norm = sqrt(diff_x*diff_x+diff_y*diff_y+diff_z*diff_z);
-              		if (norm == 0) norm = 1;
-              		double ux = diff_x / norm;
-              		double uy = diff_y / norm;
-              		double uz = diff_z / norm;
-              		int idx = iy + Size[1]*ix + Size[0]*Size[1]*iz;
-              		field_sxx[k] += ux*xi*field_velx[idx];
-              		field_sxy[k] += ux*xi*field_vely[idx];
-              		field_sxy[k] += uy*xi*field_velx[idx];
-              		field_sxz[k] += ux*xi*field_velz[idx];
-              		field_sxz[k] += uz*xi*field_velx[idx];
-              		field_syy[k] += uy*xi*field_vely[idx];
-              		field_syz[k] += uy*xi*field_velz[idx];
-              		field_syz[k] += uz*xi*field_vely[idx];
-              		field_szz[k] += uz*xi*field_velz[idx];
-              	}
-              }
-       }
-       field_sxx[k] /= factor;
-       field_sxy[k] /= (2.*factor);
-       field_sxz[k] /= (2.*factor);
-       field_syy[k] /= factor;
-       field_syz[k] /= (2.*factor);
-       field_szz[k] /= factor;
-       
+	if(!passive)
+	integrate_stress(k, Size, xi, field_velx, field_vely, field_velz,
+	                 field_sxx, field_sxy, field_sxz, field_syy, field_syz, field_szz);
 
 	if (q==0){
     	Fpol[n] = Fpressure[n] = vorticity[n] = {0, 0, 0};//add fnem[n],fshape[n] 
@@ -325,7 +274,8 @@ void cuUpdatePhysicalFieldsAtNode( stencil *neighbors,
 						double *cSxz,
 						double *cSyy,
 						double *cSyz,
-						double *cSzz)		  	
+						double *cSzz,
+						bool passive)
 {
 
 	// build indices with cuda!!
@@ -368,6 +318,20 @@ void cuUpdatePhysicalFieldsAtNode( stencil *neighbors,
 	//atomicAdd(&cell_fshape,fshape);
 	//atomicAdd(&cell_fnem,fnem);
 	
+	// store derivatives
+	phi_dx[m] = dx;
+	phi_dy[m] = dy;
+	phi_dz[m] = dz;
+
+	if(q==0){
+	com_x[n] = com_y[n] = com_z[n] = make_cuDoubleComplex(0., 0.);
+	vol[n] = 0.;
+	//S00[n] = S01[n] = S02[n] = S12[n] = S11[n] = S22[n] = vol[n] = 0;
+	}
+
+	// stress, vorticity and torques do not move a passive cell
+	if(passive) return;
+
 	atomicAdd(&cSxx[n],p*field_sxx[k]);
 	atomicAdd(&cSxy[n],p*field_sxy[k]);
 	atomicAdd(&cSxz[n],p*field_sxz[k]);
@@ -375,16 +339,10 @@ void cuUpdatePhysicalFieldsAtNode( stencil *neighbors,
 	atomicAdd(&cSyz[n],p*field_syz[k]);
 	atomicAdd(&cSzz[n],p*field_szz[k]);
 
-	
-	// store derivatives
-	phi_dx[m] = dx;
-	phi_dy[m] = dy;
-	phi_dz[m] = dz;
-
 	// nematic torques
 	// tau[n]       += phi[n][q] * (sumQ00[k]*Q01[n] - sumQ01[k]*Q00[n]);
 	// vorticity
-	const vec<double,3> vortval = { U2[k]*dy-U1[k]*dz, U0[k]*dz-U2[k]*dx, U2[k]*dx-U0[k]*dy };//--> field_velx
+	const vec<double,3> vortval = { U2[k]*dy-U1[k]*dz, U0[k]*dz-U2[k]*dx, U1[k]*dx-U0[k]*dy };//--> field_velx
 	atomicAdd(&vorticity[n][0],-vortval[0]);//--> vorticity[n]
 	atomicAdd(&vorticity[n][1],-vortval[1]);//--> vorticity[n]
 	atomicAdd(&vorticity[n][2],-vortval[2]);//--> vorticity[n]
@@ -397,12 +355,6 @@ void cuUpdatePhysicalFieldsAtNode( stencil *neighbors,
 	P[0]*polarization[n][0]+P[1]*polarization[n][1]+P[2]*polarization[n][2]                               
 		                     );
 	atomicAdd(&delta_theta_pol[n],delt_theta_pol);//--> delta_theta_pol[n]
-	
-	if(q==0){
-	com_x[n] = com_y[n] = com_z[n] = make_cuDoubleComplex(0., 0.);
-	vol[n] = 0.;
-	//S00[n] = S01[n] = S02[n] = S12[n] = S11[n] = S22[n] = vol[n] = 0;
-	}
 
 }
 
@@ -415,11 +367,13 @@ void cuUpdatePolVel(
     vec<double,3> *Fpol,
     vec<double,3> *velocity,
     vec<double,3> *polarization,
-    unsigned nphases)
+    unsigned nphases,
+    bool passive)
 {
 	const int m = blockIdx.x * blockDim.x + threadIdx.x;
 	if(m >= nphases) return;
-	Fpol[m]     = stored_alpha[m] * polarization[m];
+	if(passive) Fpol[m] = {0, 0, 0};
+	else Fpol[m] = stored_alpha[m] * polarization[m];
 	velocity[m] = (Fpressure[m] + Fpol[m]) / xi; //add nematic+shape...
 }
 
@@ -654,7 +608,8 @@ void cuUpdateAtCell(			  	cuDoubleComplex *com_x,
 					  	double Jpol,
 					  	unsigned N,
 					  	curandState *rand_states,
-					  	bool store)
+					  	bool store,
+					  	bool passive)
 {
 
 	
@@ -666,7 +621,8 @@ void cuUpdateAtCell(			  	cuDoubleComplex *com_x,
 	// -----------------------------------------------------------------------------
 	// UpdatePolarization(n, store);
 	// -----------------------------------------------------------------------------
-	// euler-marijuana update
+	// euler-marijuana update (the polarisation is frozen when passive)
+	if(!passive){
 	if(store){
 	theta_pol_old[m] = theta_pol[m] + sqrt(time_step)*stored_dpol[m]*curand_normal(&rand_states[m]);
 	}
@@ -679,6 +635,7 @@ void cuUpdateAtCell(			  	cuDoubleComplex *com_x,
 	ff[0]*polarization[m][0]+ff[1]*polarization[m][1]+ff[2]*polarization[m][2]                               
 		               ));            
 	polarization[m] = { Spol*cos(theta_pol[m]), Spol*sin(theta_pol[m]) };
+	}
 	// -----------------------------------------------------------------------------
 	// UpdateNematic(n, store);
 	// -----------------------------------------------------------------------------
@@ -711,6 +668,15 @@ void cuUpdateAtCell(			  	cuDoubleComplex *com_x,
 
 
 __host__ void Model::Update(bool store, bool end_pred_corr_step, unsigned t)
+{
+    UpdateDevice(store, false);
+    GetFromDevice();
+    // proliferate(t);
+    // if (end_pred_corr_step) 
+    proliferate_stress_based(t);
+}
+
+__host__ void Model::UpdateDevice(bool store, bool passive)
 {
     
     n_total   = static_cast<int>(nphases_index.size() * patch_N);
@@ -720,6 +686,8 @@ __host__ void Model::Update(bool store, bool end_pred_corr_step, unsigned t)
     nph_total   = static_cast<int>(nphases_index.size());
     nph_blocks  = (nph_total + ThreadsPerBlock - 1) / ThreadsPerBlock;
     nph_threads = ThreadsPerBlock;
+
+    if(roofline and !passive) costs.add_update(patch_N, nphases_index.size());
     
     /*
    // STEP 1: Allocate host buffer for copying data back
@@ -750,6 +718,7 @@ __host__ void Model::Update(bool store, bool end_pred_corr_step, unsigned t)
         exit(-1);
     }
     
+    scoped_timer stage_timer(timers, stage::sums);
     cuUpdateSumsAtNode<<<n_blocks, n_threads>>>(d_phi,
 						      d_sum_one,
 				                    d_sum_two,
@@ -766,7 +735,8 @@ __host__ void Model::Update(bool store, bool end_pred_corr_step, unsigned t)
                              		      patch_size,
 				                    d_patch_min,
 				                    Size,
-				                    d_offset);
+				                    d_offset,
+				                    passive);
 
     err = cudaGetLastError();
     if (err != cudaSuccess) {
@@ -775,6 +745,7 @@ __host__ void Model::Update(bool store, bool end_pred_corr_step, unsigned t)
     }
     cudaDeviceSynchronize();
  
+    timers.next(stage::potential);
     cuUpdatePotAtNode<<<n_blocks, n_threads>>>(d_neighbors,
                              d_neighbors_patch,
                              d_phi,
@@ -812,7 +783,8 @@ __host__ void Model::Update(bool store, bool end_pred_corr_step, unsigned t)
 				 xi,
 				 d_field_velx,
 				 d_field_vely,
-				 d_field_velz);
+				 d_field_velz,
+				 passive);
 
     err = cudaGetLastError();
     if (err != cudaSuccess) {
@@ -823,6 +795,7 @@ __host__ void Model::Update(bool store, bool end_pred_corr_step, unsigned t)
     
     
     
+    timers.next(stage::fields);
     cuUpdatePhysicalFieldsAtNode<<<n_blocks, n_threads>>>(d_neighbors,
                                      d_neighbors_patch,
                                      d_phi,
@@ -862,7 +835,8 @@ __host__ void Model::Update(bool store, bool end_pred_corr_step, unsigned t)
 					  d_cSxz,
 					  d_cSyy,
 					  d_cSyz,
-					  d_cSzz);
+					  d_cSzz,
+					  passive);
 					  	
 
     err = cudaGetLastError();
@@ -872,6 +846,7 @@ __host__ void Model::Update(bool store, bool end_pred_corr_step, unsigned t)
     }
     cudaDeviceSynchronize();
 
+    timers.next(stage::polvel);
     cuUpdatePolVel<<<nph_blocks, nph_threads>>>(
 		    d_stored_alpha,
 		    xi,
@@ -879,7 +854,8 @@ __host__ void Model::Update(bool store, bool end_pred_corr_step, unsigned t)
 		    d_Fpol,
 		    d_velocity,
 		    d_polarization,
-		    nphases);
+		    nphases,
+		    passive);
     
     err = cudaGetLastError();
     if (err != cudaSuccess) {
@@ -888,6 +864,7 @@ __host__ void Model::Update(bool store, bool end_pred_corr_step, unsigned t)
     }
     cudaDeviceSynchronize();
     
+    timers.next(stage::phase_field);
     cuUpdatePhaseFieldAtNode<<<n_blocks, n_threads>>>(d_phi,
                                  d_phi_dx,
                                  d_phi_dy,
@@ -936,6 +913,7 @@ __host__ void Model::Update(bool store, bool end_pred_corr_step, unsigned t)
     }
     cudaDeviceSynchronize();
 		  			  	
+    timers.next(stage::cells);
            cuUpdateAtCell<<<nph_blocks, nph_threads>>>(
                                  d_com_x,
                                  d_com_y,
@@ -964,7 +942,8 @@ __host__ void Model::Update(bool store, bool end_pred_corr_step, unsigned t)
                                  Jpol,
                                  N,
                                  d_rand_states,
-                                 store);
+                                 store,
+                                 passive);
 
     err = cudaGetLastError();
     if (err != cudaSuccess) {
@@ -972,13 +951,6 @@ __host__ void Model::Update(bool store, bool end_pred_corr_step, unsigned t)
         exit(-1);
     }
     cudaDeviceSynchronize();
-    
-    GetFromDevice();
-    // proliferate(t);
-    // if (end_pred_corr_step) 
-    proliferate_stress_based(t);
-
-    
 }
 
 
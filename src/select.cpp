@@ -0,0 +1,108 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "header.hpp"
+#include "model.hpp"
+#include <algorithm>
+
+using namespace std;
+
+bool Model::OutputSelection() const
+{
+  return !output_region.empty() or !output_cells.empty()
+      or !output_lineage.empty() or !output_omega_range.empty();
+}
+
+vector<unsigned> Model::SelectedCells() const
+{
+  vector<unsigned> cells;
+  for(unsigned i=0; i<nphases_index.size(); ++i)
+  {
+    const unsigned n = nphases_index[i];
+
+    // cell filters are combined: all of them must be satisfied
+    if(!output_cells.empty() and
+       find(output_cells.begin(), output_cells.end(), n)==output_cells.end())
+      continue;
+
+    if(!output_omega_range.empty() and
+       (stored_omega_cc[i]<output_omega_range[0] or
+        stored_omega_cc[i]>output_omega_range[1]))
+      continue;
+
+    if(!output_lineage.empty())
+    {
+      // follow the parents up to a lineage root (or the first cell)
+      int m = n;
+      bool found = false;
+      for(;;)
+      {
+        if(find(output_lineage.begin(), output_lineage.end(), unsigned(m))
+           != output_lineage.end()) { found = true; break; }
+
+        const auto it = cellHist.find(m);
+        if(it==cellHist.end() or it->second.parent<0) break;
+        m = it->second.parent;
+      }
+      if(!found) continue;
+    }
+
+    cells.push_back(i);
+  }
+
+  return cells;
+}
+
+field Model::CropToRegion(const field& f) const
+{
+  if(output_region.empty()) return f;
+
+  const unsigned x0 = output_region[0], x1 = output_region[1];
+  const unsigned y0 = output_region[2], y1 = output_region[3];
+  const unsigned z0 = output_region[4], z1 = output_region[5];
+
+  // same memory layout as the full domain (see GetIndex())
+  field ret;
+  ret.reserve((x1-x0)*(y1-y0)*(z1-z0));
+  for(unsigned z=z0; z<z1; ++z)
+    for(unsigned x=x0; x<x1; ++x)
+    {
+      const auto begin = f.begin() + GetIndex({ x, y0, z });
+      ret.insert(ret.end(), begin, begin + (y1-y0));
+    }
+
+  return ret;
+}
+
+void Model::CheckOutputSelection() const
+{
+  if(!output_region.empty())
+  {
+    if(output_region.size()!=6)
+      throw error_msg("output-region needs 6 values: "
+                      "{min x, max x, min y, max y, min z, max z}.");
+    for(unsigned d=0; d<3; ++d)
+      if(output_region[2*d]>=output_region[2*d+1] or
+         output_region[2*d+1]>Size[d])
+        throw error_msg("output-region does not define a valid region "
+                        "within the domain.");
+    if(delta_frames)
+      throw error_msg("output-region can not be used with delta-frames.");
+  }
+
+  if(!output_omega_range.empty() and output_omega_range.size()!=2)
+    throw error_msg("output-omega-range needs 2 values: {min, max}.");
+}
@@ -23,6 +23,20 @@ using namespace std;
 /** The number of spaces in indendation */
 static const unsigned padding = 2;
 
+/** Write new line followed by indentation without temporary strings */
+static void write_indent(std::ostream& stream, unsigned n)
+{
+  static const string spaces(256, ' ');
+
+  stream.put('\n');
+  while(n>spaces.size())
+  {
+    stream.write(spaces.data(), spaces.size());
+    n -= spaces.size();
+  }
+  stream.write(spaces.data(), n);
+}
+
 oarchive::oarchive(std::ostream& stream_, string id, unsigned version)
   : stream(stream_)
 {
@@ -42,7 +56,7 @@ oarchive::~oarchive()
   // close the 'data' group
   close_group();
   // write final brace
-  if(stream.good()) stream << endl << '}';
+  if(stream.good()) stream << "\n}";
 }
 
 void oarchive::indent(unsigned n)
@@ -70,7 +84,7 @@ void oarchive::close_group(const string& cbrace)
   // unindent
   unindent();
   // new line
-  stream << endl << string(padding*level, ' ');
+  write_indent(stream, padding*level);
   // close brace
   stream << cbrace;
   // not the first in the list
@@ -88,22 +102,18 @@ void oarchive::new_line()
   // add comma
   if(!first) stream << ',';
   else first = false;
-  // new line
-  stream << endl;
-  // indent
-  stream << string(padding*level, ' ');
+  // new line and indent
+  write_indent(stream, padding*level);
 }
 
 template<>
 void oarchive::add_element<const char*>(const char* const& t)
 {
-  std::stringstream ss;
-  ss << "\"" << t << "\"";
-  stream << ss.str();
+  stream << '"' << t << '"';
 }
 
 template<>
 void oarchive::add_element<std::string>(const std::string& t)
 {
-  add_element(t.c_str());
+  stream << '"' << t << '"';
 }
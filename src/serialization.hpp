@@ -18,6 +18,8 @@
 #ifndef SERIALIZATION_HPP_
 #define SERIALIZATION_HPP_
 
+#include "format.hpp"
+
 // =============================================================================
 // Tools
 
@@ -40,6 +42,27 @@ struct bad_stream : public std::exception
   * */
 #define auto_name(obj) std::pair<decltype(obj)&, std::string> {obj, #obj}
 
+/** Value together with a type name known only at run time
+  *
+  * This is used for encoded data whose type name carries extra information,
+  * such as the scale of quantised fields (see precision.hpp).
+  * */
+template<class T>
+struct typed_value
+{
+  T value;
+  std::string type;
+  /** Could some values not be encoded? (see oarchive::bad_value()) */
+  bool bad;
+};
+
+/** Construct typed_value */
+template<class T>
+typed_value<typename std::decay<T>::type> make_typed_value(T&& value,
+                                                           std::string type,
+                                                           bool bad = false)
+{ return { std::forward<T>(value), std::move(type), bad }; }
+
 // =============================================================================
 // Type traits (using SFINAE)
 
@@ -248,6 +271,25 @@ class oarchive : public std::ostream
   template<class T>
   void add_iterable(const T&);
 
+  /** Write number using the fast formatter */
+  template<class T>
+  void write_number(T value)
+  {
+    char buf[format_buffer_size];
+    stream.write(buf, format_number(buf, value));
+  }
+  /** Write scalar value (fallback for types without fast formatting) */
+  template<class T>
+  void write_value(const T& value) { stream << value; }
+  void write_value(double value) { write_number(value); }
+  void write_value(float value) { write_number(value); }
+  void write_value(int value) { write_number(value); }
+  void write_value(long value) { write_number(value); }
+  void write_value(long long value) { write_number(value); }
+  void write_value(unsigned value) { write_number(value); }
+  void write_value(unsigned long value) { write_number(value); }
+  void write_value(unsigned long long value) { write_number(value); }
+
   /** Bad value flag (nans) */
   bool f_bad_value = false;
 public:
@@ -262,6 +304,9 @@ public:
   /** The archive output operator */
   template<class T>
   oarchive& operator&(const std::pair<T&, std::string>&);
+  /** The archive output operator for values with run-time type names */
+  template<class T>
+  oarchive& operator&(const std::pair<typed_value<T>&, std::string>&);
 
   template<class Archive, class T, bool HasSerializer, bool IsIterable>
   friend struct detail::wrapper;
@@ -269,20 +314,19 @@ public:
   template<class T>
   void serialize(const T&);
 
-  /** Return true if a nan was found while writting */
+  /** Return true if a nan (or a value which could not be encoded) was found
+   * while writting */
   bool bad_value() const { return f_bad_value; }
 };
 
-/** For non-string types: put into stream using stringstream directly */
+/** For non-string types: write directly to the stream */
 template<class T>
 void oarchive::add_element(const T& value)
 {
   // detect nans
   if(value!=value) f_bad_value = true;
   // write
-  std::stringstream ss;
-  ss << value;
-  stream << ss.str();
+  write_value(value);
 }
 /** Template specialization for const char*: add enclsoing braces */
 template<>
@@ -400,4 +444,18 @@ oarchive& oarchive::operator&(const std::pair<T&, std::string>& t)
   return *this;
 }
 
+template<class T>
+oarchive& oarchive::operator&(const std::pair<typed_value<T>&, std::string>& t)
+{
+  if(t.first.bad) f_bad_value = true;
+  add_key(t.second);
+  open_group();
+  add_key("type");
+  add_element(t.first.type);
+  add_key("value");
+  serialize(t.first.value);
+  close_group();
+  return *this;
+}
+
 #endif//SERIALIZATION_HPP_
@@ -0,0 +1,311 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// this file is also compiled in the consumer library: no dependency on the
+// model or on cuda
+#include <cstring>
+#include <exception>
+#include <new>
+#include <sstream>
+#include <string>
+#include "error_msg.hpp"
+#include "shm.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+/** Magic string at the beginning of the segment */
+static const char shm_magic[8] = { 'C', 'E', 'L', 'A', 'D', 'R', 'S', 'H' };
+/** Version of the layout */
+static const uint32_t shm_version = 1;
+/** Alignment of the sections */
+static const size_t shm_align = 64;
+
+static size_t align(size_t n)
+{
+  return (n + shm_align - 1)/shm_align*shm_align;
+}
+
+string shm_segment_name(const string& name)
+{
+  return name.empty() or name[0]!='/' ? "/" + name : name;
+}
+
+// =============================================================================
+// Layout
+
+shm_layout::shm_layout(const shm_header& h)
+{
+  const size_t N = size_t(h.Size[0])*h.Size[1]*h.Size[2];
+  const size_t patch_N = size_t(h.patch_size[0])*h.patch_size[1]*h.patch_size[2];
+
+  size_t pos = align(sizeof(shm_slot_header));
+  ids       = pos; pos = align(pos + h.max_cells*sizeof(uint32_t));
+  patch_min = pos; pos = align(pos + 3*h.max_cells*sizeof(uint32_t));
+  offset    = pos; pos = align(pos + 3*h.max_cells*sizeof(uint32_t));
+  columns   = pos; pos = align(pos + size_t(h.ncolumns)*h.max_cells*sizeof(double));
+  fields    = pos; pos = align(pos + h.nfields*N*sizeof(double));
+  patches   = pos; if(h.patches) pos = align(pos + h.max_cells*patch_N*sizeof(double));
+  size      = pos;
+}
+
+size_t shm_layout::first_slot()
+{
+  return align(sizeof(shm_header));
+}
+
+const double* shm_frame::column(unsigned c) const
+{
+  return reinterpret_cast<const double*>(data + layout->columns)
+         + size_t(c)*header->max_cells;
+}
+
+const double* shm_frame::field(unsigned f) const
+{
+  const size_t N = size_t(header->Size[0])*header->Size[1]*header->Size[2];
+  return reinterpret_cast<const double*>(data + layout->fields) + f*N;
+}
+
+const double* shm_frame::patch(unsigned n) const
+{
+  if(!header->patches) return nullptr;
+  const size_t patch_N = size_t(header->patch_size[0])*header->patch_size[1]
+                        *header->patch_size[2];
+  return reinterpret_cast<const double*>(data + layout->patches) + n*patch_N;
+}
+
+// =============================================================================
+// Publisher
+
+shm_publisher::shm_publisher(const string& name_, unsigned nslots,
+                             const unsigned Size[3], const unsigned patch_size[3],
+                             unsigned max_cells, const vector<string>& columns,
+                             const vector<string>& fields, bool patches)
+  : name(shm_segment_name(name_))
+{
+  if(nslots<2) throw error_msg("shared memory needs at least two slots.");
+  if(columns.size()>shm_max_names or fields.size()>shm_max_names)
+    throw error_msg("too many published quantities.");
+
+  // describe the layout, first on the stack as the size is not known yet
+  const auto describe = [&](shm_header& h) {
+    h.version   = shm_version;
+    h.nslots    = nslots;
+    h.max_cells = max_cells;
+    h.ncolumns  = columns.size();
+    h.nfields   = fields.size();
+    h.patches   = patches;
+    for(unsigned d=0; d<3; ++d)
+    {
+      h.Size[d] = Size[d];
+      h.patch_size[d] = patch_size[d];
+    }
+    for(unsigned i=0; i<columns.size(); ++i)
+      strncpy(h.columns[i], columns[i].c_str(), shm_name_length-1);
+    for(unsigned i=0; i<fields.size(); ++i)
+      strncpy(h.fields[i], fields[i].c_str(), shm_name_length-1);
+  };
+
+  shm_header h = {};
+  describe(h);
+  layout.reset(new shm_layout(h));
+  h.slot_size = layout->size;
+  size = shm_layout::first_slot() + nslots*layout->size;
+
+  // create a new segment, readers of a previous run keep their mapping
+  shm_unlink(name.c_str());
+  fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if(fd<0) throw error_msg("can not create shared memory segment ", name, ".");
+  if(ftruncate(fd, size))
+  {
+    close(fd);
+    shm_unlink(name.c_str());
+    throw error_msg("can not allocate ", size, " bytes of shared memory.");
+  }
+  void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(ptr==MAP_FAILED)
+  {
+    close(fd);
+    shm_unlink(name.c_str());
+    throw error_msg("can not map shared memory segment ", name, ".");
+  }
+  base = static_cast<char*>(ptr);
+
+  // the segment is zero-initialized: all sequence numbers are 0 (empty)
+  header = new (base) shm_header();
+  describe(*header);
+  header->slot_size = layout->size;
+  for(unsigned s=0; s<nslots; ++s)
+    new (base + shm_layout::first_slot() + s*layout->size) shm_slot_header();
+
+  // ready
+  atomic_thread_fence(memory_order_release);
+  memcpy(header->magic, shm_magic, sizeof(shm_magic));
+}
+
+shm_publisher::~shm_publisher()
+{
+  header->closed.store(1, memory_order_release);
+  munmap(base, size);
+  close(fd);
+  shm_unlink(name.c_str());
+}
+
+shm_publisher::frame shm_publisher::begin(unsigned time, unsigned ncells)
+{
+  if(ncells>header->max_cells)
+    throw error_msg("too many cells for the shared memory segment (max ",
+                    header->max_cells, ").");
+
+  ++count;
+  char* data = base + shm_layout::first_slot()
+             + (count%header->nslots)*layout->size;
+  auto& slot = *reinterpret_cast<shm_slot_header*>(data);
+
+  // lock the slot
+  slot.seq.store(2*count-1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  slot.time = time;
+  slot.ncells = ncells;
+
+  frame f;
+  f.ids       = reinterpret_cast<uint32_t*>(data + layout->ids);
+  f.patch_min = reinterpret_cast<uint32_t*>(data + layout->patch_min);
+  f.offset    = reinterpret_cast<uint32_t*>(data + layout->offset);
+  f.columns   = reinterpret_cast<double*>(data + layout->columns);
+  f.fields    = reinterpret_cast<double*>(data + layout->fields);
+  f.patches   = header->patches ? reinterpret_cast<double*>(data + layout->patches)
+                                : nullptr;
+  f.max_cells = header->max_cells;
+  return f;
+}
+
+void shm_publisher::commit()
+{
+  char* data = base + shm_layout::first_slot()
+             + (count%header->nslots)*layout->size;
+  auto& slot = *reinterpret_cast<shm_slot_header*>(data);
+
+  slot.seq.store(2*count, memory_order_release);
+  header->head.store(count, memory_order_release);
+}
+
+// =============================================================================
+// Consumer
+
+shm_consumer::shm_consumer(const string& name_)
+{
+  const string name = shm_segment_name(name_);
+
+  fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if(fd<0) throw error_msg("can not open shared memory segment ", name, ".");
+
+  struct stat st;
+  if(fstat(fd, &st) or size_t(st.st_size)<sizeof(shm_header))
+  {
+    close(fd);
+    throw error_msg("shared memory segment ", name, " is not ready.");
+  }
+  size = st.st_size;
+
+  void* ptr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  if(ptr==MAP_FAILED)
+  {
+    close(fd);
+    throw error_msg("can not map shared memory segment ", name, ".");
+  }
+  base = static_cast<const char*>(ptr);
+  header_ = reinterpret_cast<const shm_header*>(base);
+
+  const bool ready = !memcmp(header_->magic, shm_magic, sizeof(shm_magic));
+  atomic_thread_fence(memory_order_acquire);
+  if(!ready or header_->version!=shm_version)
+  {
+    munmap(const_cast<char*>(base), size);
+    close(fd);
+    throw error_msg("shared memory segment ", name,
+                    ready ? " has an unsupported version." : " is not ready.");
+  }
+
+  layout.reset(new shm_layout(*header_));
+}
+
+shm_consumer::~shm_consumer()
+{
+  munmap(const_cast<char*>(base), size);
+  close(fd);
+}
+
+const shm_slot_header& shm_consumer::slot(uint64_t k) const
+{
+  return *reinterpret_cast<const shm_slot_header*>(
+    base + shm_layout::first_slot() + (k%header_->nslots)*layout->size);
+}
+
+unsigned shm_consumer::column(const string& name) const
+{
+  for(unsigned i=0; i<header_->ncolumns; ++i)
+    if(name==header_->columns[i]) return i;
+  throw error_msg("unknown cell scalar ", name, ".");
+}
+
+unsigned shm_consumer::field(const string& name) const
+{
+  for(unsigned i=0; i<header_->nfields; ++i)
+    if(name==header_->fields[i]) return i;
+  throw error_msg("unknown field ", name, ".");
+}
+
+uint64_t shm_consumer::latest() const
+{
+  return header_->head.load(memory_order_acquire);
+}
+
+bool shm_consumer::closed() const
+{
+  return header_->closed.load(memory_order_acquire);
+}
+
+bool shm_consumer::acquire(uint64_t k, shm_frame& f) const
+{
+  if(k==0) return false;
+
+  const auto& s = slot(k);
+  if(s.seq.load(memory_order_acquire)!=2*k) return false;
+
+  const char* data = reinterpret_cast<const char*>(&s);
+  f.seq       = k;
+  f.time      = s.time;
+  f.ncells    = s.ncells;
+  f.ids       = reinterpret_cast<const uint32_t*>(data + layout->ids);
+  f.patch_min = reinterpret_cast<const uint32_t*>(data + layout->patch_min);
+  f.offset    = reinterpret_cast<const uint32_t*>(data + layout->offset);
+  f.data      = data;
+  f.layout    = layout.get();
+  f.header    = header_;
+
+  // the header of the slot may have been changed in between
+  return still_valid(f);
+}
+
+bool shm_consumer::still_valid(const shm_frame& f) const
+{
+  atomic_thread_fence(memory_order_acquire);
+  return slot(f.seq).seq.load(memory_order_relaxed)==2*f.seq;
+}
@@ -0,0 +1,220 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHM_HPP_
+#define SHM_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/** Live frames published in a POSIX shared memory ring buffer
+  *
+  * The segment starts with a header describing the layout and is followed by
+  * a fixed number of slots, each holding a complete frame. Frames are numbered
+  * from 1 and frame k is written to slot k%nslots, such that the last nslots-1
+  * frames can be read while the next one is being written.
+  *
+  * Every slot is protected by a sequence lock: its sequence number is odd while
+  * the slot is written and equal to 2k once frame k is complete. A reader
+  * thus checks the sequence number before and after accessing the data, and
+  * discards the frame if it has changed. Readers never write to the segment.
+  *
+  * Slot layout (native endianness, every section aligned to 64 bytes):
+  *
+  *   slot header | ids (u32) | patch_min (3 x u32) | offset (3 x u32)
+  *   | cell scalars (double, one column of max_cells values per name)
+  *   | global fields (double, N values per field)
+  *   | patches (double, patch_N values per cell, optional)
+  * */
+
+/** Maximum number and length of the names stored in the header */
+constexpr unsigned shm_max_names = 32;
+constexpr unsigned shm_name_length = 24;
+
+/** Header of the segment */
+struct shm_header
+{
+  /** Magic string, written last when the segment is ready */
+  char magic[8];
+  uint32_t version;
+  /** Number of slots and size of a slot in bytes */
+  uint32_t nslots;
+  uint64_t slot_size;
+  /** Size of the domain and of the patches */
+  uint32_t Size[3], patch_size[3];
+  /** Maximum number of cells in a frame */
+  uint32_t max_cells;
+  /** Number of cell scalars and of global fields */
+  uint32_t ncolumns, nfields;
+  /** Are the patches published? */
+  uint32_t patches;
+  /** Names of the cell scalars and of the global fields */
+  char columns[shm_max_names][shm_name_length];
+  char fields[shm_max_names][shm_name_length];
+  /** Number of the last complete frame (0 if none) */
+  std::atomic<uint64_t> head;
+  /** Set when the simulation has ended */
+  std::atomic<uint32_t> closed;
+};
+
+/** Header of a slot */
+struct shm_slot_header
+{
+  /** Sequence lock (2k when frame k is complete, odd while writing) */
+  std::atomic<uint64_t> seq;
+  /** Time of the frame and number of cells */
+  uint32_t time, ncells;
+};
+
+/** Offsets of the sections of a slot, computed from the header */
+struct shm_layout
+{
+  std::size_t ids, patch_min, offset, columns, fields, patches, size;
+
+  explicit shm_layout(const shm_header& h);
+  /** Offset of the first slot from the beginning of the segment */
+  static std::size_t first_slot();
+};
+
+/** View of a frame in shared memory (no copy) */
+struct shm_frame
+{
+  /** Number of the frame */
+  uint64_t seq = 0;
+  /** Time of the frame and number of cells */
+  unsigned time = 0, ncells = 0;
+  /** Persistent ids of the cells */
+  const uint32_t* ids = nullptr;
+  /** Patch position and memory offset of each cell (3 values per cell) */
+  const uint32_t* patch_min = nullptr;
+  const uint32_t* offset = nullptr;
+
+  /** Slot data */
+  const char* data = nullptr;
+  const shm_layout* layout = nullptr;
+  const shm_header* header = nullptr;
+
+  /** Values of cell scalar c (ncells values) */
+  const double* column(unsigned c) const;
+  /** Values of global field f (N values, same layout as the domain) */
+  const double* field(unsigned f) const;
+  /** Phase field of cell n (patch_N values), nullptr if not published */
+  const double* patch(unsigned n) const;
+};
+
+/** Publisher of live frames (used by the simulation) */
+class shm_publisher
+{
+  std::string name;
+  int fd = -1;
+  char* base = nullptr;
+  std::size_t size = 0;
+  shm_header* header = nullptr;
+  std::unique_ptr<shm_layout> layout;
+  /** Number of the frame being written */
+  uint64_t count = 0;
+
+public:
+  /** Writable view of the frame being written */
+  struct frame
+  {
+    uint32_t *ids, *patch_min, *offset;
+    /** Column c of cell i is at columns[c*max_cells+i] */
+    double* columns;
+    /** Field f of node k is at fields[f*N+k] */
+    double* fields;
+    /** Node q of cell n is at patches[n*patch_N+q] (nullptr if disabled) */
+    double* patches;
+    unsigned max_cells;
+  };
+
+  /** Create the segment (an existing segment with the same name is removed)
+   *
+   * Arguments are the name of the segment, the number of slots, the size of
+   * the domain and of the patches, the maximum number of cells, the names of
+   * the cell scalars and of the global fields, and if the patches are
+   * published.
+   * */
+  shm_publisher(const std::string& name, unsigned nslots,
+                const unsigned Size[3], const unsigned patch_size[3],
+                unsigned max_cells, const std::vector<std::string>& columns,
+                const std::vector<std::string>& fields, bool patches);
+  /** Mark as closed and remove the name (mapped segments stay valid) */
+  ~shm_publisher();
+
+  shm_publisher(const shm_publisher&) = delete;
+  shm_publisher& operator=(const shm_publisher&) = delete;
+
+  /** Start writing a new frame */
+  frame begin(unsigned time, unsigned ncells);
+  /** Publish the frame */
+  void commit();
+  /** Number of frames written so far */
+  uint64_t frames() const
+  { return count; }
+};
+
+/** Read-only access to live frames (consumer library) */
+class shm_consumer
+{
+  int fd = -1;
+  const char* base = nullptr;
+  std::size_t size = 0;
+  const shm_header* header_ = nullptr;
+  std::unique_ptr<shm_layout> layout;
+
+  const shm_slot_header& slot(uint64_t k) const;
+
+public:
+  /** Map an existing segment, throws if it does not exist or is not ready */
+  explicit shm_consumer(const std::string& name);
+  ~shm_consumer();
+
+  shm_consumer(const shm_consumer&) = delete;
+  shm_consumer& operator=(const shm_consumer&) = delete;
+
+  /** Description of the layout */
+  const shm_header& header() const
+  { return *header_; }
+
+  /** Index of a cell scalar or a global field from its name */
+  unsigned column(const std::string& name) const;
+  unsigned field(const std::string& name) const;
+
+  /** Number of the last complete frame (0 if none) */
+  uint64_t latest() const;
+  /** Has the simulation ended? */
+  bool closed() const;
+
+  /** Get a view of frame k
+   *
+   * Returns false if the frame is not available (not yet written or already
+   * overwritten). The view points directly to shared memory and the data
+   * must be validated with still_valid() after use.
+   * */
+  bool acquire(uint64_t k, shm_frame& frame) const;
+  /** Check that a frame has not been overwritten while being read */
+  bool still_valid(const shm_frame& frame) const;
+};
+
+/** Normalized name of a shared memory segment (starts with a slash) */
+std::string shm_segment_name(const std::string& name);
+
+#endif//SHM_HPP_
@@ -0,0 +1,112 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STRESS_HPP_
+#define STRESS_HPP_
+
+#include <cmath>
+#include "vec_cuda.h"
+#include "cuda.h"   // Must come before using CUDA_host_device
+
+/** Update a component of the stress as *s = (*s + c)/factor
+ *
+ * The update is atomic on the device. Every cell overlapping a node performs
+ * it once with the same contribution c, such that the result does not depend
+ * on the order of the cells.
+ * */
+CUDA_host_device
+inline void accumulate_stress(double *s, double c, double factor)
+{
+#ifdef __CUDA_ARCH__
+  auto addr = reinterpret_cast<unsigned long long*>(s);
+  unsigned long long old = *addr, assumed;
+  do
+  {
+    assumed = old;
+    const double value = (__longlong_as_double(assumed) + c)/factor;
+    old = atomicCAS(addr, assumed, static_cast<unsigned long long>(__double_as_longlong(value)));
+  }
+  while(assumed!=old);
+#else
+  *s = (*s + c)/factor;
+#endif
+}
+
+/** Add the stress at node k integrated from the velocity field
+ *
+ * The velocity field is integrated over the 2x2x2 nodes starting at node k,
+ * weighted by the unit vectors from the centre of the corresponding voxel. The
+ * nodes beyond the last plane of the domain are wrapped periodically, such
+ * that only the N nodes of the fields are read. The contributions are summed
+ * first and added with accumulate_stress().
+ * Used by the potential update on the device, and by the micro-benchmarks.
+ * */
+CUDA_host_device
+inline void integrate_stress(unsigned k,
+                             const vec<unsigned, 3>& Size,
+                             double xi,
+                             const double *field_velx,
+                             const double *field_vely,
+                             const double *field_velz,
+                             double *field_sxx,
+                             double *field_sxy,
+                             double *field_sxz,
+                             double *field_syy,
+                             double *field_syz,
+                             double *field_szz)
+{
+  const double factor = 8;
+  const unsigned x = (k/Size[1])%Size[0];
+  const unsigned y = k%Size[1];
+  const unsigned z = k/(Size[0]*Size[1]);
+
+  double sxx = 0, sxy = 0, sxz = 0, syy = 0, syz = 0, szz = 0;
+  for(unsigned dz=0; dz<2; ++dz)
+    for(unsigned dy=0; dy<2; ++dy)
+      for(unsigned dx=0; dx<2; ++dx)
+      {
+        // unit vector from the centre of the voxel to the node
+        const double diff_x = 0.5 - dx;
+        const double diff_y = 0.5 - dy;
+        const double diff_z = 0.5 - dz;
+        const double norm = sqrt(diff_x*diff_x+diff_y*diff_y+diff_z*diff_z);
+        const double ux = diff_x/norm;
+        const double uy = diff_y/norm;
+        const double uz = diff_z/norm;
+        const unsigned ix = (x+dx)%Size[0];
+        const unsigned iy = (y+dy)%Size[1];
+        const unsigned iz = (z+dz)%Size[2];
+        const unsigned idx = iy + Size[1]*ix + Size[0]*Size[1]*iz;
+        sxx += ux*xi*field_velx[idx];
+        sxy += ux*xi*field_vely[idx];
+        sxy += uy*xi*field_velx[idx];
+        sxz += ux*xi*field_velz[idx];
+        sxz += uz*xi*field_velx[idx];
+        syy += uy*xi*field_vely[idx];
+        syz += uy*xi*field_velz[idx];
+        syz += uz*xi*field_vely[idx];
+        szz += uz*xi*field_velz[idx];
+      }
+
+  accumulate_stress(&field_sxx[k], sxx, factor);
+  accumulate_stress(&field_sxy[k], sxy, 2.*factor);
+  accumulate_stress(&field_sxz[k], sxz, 2.*factor);
+  accumulate_stress(&field_syy[k], syy, factor);
+  accumulate_stress(&field_syz[k], syz, 2.*factor);
+  accumulate_stress(&field_szz[k], szz, factor);
+}
+
+#endif//STRESS_HPP_
@@ -0,0 +1,80 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "header.hpp"
+#include "timer.hpp"
+
+using namespace std;
+
+const char* stage_name(stage s)
+{
+  static const char* names[nstages] = {
+    "other", "setup", "relax", "sums", "potential", "fields", "polvel",
+    "phase_field", "cells", "proliferation", "division", "transfer",
+    "analysis", "write"
+  };
+  return names[static_cast<unsigned>(s)];
+}
+
+void stage_timers::print(ostream& stream) const
+{
+  double sum = 0;
+  for(const auto t : total) sum += t;
+  if(sum==0) return;
+
+  for(unsigned i=0; i<nstages; ++i)
+  {
+    if(calls[i]==0 and total[i]==0) continue;
+    stream << "  " << setw(16) << left << stage_name(static_cast<stage>(i))
+           << setw(10) << right << fixed << setprecision(3) << total[i] << " s"
+           << setw(7) << setprecision(1) << 100*total[i]/sum << " %"
+           << setw(12) << calls[i] << " calls" << '\n';
+  }
+  stream << defaultfloat << setprecision(6);
+}
+
+void stage_timers::write_json(const string& fname) const
+{
+  ofstream file(fname);
+  if(!file.good()) throw error_msg("can not open file ", fname, ".");
+  file << setprecision(9);
+
+  const auto write_times = [&](const stage_times& times) {
+    file << "{ ";
+    for(unsigned i=0; i<nstages; ++i)
+      file << (i ? ", " : "") << '"' << stage_name(static_cast<stage>(i))
+           << "\": " << times[i];
+    file << " }";
+  };
+
+  file << "{\n  \"total\": ";
+  write_times(total);
+  file << ",\n  \"calls\": { ";
+  for(unsigned i=0; i<nstages; ++i)
+    file << (i ? ", " : "") << '"' << stage_name(static_cast<stage>(i))
+         << "\": " << calls[i];
+  file << " },\n  \"streaks\": [";
+  for(unsigned k=0; k<streaks.size(); ++k)
+  {
+    file << (k ? ",\n" : "\n") << "    { \"time\": " << streaks[k].first
+         << ", \"stages\": ";
+    write_times(streaks[k].second);
+    file << " }";
+  }
+  file << "\n  ]\n}\n";
+
+  if(!file) throw error_msg("error while writing file ", fname, ".");
+}
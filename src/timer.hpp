@@ -0,0 +1,179 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TIMER_HPP_
+#define TIMER_HPP_
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "trace.hpp"
+
+/** Wall-clock time spent in each stage of the computation
+  *
+  * Timers are exclusive: entering a stage pauses the enclosing one, such that
+  * the times add up to the total time and transfers done during a division are
+  * not counted twice. Every kernel of Update() is followed by a device
+  * synchronization, hence the time of a stage includes the device work.
+  *
+  * Times are accumulated over the whole run and over the current streak of
+  * ninfo steps, which is archived at the end of every streak.
+  *
+  * When the trace is enabled, stages are also recorded as nested spans (from
+  * entering a stage to leaving it), see trace.hpp.
+  * */
+
+/** Stages of the computation */
+enum class stage : unsigned
+{
+  other,
+  setup,
+  relax,
+  sums,
+  potential,
+  fields,
+  polvel,
+  phase_field,
+  cells,
+  proliferation,
+  division,
+  transfer,
+  analysis,
+  write,
+  count
+};
+
+/** Number of stages */
+constexpr unsigned nstages = static_cast<unsigned>(stage::count);
+
+/** Name of a stage (as in the exported file) */
+const char* stage_name(stage s);
+
+/** Times of all stages (in seconds) */
+using stage_times = std::array<double, nstages>;
+
+/** Accumulate the time spent in each stage */
+class stage_timers
+{
+  using clock = std::chrono::steady_clock;
+
+  /** Stage being timed and time at which it was (re)started */
+  stage current = stage::other;
+  clock::time_point start = clock::now();
+
+  /** Charge the time elapsed since the last switch to the current stage */
+  void charge(clock::time_point now)
+  {
+    const double dt = std::chrono::duration<double>(now - start).count();
+    const auto i = static_cast<unsigned>(current);
+    total[i] += dt;
+    streak[i] += dt;
+    start = now;
+  }
+
+  /** Stages entered and not left yet, with the time they were entered */
+  std::vector<std::pair<stage, clock::time_point>> open;
+
+  /** Record the innermost open stage as a span ending now */
+  void trace_span(clock::time_point now) const
+  {
+    if(trace::enabled() and !open.empty())
+      trace::record(stage_name(open.back().first), "stage",
+                    open.back().second, now);
+  }
+
+public:
+  /** Accumulated times over the run and over the current streak */
+  stage_times total {}, streak {};
+  /** Number of times each stage has been entered */
+  std::array<uint64_t, nstages> calls {};
+  /** Archived streaks: time at the end of the streak and stage times */
+  std::vector<std::pair<unsigned, stage_times>> streaks;
+  /** If set, everything is charged to the current stage (nested stages are
+   * ignored) */
+  bool paused = false;
+
+  /** Switch to stage s, returns the stage to go back to */
+  stage enter(stage s)
+  {
+    if(paused) return current;
+    const auto now = clock::now();
+    charge(now);
+    ++calls[static_cast<unsigned>(s)];
+    open.emplace_back(s, now);
+    const stage previous = current;
+    current = s;
+    return previous;
+  }
+
+  /** Switch to stage s, within the same scope */
+  void next(stage s)
+  {
+    if(paused) return;
+    const auto now = clock::now();
+    charge(now);
+    ++calls[static_cast<unsigned>(s)];
+    trace_span(now);
+    if(!open.empty()) open.back() = { s, now };
+    current = s;
+  }
+
+  /** Go back to a previous stage */
+  void leave(stage previous)
+  {
+    if(paused) return;
+    const auto now = clock::now();
+    charge(now);
+    trace_span(now);
+    if(!open.empty()) open.pop_back();
+    current = previous;
+  }
+
+  /** Archive the current streak, ending at time t */
+  void end_streak(unsigned t)
+  {
+    charge(clock::now());
+    streaks.emplace_back(t, streak);
+    streak.fill(0.);
+  }
+
+  /** Print a summary (time and fraction of each stage) */
+  void print(std::ostream& stream) const;
+  /** Write totals and streaks to a json file */
+  void write_json(const std::string& fname) const;
+};
+
+/** Time the enclosing scope as stage s */
+class scoped_timer
+{
+  stage_timers& timers;
+  stage previous;
+
+public:
+  scoped_timer(stage_timers& timers, stage s)
+    : timers(timers), previous(timers.enter(s))
+  {}
+  ~scoped_timer()
+  { timers.leave(previous); }
+
+  scoped_timer(const scoped_timer&) = delete;
+  scoped_timer& operator=(const scoped_timer&) = delete;
+};
+
+#endif//TIMER_HPP_
@@ -0,0 +1,283 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "header.hpp"
+#include "timeseries.hpp"
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+using namespace std;
+
+/** Magic string at the beginning of the file */
+static const char ts_magic[8] = { 'C', 'E', 'L', 'A', 'D', 'R', 'T', 'S' };
+/** Version of the file format */
+static const uint32_t ts_version = 1;
+
+/** Write POD value to stream */
+template<class T>
+static void write_pod(ostream& stream, const T& value)
+{
+  stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+/** Read POD value from stream */
+template<class T>
+static T read_pod(istream& stream)
+{
+  T value;
+  stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+  if(!stream) throw error_msg("unexpected end of time-series file.");
+  return value;
+}
+
+// =============================================================================
+// XOR codec
+
+void ts_encode_xor(const vector<double>& values, vector<char>& buf)
+{
+  uint64_t prev = 0;
+  for(const auto v : values)
+  {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    uint64_t x = bits^prev;
+    prev = bits;
+
+    // count zero bytes on both sides
+    unsigned lead = 0, trail = 0;
+    while(lead<8 and ((x>>(56-8*lead))&0xff)==0) ++lead;
+    if(lead<8) while(((x>>(8*trail))&0xff)==0) ++trail;
+
+    buf.push_back(static_cast<char>((lead<<4)|trail));
+    for(unsigned i=trail; i<8-lead; ++i)
+      buf.push_back(static_cast<char>((x>>(8*i))&0xff));
+  }
+}
+
+size_t ts_decode_xor(const char* buf, size_t n, vector<double>& values)
+{
+  size_t pos = 0;
+  uint64_t prev = 0;
+  for(size_t k=0; k<n; ++k)
+  {
+    const unsigned char ctrl = buf[pos++];
+    const unsigned lead = ctrl>>4, trail = ctrl&0x0f;
+
+    uint64_t x = 0;
+    for(unsigned i=trail; i<8-lead; ++i)
+      x |= uint64_t(static_cast<unsigned char>(buf[pos++]))<<(8*i);
+
+    prev ^= x;
+    double v;
+    memcpy(&v, &prev, sizeof(v));
+    values.push_back(v);
+  }
+  return pos;
+}
+
+// =============================================================================
+// Writer
+
+tswriter::tswriter(const string& fname, const vector<string>& names,
+                   unsigned chunk_)
+  : stream(fname, ios::out | ios::binary),
+    ncols(names.size()),
+    chunk(max(chunk_, 1u))
+{
+  if(!stream.good())
+    throw error_msg("can not open time-series file ", fname, ".");
+
+  stream.write(ts_magic, sizeof(ts_magic));
+  write_pod(stream, ts_version);
+  write_pod(stream, uint32_t(ncols));
+  for(const auto& name : names)
+  {
+    write_pod(stream, uint8_t(name.size()));
+    stream.write(name.data(), name.size());
+  }
+}
+
+tswriter::~tswriter()
+{
+  flush();
+}
+
+void tswriter::new_frame(unsigned t)
+{
+  if(times.size()==chunk) flush();
+  times.push_back(t);
+}
+
+void tswriter::add(unsigned id, const double* values)
+{
+  const unsigned frame = times.size()-1;
+
+  auto it = buffer.find(id);
+  if(it==buffer.end())
+  {
+    it = buffer.emplace(id, series { frame, {} }).first;
+    it->second.columns.resize(ncols);
+  }
+
+  auto& s = it->second;
+  for(unsigned c=0; c<ncols; ++c)
+  {
+    // fill gaps (should not happen as cells are alive on a contiguous range)
+    s.columns[c].resize(frame-s.first, numeric_limits<double>::quiet_NaN());
+    s.columns[c].push_back(values[c]);
+  }
+}
+
+void tswriter::flush()
+{
+  if(times.empty()) return;
+
+  // encode all cells
+  vector<char> data;
+  vector<tuple<uint32_t, uint32_t, uint32_t, uint64_t, uint32_t>> index;
+  for(const auto& kv : buffer)
+  {
+    const uint64_t start = data.size();
+    for(const auto& c : kv.second.columns)
+      ts_encode_xor(c, data);
+
+    index.emplace_back(kv.first, kv.second.first,
+                       kv.second.columns[0].size(), start, data.size()-start);
+  }
+
+  // write chunk
+  write_pod(stream, uint32_t(times.size()));
+  write_pod(stream, uint32_t(index.size()));
+  write_pod(stream, uint64_t(data.size()));
+  stream.write(reinterpret_cast<const char*>(times.data()),
+               times.size()*sizeof(uint32_t));
+  for(const auto& i : index)
+  {
+    write_pod(stream, get<0>(i));
+    write_pod(stream, get<1>(i));
+    write_pod(stream, get<2>(i));
+    write_pod(stream, get<3>(i));
+    write_pod(stream, get<4>(i));
+  }
+  stream.write(data.data(), data.size());
+  stream.flush();
+
+  times.clear();
+  buffer.clear();
+}
+
+// =============================================================================
+// Reader
+
+tsreader::tsreader(const string& fname)
+  : stream(fname, ios::in | ios::binary)
+{
+  if(!stream.good())
+    throw error_msg("can not open time-series file ", fname, ".");
+
+  char magic[sizeof(ts_magic)];
+  stream.read(magic, sizeof(magic));
+  if(!stream or memcmp(magic, ts_magic, sizeof(magic)))
+    throw error_msg("file ", fname, " is not a time-series file.");
+  if(read_pod<uint32_t>(stream)!=ts_version)
+    throw error_msg("unsupported time-series file version.");
+
+  const auto ncols = read_pod<uint32_t>(stream);
+  for(unsigned c=0; c<ncols; ++c)
+  {
+    string name(read_pod<uint8_t>(stream), ' ');
+    stream.read(&name[0], name.size());
+    names.push_back(name);
+  }
+
+  // scan chunks, skipping the data sections
+  while(stream.peek()!=char_traits<char>::eof())
+  {
+    chunk_index ci;
+    const auto nframes = read_pod<uint32_t>(stream);
+    const auto ncells  = read_pod<uint32_t>(stream);
+    const auto size    = read_pod<uint64_t>(stream);
+
+    ci.times.resize(nframes);
+    stream.read(reinterpret_cast<char*>(ci.times.data()),
+                nframes*sizeof(uint32_t));
+
+    for(unsigned i=0; i<ncells; ++i)
+    {
+      const auto id = read_pod<uint32_t>(stream);
+      block b;
+      b.first  = read_pod<uint32_t>(stream);
+      b.count  = read_pod<uint32_t>(stream);
+      b.offset = read_pod<uint64_t>(stream);
+      b.size   = read_pod<uint32_t>(stream);
+      ci.cells[id] = b;
+    }
+
+    ci.data = stream.tellg();
+    stream.seekg(size, ios::cur);
+    chunks.push_back(move(ci));
+  }
+  stream.clear();
+}
+
+unsigned tsreader::column(const string& name) const
+{
+  const auto it = find(names.begin(), names.end(), name);
+  if(it==names.end()) throw error_msg("unknown time-series column ", name, ".");
+  return it-names.begin();
+}
+
+vector<unsigned> tsreader::cells() const
+{
+  vector<unsigned> ids;
+  for(const auto& ci : chunks)
+    for(const auto& kv : ci.cells)
+      ids.push_back(kv.first);
+
+  sort(ids.begin(), ids.end());
+  ids.erase(unique(ids.begin(), ids.end()), ids.end());
+  return ids;
+}
+
+tsreader::trajectory tsreader::read_cell(unsigned id) const
+{
+  trajectory traj;
+  traj.columns.resize(names.size());
+
+  vector<char> buf;
+  for(const auto& ci : chunks)
+  {
+    const auto it = ci.cells.find(id);
+    if(it==ci.cells.end()) continue;
+    const auto& b = it->second;
+
+    // read only the block of this cell
+    buf.resize(b.size);
+    stream.seekg(ci.data+b.offset);
+    stream.read(buf.data(), b.size);
+    if(!stream) throw error_msg("unexpected end of time-series file.");
+
+    size_t pos = 0;
+    for(auto& c : traj.columns)
+      pos += ts_decode_xor(buf.data()+pos, b.count, c);
+
+    for(unsigned f=b.first; f<b.first+b.count; ++f)
+      traj.time.push_back(ci.times[f]);
+  }
+
+  return traj;
+}
@@ -0,0 +1,156 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TIMESERIES_HPP_
+#define TIMESERIES_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+
+/** Columnar per-cell time-series store
+  *
+  * The file starts with a header listing the column names and is followed by
+  * a sequence of chunks, each holding a fixed number of frames. Within a chunk
+  * the data is grouped by cell (keyed by its persistent id) and then by
+  * column, such that the trajectory of a single cell can be read by seeking
+  * directly to its block. Every column is XOR-compressed against the previous
+  * value of the same cell (see ts_encode_xor()).
+  *
+  * Layout (native endianness):
+  *
+  *   header : "CELADRTS" | u32 version | u32 ncols | ncols x (u8 len, name)
+  *   chunk  : u32 nframes | u32 ncells | u64 data size | nframes x u32 time
+  *            | ncells x (u32 id, u32 first frame, u32 count, u64 offset,
+  *                        u32 size) | data
+  * */
+
+/** XOR-encode a series of doubles and append the result to a byte buffer
+  *
+  * Each value is XORed with the previous one and stored as a control byte
+  * (number of leading and trailing zero bytes) followed by the remaining
+  * significant bytes. Slowly varying quantities thus need only a few bytes.
+  * */
+void ts_encode_xor(const std::vector<double>& values, std::vector<char>& buf);
+
+/** Decode n values encoded with ts_encode_xor(), returns the bytes read */
+size_t ts_decode_xor(const char* buf, size_t n, std::vector<double>& values);
+
+/** Writer for the columnar time-series store */
+class tswriter
+{
+  /** Per-cell buffer within the current chunk */
+  struct series
+  {
+    /** First frame (within the chunk) where the cell appears */
+    unsigned first;
+    /** Values, one vector per column */
+    std::vector<std::vector<double>> columns;
+  };
+
+  /** The output file */
+  std::ofstream stream;
+  /** Number of columns */
+  unsigned ncols;
+  /** Number of frames per chunk */
+  unsigned chunk;
+  /** Times of the frames in the current chunk */
+  std::vector<uint32_t> times;
+  /** Buffered data of the current chunk, ordered by cell id */
+  std::map<unsigned, series> buffer;
+
+public:
+  /** Contructor
+   *
+   * Arguments are the file name, the column names and the number of frames
+   * buffered before a chunk is written to disk.
+   * */
+  tswriter(const std::string& fname, const std::vector<std::string>& names,
+           unsigned chunk=64);
+  /** Write remaining chunk to disk and close */
+  ~tswriter();
+
+  /** Start a new frame at time t */
+  void new_frame(unsigned t);
+  /** Add values (one per column) for cell with persistent id */
+  void add(unsigned id, const double* values);
+  /** Write current chunk to disk */
+  void flush();
+};
+
+/** Reader for the columnar time-series store
+  *
+  * Only the chunk indices are read at construction. Reading the trajectory of
+  * a given cell then only touches the blocks belonging to this cell.
+  * */
+class tsreader
+{
+  /** Position of a cell block within a chunk */
+  struct block
+  {
+    uint32_t first, count;
+    uint64_t offset;
+    uint32_t size;
+  };
+
+  /** Chunk description */
+  struct chunk_index
+  {
+    /** Position of the data section in the file */
+    uint64_t data;
+    /** Times of the frames */
+    std::vector<uint32_t> times;
+    /** Position of the cell blocks */
+    std::map<unsigned, block> cells;
+  };
+
+  /** The input file */
+  mutable std::ifstream stream;
+  /** Names of the columns */
+  std::vector<std::string> names;
+  /** Index of all chunks */
+  std::vector<chunk_index> chunks;
+
+public:
+  /** Trajectory of a single cell */
+  struct trajectory
+  {
+    /** Times at which the cell has been recorded */
+    std::vector<unsigned> time;
+    /** Values, one vector per column */
+    std::vector<std::vector<double>> columns;
+  };
+
+  /** Open file and read chunk indices */
+  explicit tsreader(const std::string& fname);
+
+  /** Names of the columns */
+  const std::vector<std::string>& columns() const
+  { return names; }
+
+  /** Index of a column from its name */
+  unsigned column(const std::string& name) const;
+
+  /** Persistent ids of all cells found in the file */
+  std::vector<unsigned> cells() const;
+
+  /** Read the full trajectory of a single cell */
+  trajectory read_cell(unsigned id) const;
+};
+
+#endif//TIMESERIES_HPP_
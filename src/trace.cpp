@@ -0,0 +1,143 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "header.hpp"
+#include "trace.hpp"
+#include <mutex>
+#include <set>
+#include <unistd.h>
+
+using namespace std;
+
+namespace trace
+{
+  namespace detail
+  {
+    atomic<bool> enabled { false };
+  }
+
+  namespace
+  {
+    struct event
+    {
+      const char* name;
+      const char* category;
+      clock::time_point begin, end;
+    };
+
+    /** Spans of a single thread */
+    struct ring
+    {
+      vector<event> events;
+      /** Number of spans recorded (the last ones are in the ring) */
+      atomic<size_t> count { 0 };
+      /** Index of the thread in the trace */
+      unsigned tid;
+    };
+
+    /** Size of the rings and origin of the time axis */
+    size_t capacity = 0;
+    clock::time_point origin;
+
+    /** All the rings (the lock is only taken when a thread starts recording
+     * and when the trace is written) */
+    mutex rings_mutex;
+    vector<unique_ptr<ring>> rings;
+
+    thread_local ring* local = nullptr;
+
+    ring* new_ring()
+    {
+      lock_guard<mutex> lock(rings_mutex);
+      rings.emplace_back(new ring);
+      auto r = rings.back().get();
+      r->events.resize(capacity);
+      r->tid = rings.size();
+      return r;
+    }
+
+    /** Interned names (the nodes of a set do not move) */
+    mutex names_mutex;
+    set<string> names;
+
+    double microseconds(clock::time_point t)
+    {
+      return chrono::duration<double, micro>(t - origin).count();
+    }
+  }
+
+  void start(size_t capacity_)
+  {
+    if(capacity_==0) throw error_msg("the trace buffer can not be empty.");
+    capacity = capacity_;
+    origin = clock::now();
+    detail::enabled.store(true, memory_order_release);
+  }
+
+  void record(const char* name, const char* category,
+              clock::time_point begin, clock::time_point end)
+  {
+    if(!local) local = new_ring();
+
+    const size_t n = local->count.load(memory_order_relaxed);
+    local->events[n%capacity] = { name, category, begin, end };
+    local->count.store(n+1, memory_order_release);
+  }
+
+  const char* intern(const string& name)
+  {
+    lock_guard<mutex> lock(names_mutex);
+    return names.insert(name).first->c_str();
+  }
+
+  void write(const string& fname)
+  {
+    ofstream file(fname);
+    if(!file.good()) throw error_msg("can not open file ", fname, ".");
+    file << fixed << setprecision(3);
+
+    lock_guard<mutex> lock(rings_mutex);
+    const auto pid = getpid();
+    size_t dropped = 0;
+
+    file << "{\"traceEvents\":[";
+    bool first = true;
+    for(const auto& r : rings)
+    {
+      file << (first ? "\n" : ",\n")
+           << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+           << ",\"tid\":" << r->tid << ",\"args\":{\"name\":\""
+           << (r->tid==1 ? "main" : "thread " + to_string(r->tid)) << "\"}}";
+      first = false;
+
+      const size_t count = r->count.load(memory_order_acquire);
+      const size_t n = min(count, capacity);
+      dropped += count - n;
+      for(size_t k=count-n; k<count; ++k)
+      {
+        const auto& e = r->events[k%capacity];
+        file << ",\n{\"name\":\"" << e.name << "\",\"cat\":\"" << e.category
+             << "\",\"ph\":\"X\",\"ts\":" << microseconds(e.begin)
+             << ",\"dur\":" << microseconds(e.end) - microseconds(e.begin)
+             << ",\"pid\":" << pid << ",\"tid\":" << r->tid << "}";
+      }
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":"
+         << dropped << "}}\n";
+
+    if(!file) throw error_msg("error while writing file ", fname, ".");
+  }
+}
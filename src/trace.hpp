@@ -0,0 +1,82 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACE_HPP_
+#define TRACE_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+/** Timeline of the simulation in the Chrome trace-event format
+  *
+  * Every thread records complete spans (name, category, begin and end) in its
+  * own ring buffer, allocated on the first span of the thread. Recording does
+  * not take any lock: a ring is only written by its thread, and the oldest
+  * spans are overwritten when it is full. The rings are collected when the
+  * trace is written, once the recording threads are done.
+  *
+  * The trace can be opened with chrome://tracing or https://ui.perfetto.dev.
+  * */
+namespace trace
+{
+  using clock = std::chrono::steady_clock;
+
+  namespace detail
+  {
+    extern std::atomic<bool> enabled;
+  }
+
+  /** Is the recorder enabled? */
+  inline bool enabled()
+  { return detail::enabled.load(std::memory_order_relaxed); }
+
+  /** Enable the recorder with rings of the given number of spans */
+  void start(std::size_t capacity);
+
+  /** Record a span of the calling thread (names must be static strings) */
+  void record(const char* name, const char* category,
+              clock::time_point begin, clock::time_point end);
+
+  /** Write all the spans recorded so far as a Chrome trace */
+  void write(const std::string& fname);
+
+  /** Copy of a name built at run time which lives until the end of the
+   * program, to be used as a span name */
+  const char* intern(const std::string& name);
+
+  /** Record the enclosing scope as a span */
+  class span
+  {
+    const char* name;
+    const char* category;
+    clock::time_point begin;
+    bool active;
+
+  public:
+    span(const char* name, const char* category)
+      : name(name), category(category), active(enabled())
+    { if(active) begin = clock::now(); }
+    ~span()
+    { if(active) record(name, category, begin, clock::now()); }
+
+    span(const span&) = delete;
+    span& operator=(const span&) = delete;
+  };
+}
+
+#endif//TRACE_HPP_
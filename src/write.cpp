@@ -17,6 +17,9 @@
 #include "header.hpp"
 #include "model.hpp"
 #include "files.hpp"
+#include "timeseries.hpp"
+#include "delta.hpp"
+#include "shm.hpp"
 
 using namespace std;
 
@@ -65,9 +68,11 @@ void Model::Write_dphi(unsigned t){
 
 
 void Model::Write_COM(unsigned t){
+    trace::span span("Write_COM", "writer");
 
     const string fname = "center_of_mass.dat";
     const char * cname = fname.c_str();
+    counted_file counted(counters, fname, counted_file::mode::append);
     FILE * sortie;
     sortie = fopen(cname, "a");    
   
@@ -80,8 +85,10 @@ void Model::Write_COM(unsigned t){
 }
 
 void Model::Write_divAngle(unsigned t, unsigned n, unsigned i, bool mutate, double angle, double plocal, double pcomp, double ptens) {
+    trace::span span("Write_divAngle", "writer");
     const std::string fname = "division_angles.dat";
     const char *cname = fname.c_str();
+    counted_file counted(counters, fname, counted_file::mode::append);
     FILE *sortie = fopen(cname, "a");
     if (sortie != nullptr) {
         // Using %u for unsigned integers, %d for the bool (cast to int), and %g for the double.
@@ -251,24 +258,243 @@ void Model::Write_forces(unsigned t){
 }
 
 
+const vector<string> Model::timeseries_columns = {
+  "com_x", "com_y", "com_z",
+  "velocity_x", "velocity_y", "velocity_z",
+  "Fpressure_x", "Fpressure_y", "Fpressure_z",
+  "Fpol_x", "Fpol_y", "Fpol_z",
+  "vol", "theta_pol",
+  "cSxx", "cSxy", "cSxz", "cSyy", "cSyz", "cSzz"
+};
+
+void Model::GetCellScalars(unsigned i, double* values) const
+{
+  const double v[] = {
+    com[i][0], com[i][1], com[i][2],
+    velocity[i][0], velocity[i][1], velocity[i][2],
+    Fpressure[i][0], Fpressure[i][1], Fpressure[i][2],
+    Fpol[i][0], Fpol[i][1], Fpol[i][2],
+    vol[i], theta_pol[i],
+    cSxx[i], cSxy[i], cSxz[i], cSyy[i], cSyz[i], cSzz[i]
+  };
+  copy(begin(v), end(v), values);
+}
+
+void Model::Write_timeseries(unsigned t)
+{
+  trace::span span("Write_timeseries", "writer");
+  const string oname = inline_str(output_dir, "timeseries.bin");
+  if(!timeseries)
+  {
+    timeseries = make_shared<tswriter>(oname, timeseries_columns, timeseries_chunk);
+    counters.add(counter::files_opened);
+  }
+  counted_file counted(counters, oname, counted_file::mode::stream);
+
+  timeseries->new_frame(t);
+  vector<double> values(timeseries_columns.size());
+  for(unsigned i=0; i<nphases_index.size(); ++i)
+  {
+    GetCellScalars(i, values.data());
+    // cells are identified by their persistent index
+    timeseries->add(nphases_index[i], values.data());
+  }
+}
+
+void Model::CloseTimeSeries()
+{
+  if(!timeseries) return;
+  const string oname = inline_str(output_dir, "timeseries.bin");
+  {
+    // the destructor writes the last chunk
+    counted_file counted(counters, oname, counted_file::mode::stream);
+    timeseries.reset();
+  }
+
+  if(compress) compress_file(oname, oname);
+  if(compress_full) compress_file(oname, runname);
+}
+
+void Model::WriteDeltaFrame(unsigned t)
+{
+  trace::span span("WriteDeltaFrame", "writer");
+  const auto to_delta = [](const coord& c) -> delta_coord {
+    return { c[0], c[1], c[2] };
+  };
+
+  const string oname = inline_str(output_dir, "frames.bin");
+  if(!delta_archive)
+  {
+    delta_archive = make_shared<deltawriter>(
+      oname, to_delta(Size), to_delta(patch_size), keyframe_interval);
+    counters.add(counter::files_opened);
+  }
+  counted_file counted(counters, oname, counted_file::mode::stream);
+
+  delta_frame frame;
+  frame.time = t;
+  for(const auto i : SelectedCells())
+  {
+    // cells are identified by their persistent index
+    frame.ids.push_back(nphases_index[i]);
+    frame.patch_min.push_back(to_delta(patch_min[i]));
+    frame.offset.push_back(to_delta(offset[i]));
+    frame.phi.push_back(phi[i]);
+  }
+  frame.stress = { field_sxx, field_syy, field_szz,
+                   field_sxy, field_sxz, field_syz };
+
+  delta_archive->write(move(frame));
+}
+
+void Model::CloseDeltaFrames()
+{
+  if(!delta_archive) return;
+  const string oname = inline_str(output_dir, "frames.bin");
+  {
+    counted_file counted(counters, oname, counted_file::mode::stream);
+    delta_archive.reset();
+  }
+
+  if(compress) compress_file(oname, oname);
+  if(compress_full) compress_file(oname, runname);
+}
+
+/** Global fields that can be published or accessed by name */
+static const pair<const char*, field Model::*> named_fields[] = {
+  { "sum_one",     &Model::sum_one },
+  { "sum_two",     &Model::sum_two },
+  { "field_press", &Model::field_press },
+  { "field_sxx",   &Model::field_sxx },
+  { "field_sxy",   &Model::field_sxy },
+  { "field_sxz",   &Model::field_sxz },
+  { "field_syy",   &Model::field_syy },
+  { "field_syz",   &Model::field_syz },
+  { "field_szz",   &Model::field_szz },
+  { "field_polx",  &Model::field_polx },
+  { "field_poly",  &Model::field_poly },
+  { "field_polz",  &Model::field_polz },
+  { "field_velx",  &Model::field_velx },
+  { "field_vely",  &Model::field_vely },
+  { "field_velz",  &Model::field_velz },
+  { "walls",       &Model::walls }
+};
+
+field Model::* Model::FieldByName(const string& name)
+{
+  for(const auto& f : named_fields)
+    if(name==f.first) return f.second;
+  return nullptr;
+}
+
+static field Model::* find_published_field(const string& name)
+{
+  const auto f = Model::FieldByName(name);
+  if(!f) throw error_msg("field ", name, " can not be published in shared memory.");
+  return f;
+}
+
+void Model::CheckPublishOptions()
+{
+  if(shm_name.empty()) return;
+  if(shm_slots<2)
+    throw error_msg("shm-slots must be at least 2.");
+  for(const auto& f : shm_fields) find_published_field(f);
+}
+
+void Model::PublishFrame(unsigned t)
+{
+  trace::span span("PublishFrame", "writer");
+  if(!publisher)
+  {
+    const unsigned S[] = { Size[0], Size[1], Size[2] };
+    const unsigned P[] = { patch_size[0], patch_size[1], patch_size[2] };
+    publisher = make_shared<shm_publisher>(
+      shm_name, shm_slots, S, P, shm_max_cells ? shm_max_cells : nphases_max,
+      timeseries_columns, shm_fields, shm_patches);
+  }
+
+  const unsigned ncells = nphases_index.size();
+  auto f = publisher->begin(t, ncells);
+  // the oldest frame is overwritten once all slots have been used
+  if(publisher->frames()>shm_slots) counters.add(counter::shm_overwrites);
+
+  vector<double> values(timeseries_columns.size());
+  for(unsigned i=0; i<ncells; ++i)
+  {
+    // cells are identified by their persistent index
+    f.ids[i] = nphases_index[i];
+    for(unsigned d=0; d<3; ++d)
+    {
+      f.patch_min[3*i+d] = patch_min[i][d];
+      f.offset[3*i+d] = offset[i][d];
+    }
+
+    GetCellScalars(i, values.data());
+    for(unsigned c=0; c<values.size(); ++c)
+      f.columns[c*f.max_cells+i] = values[c];
+
+    if(f.patches) copy(phi[i].begin(), phi[i].end(), f.patches + i*patch_N);
+  }
+
+  for(unsigned k=0; k<shm_fields.size(); ++k)
+  {
+    const auto& field = this->*find_published_field(shm_fields[k]);
+    copy(field.begin(), field.end(), f.fields + size_t(k)*N);
+  }
+
+  publisher->commit();
+}
+
+void Model::ClosePublisher()
+{
+  publisher.reset();
+}
+
+/** Size of the write buffer used for json output */
+static const size_t json_buffer_size = 1<<20;
+
+/** Open output file with a fixed-size write buffer
+ *
+ * The buffer must outlive the stream and is provided by the caller.
+ * */
+static void open_buffered(std::ofstream& ofs, vector<char>& buffer,
+                          const string& oname)
+{
+  buffer.resize(json_buffer_size);
+  // must be called before open() to be taken into account
+  ofs.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+  ofs.open(oname.c_str(), ios::out);
+  if(!ofs.good()) throw error_msg("can not open file ", oname, ".");
+}
+
 void Model::WriteFrame(unsigned t)
 {
+  trace::span span("WriteFrame", "writer");
   // construct output name
   const string oname = inline_str(output_dir, "frame", t, ".json");
 
-  // write
+  // write directly to file
+  bool bad_value;
   {
-    stringstream buffer;
+    counted_file counted(counters, oname);
+    vector<char> buffer;
+    std::ofstream ofs;
+    open_buffered(ofs, buffer, oname);
     {
-      oarchive ar(buffer, "frame", 1);
+      oarchive ar(ofs, "frame", 1);
       // serialize
       SerializeFrame(ar);
 
-     if(ar.bad_value()) throw error_msg("nan found while writing file.");
+      bad_value = ar.bad_value();
     }
-    // dump to file
-    std::ofstream ofs(oname.c_str(), ios::out);
-    ofs << buffer.rdbuf();
+    if(!ofs.good()) throw error_msg("error while writing file ", oname, ".");
+  }
+  if(bad_value)
+  {
+    remove(oname.c_str());
+    throw error_msg("nan (or value out of the range of the output precision) "
+                    "found while writing file ", oname, ".");
   }
 
   // compress
@@ -278,30 +504,39 @@ void Model::WriteFrame(unsigned t)
 
 void Model::WriteParams()
 {
+  trace::span span("WriteParams", "writer");
   // a name that makes sense
   const string oname = inline_str(output_dir, "parameters.json");
 
-  // write
+  // write directly to file
+  bool bad_value;
   {
-    stringstream buffer;
+    counted_file counted(counters, oname);
+    vector<char> buffer;
+    std::ofstream ofs;
+    open_buffered(ofs, buffer, oname);
     {
       // serialize
-      oarchive ar(buffer, "parameters", 1);
+      oarchive ar(ofs, "parameters", 1);
       // ...program parameters...
       ar & auto_name(Size)
          & auto_name(BC)
          & auto_name(nsteps)
          & auto_name(nsubsteps)
          & auto_name(ninfo)
-         & auto_name(nstart);
+         & auto_name(nstart)
+         & auto_name(output_region);
       // ...and model parameters
       SerializeParameters(ar);
 
-     if(ar.bad_value()) throw error_msg("nan found while writing file.");
+      bad_value = ar.bad_value();
     }
-    // dump to file
-    std::ofstream ofs(oname.c_str(), ios::out);
-    ofs << buffer.rdbuf();
+    if(!ofs.good()) throw error_msg("error while writing file ", oname, ".");
+  }
+  if(bad_value)
+  {
+    remove(oname.c_str());
+    throw error_msg("nan found while writing file.");
   }
 
   // compress
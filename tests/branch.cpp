@@ -0,0 +1,218 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** Forks proliferating branches from a checkpoint taken after a division
+  *
+  * The original run proliferates and writes a checkpoint every time step (in
+  * its own process, such that this one never uses OpenMP before forking). Two
+  * branches are then forked from the first checkpoint after a division and
+  * must both divide again. Run with several OpenMP threads, a branch forked
+  * after the thread pool is created hangs at its first parallel region.
+  * Returns 1 on failure.
+  * */
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "header.hpp"
+#include "model.hpp"
+#include "celadro.hpp"
+
+using namespace std;
+
+/** Length of the runs */
+static const unsigned nsteps = 12;
+/** Number of branches */
+static const unsigned nbranches = 2;
+
+/** Remove a directory and its content (no sub-directories) */
+static void remove_dir(const string& dir)
+{
+  if(DIR *d = opendir(dir.c_str()))
+  {
+    while(const dirent *e = readdir(d))
+    {
+      const string name = e->d_name;
+      if(name!="." and name!="..") remove((dir + "/" + name).c_str());
+    }
+    closedir(d);
+  }
+  rmdir(dir.c_str());
+}
+
+/** Small proliferating tissue (divisions every few time steps) */
+static celadro::parameters tissue()
+{
+  celadro::parameters p;
+  p.set("config", "cubic")
+   .set("LX", 32).set("LY", 32).set("LZ", 24).set("bc", 2)
+   .set("nsteps", nsteps).set("ninfo", 1).set("nsubsteps", 5).set("npc", 1)
+   .set("relax-time", 0)
+   .set("nphases_init", 4).set("nphases_max", 16)
+   .set("margin", 10)
+   .set("gamma", 0.006)
+   .set("mu", 45)
+   .set("lambda", 3)
+   .set("kappa_cc", 0.5)
+   .set("R", 6)
+   .set("xi", 1)
+   .set("omega_cc", 0.0002)
+   .set("wall-thickness", 5)
+   .set("kappa_cs", 0.15)
+   .set("omega_cs", 0.002)
+   .set("alpha", 0.15)
+   .set("S-pol", 1)
+   .set("D-pol", 0.05)
+   .set("J-pol", 0.1)
+   .set("K-pol", 0.05)
+   .set("zetaS", 0).set("zetaQ", 0)
+   .set("S-nem", 0).set("K-nem", 0).set("J-nem", 0).set("W-nem", 0)
+   .set("proliferate", "true")
+   .set("prolif_start", 0)
+   .set("prolif_freq_mean", 20)
+   .set("prolif_freq_std", 0.)
+   .set("time_corr_OU", 1)
+   .set("sigma_OU", 0)
+   .set("seed", 1);
+  return p;
+}
+
+/** Set up a model with the given arguments
+ *
+ * Returns the number of failed branches in the process which forked them. A
+ * branch runs to the end and exits with its status.
+ * */
+static unsigned run(vector<string> args)
+{
+  Model model;
+  model.runcard = tissue().runcard();
+  args.insert(args.begin(), { "celadro", "--verbose=0", "--no-write" });
+  vector<char*> argv;
+  for(auto& a : args) argv.push_back(&a[0]);
+
+  try
+  {
+    model.ParseProgramOptions(argv.size(), argv.data());
+    model.SetupModel();
+    if(model.branch_parent) return model.branch_failures;
+    model.Run();
+    model.Cleanup();
+  }
+  catch(const error_msg& e)
+  {
+    if(model.branch<0) throw;
+    cerr << "error in branch " << model.branch << ": " << e.what() << endl;
+    _exit(1);
+  }
+  if(model.branch>=0) _exit(0);
+  return 0;
+}
+
+/** Number of cells in the checkpoint at time t (see WriteCheckpoint) */
+static unsigned checkpoint_cells(const string& dir, unsigned t)
+{
+  ifstream stream(inline_str(dir, "/checkpoint", t, ".bin"), ios::binary);
+  // magic, version, hash, seed, time and global time
+  stream.seekg(8 + 4 + 8 + 8 + 4 + 4);
+  uint32_t nphases = 0;
+  stream.read(reinterpret_cast<char*>(&nphases), sizeof(nphases));
+  if(!stream) throw error_msg("can not read checkpoint ", t, ".");
+  return nphases;
+}
+
+int main()
+{
+  char tmpl[] = "/tmp/celadro_branch_XXXXXX";
+  const char* dir = mkdtemp(tmpl);
+  if(!dir or chdir(dir))
+  {
+    cerr << "can not create a scratch directory" << endl;
+    return 1;
+  }
+  const string checkpoints = string(dir) + "/checkpoints";
+  const string every = "--checkpoint-every=1", where = "--checkpoint-dir=" + checkpoints;
+
+  vector<string> outputs;
+  unsigned failures = 0;
+  try
+  {
+    // original run
+    const pid_t pid = fork();
+    if(pid<0) throw error_msg("can not fork the original run.");
+    if(pid==0)
+    {
+      try { run({ every, where }); }
+      catch(const error_msg& e) { cerr << "error: " << e.what() << endl; _exit(1); }
+      _exit(0);
+    }
+    int status;
+    if(waitpid(pid, &status, 0)!=pid or !WIFEXITED(status) or WEXITSTATUS(status))
+      throw error_msg("the original run failed.");
+
+    // first checkpoint after a division
+    const unsigned start = checkpoint_cells(checkpoints, 0);
+    unsigned from = 1;
+    while(from<nsteps and checkpoint_cells(checkpoints, from)==start) ++from;
+
+    if(from>=nsteps)
+    {
+      cout << "the original run has no division" << endl;
+      ++failures;
+    }
+    else
+    {
+      vector<string> args = { every, inline_str("--branch-from=", from),
+                              inline_str("--branch-jobs=", nbranches),
+                              "--checkpoint-dir=" + checkpoints, "--branch" };
+      for(unsigned i=0; i<nbranches; ++i)
+      {
+        outputs.push_back(inline_str(dir, "/branch", i));
+        args.push_back(inline_str("alpha=", 0.1+0.05*i, ",output=", outputs.back()));
+      }
+
+      const unsigned failed = run(args);
+      if(failed)
+      {
+        cout << failed << " of " << nbranches << " branches failed" << endl;
+        ++failures;
+      }
+
+      // every branch must have divided
+      const unsigned cells = checkpoint_cells(checkpoints, from);
+      for(unsigned i=0; i<nbranches; ++i)
+        if(checkpoint_cells(outputs[i] + "_checkpoints", nsteps-1)<=cells)
+        {
+          cout << "branch " << i << " did not divide" << endl;
+          ++failures;
+        }
+    }
+  }
+  catch(const error_msg& e)
+  {
+    cerr << "error: " << e.what() << endl;
+    ++failures;
+  }
+
+  for(const auto& o : outputs) remove_dir(o + "_checkpoints");
+  remove_dir(checkpoints);
+  remove_dir(dir);
+  if(!failures) cout << "branches divided" << endl;
+  return failures ? 1 : 0;
+}
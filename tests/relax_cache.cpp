@@ -0,0 +1,146 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** Relaxes the same generated tissue twice with --relax-cache
+  *
+  * The first run must relax and store its state, the second one must restore
+  * it from the cache, with the same phase fields. Returns 1 on failure.
+  * */
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <unistd.h>
+#include "header.hpp"
+#include "model.hpp"
+#include "celadro.hpp"
+
+using namespace std;
+
+/** Remove a directory and its content (no sub-directories) */
+static void remove_dir(const string& dir)
+{
+  if(DIR *d = opendir(dir.c_str()))
+  {
+    while(const dirent *e = readdir(d))
+    {
+      const string name = e->d_name;
+      if(name!="." and name!="..") remove((dir + "/" + name).c_str());
+    }
+    closedir(d);
+  }
+  rmdir(dir.c_str());
+}
+
+/** Set up and relax a small lattice, returns the relaxed phase fields */
+static vector<field> relax(const string& cache, bool& hit)
+{
+  celadro::parameters p;
+  p.set("config", "cubic")
+   .set("LX", 32).set("LY", 32).set("LZ", 24).set("bc", 2)
+   .set("nsteps", 1).set("ninfo", 1).set("nsubsteps", 5).set("npc", 1)
+   .set("relax-time", 2)
+   .set("relax-cache", cache)
+   .set("nphases_init", 4).set("nphases_max", 8)
+   .set("margin", 10)
+   .set("gamma", 0.006)
+   .set("mu", 45)
+   .set("lambda", 3)
+   .set("kappa_cc", 0.5)
+   .set("R", 6)
+   .set("xi", 1)
+   .set("omega_cc", 0.0002)
+   .set("wall-thickness", 5)
+   .set("kappa_cs", 0.15)
+   .set("omega_cs", 0.002)
+   .set("alpha", 0.15)
+   .set("S-pol", 1)
+   .set("D-pol", 0.05)
+   .set("J-pol", 0.1)
+   .set("K-pol", 0.05)
+   .set("zetaS", 0).set("zetaQ", 0)
+   .set("S-nem", 0).set("K-nem", 0).set("J-nem", 0).set("W-nem", 0)
+   .set("proliferate", "false")
+   .set("prolif_start", 0)
+   .set("prolif_freq_mean", 1500)
+   .set("prolif_freq_std", 0.)
+   .set("time_corr_OU", 25)
+   .set("sigma_OU", 50)
+   .set("seed", 1);
+
+  // same set-up as celadro::simulation
+  Model model;
+  model.runcard = p.runcard();
+  vector<string> args = { "celadro", "--verbose=0", "--no-write" };
+  vector<char*> argv;
+  for(auto& a : args) argv.push_back(&a[0]);
+  model.ParseProgramOptions(argv.size(), argv.data());
+  model.SetupModel();
+  model.Pre();
+  model.GetFromDevice();
+
+  hit = model.relax_cache_hit;
+  const vector<field> phi(model.phi.begin(),
+                          model.phi.begin() + model.nphases_index.size());
+  model.Cleanup();
+  return phi;
+}
+
+int main()
+{
+  char tmpl[] = "/tmp/celadro_relax_cache_XXXXXX";
+  const char* dir = mkdtemp(tmpl);
+  if(!dir)
+  {
+    cerr << "can not create a scratch directory" << endl;
+    return 1;
+  }
+
+  unsigned failures = 0;
+  try
+  {
+    bool first_hit, second_hit;
+    const auto first  = relax(dir, first_hit);
+    const auto second = relax(dir, second_hit);
+
+    if(first_hit)
+    {
+      cout << "first run restored a state from an empty cache" << endl;
+      ++failures;
+    }
+    if(!second_hit)
+    {
+      cout << "second run did not hit the cache" << endl;
+      ++failures;
+    }
+    if(first!=second)
+    {
+      cout << "restored state differs from the relaxed state" << endl;
+      ++failures;
+    }
+  }
+  catch(const error_msg& e)
+  {
+    cerr << "error: " << e.what() << endl;
+    ++failures;
+  }
+
+  remove_dir(dir);
+  if(!failures) cout << "relax cache hit" << endl;
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** Replays a window across a division from the checkpoints of a run
+  *
+  * The original run proliferates and writes a checkpoint every time step. The
+  * replay restores a checkpoint taken after a division (the number of cells
+  * differs from the set-up) and runs across a later division, checked against
+  * the original checkpoints. Returns 1 on failure.
+  * */
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <unistd.h>
+#include "header.hpp"
+#include "model.hpp"
+#include "celadro.hpp"
+
+using namespace std;
+
+/** Length of the original run */
+static const unsigned nsteps = 12;
+
+/** Remove a directory and its content (no sub-directories) */
+static void remove_dir(const string& dir)
+{
+  if(DIR *d = opendir(dir.c_str()))
+  {
+    while(const dirent *e = readdir(d))
+    {
+      const string name = e->d_name;
+      if(name!="." and name!="..") remove((dir + "/" + name).c_str());
+    }
+    closedir(d);
+  }
+  rmdir(dir.c_str());
+}
+
+/** Small proliferating tissue (divisions every few time steps) */
+static celadro::parameters tissue()
+{
+  celadro::parameters p;
+  p.set("config", "cubic")
+   .set("LX", 32).set("LY", 32).set("LZ", 24).set("bc", 2)
+   .set("nsteps", nsteps).set("ninfo", 1).set("nsubsteps", 5).set("npc", 1)
+   .set("relax-time", 0)
+   .set("nphases_init", 4).set("nphases_max", 16)
+   .set("margin", 10)
+   .set("gamma", 0.006)
+   .set("mu", 45)
+   .set("lambda", 3)
+   .set("kappa_cc", 0.5)
+   .set("R", 6)
+   .set("xi", 1)
+   .set("omega_cc", 0.0002)
+   .set("wall-thickness", 5)
+   .set("kappa_cs", 0.15)
+   .set("omega_cs", 0.002)
+   .set("alpha", 0.15)
+   .set("S-pol", 1)
+   .set("D-pol", 0.05)
+   .set("J-pol", 0.1)
+   .set("K-pol", 0.05)
+   .set("zetaS", 0).set("zetaQ", 0)
+   .set("S-nem", 0).set("K-nem", 0).set("J-nem", 0).set("W-nem", 0)
+   .set("proliferate", "true")
+   .set("prolif_start", 0)
+   .set("prolif_freq_mean", 20)
+   .set("prolif_freq_std", 0.)
+   .set("time_corr_OU", 1)
+   .set("sigma_OU", 0)
+   .set("seed", 1);
+  return p;
+}
+
+/** Set up and run a model with the given arguments */
+static unsigned run(vector<string> args)
+{
+  Model model;
+  model.runcard = tissue().runcard();
+  args.insert(args.begin(), { "celadro", "--verbose=0", "--no-write" });
+  vector<char*> argv;
+  for(auto& a : args) argv.push_back(&a[0]);
+  model.ParseProgramOptions(argv.size(), argv.data());
+  model.SetupModel();
+  model.Run();
+  model.Cleanup();
+  return model.replay_checks;
+}
+
+/** Number of cells in the checkpoint at time t (see WriteCheckpoint) */
+static unsigned checkpoint_cells(const string& dir, unsigned t)
+{
+  ifstream stream(inline_str(dir, "/checkpoint", t, ".bin"), ios::binary);
+  // magic, version, hash, seed, time and global time
+  stream.seekg(8 + 4 + 8 + 8 + 4 + 4);
+  uint32_t nphases = 0;
+  stream.read(reinterpret_cast<char*>(&nphases), sizeof(nphases));
+  if(!stream) throw error_msg("can not read checkpoint ", t, ".");
+  return nphases;
+}
+
+int main()
+{
+  char tmpl[] = "/tmp/celadro_replay_XXXXXX";
+  const char* dir = mkdtemp(tmpl);
+  if(!dir or chdir(dir))
+  {
+    cerr << "can not create a scratch directory" << endl;
+    return 1;
+  }
+  const string checkpoints = string(dir) + "/checkpoints";
+  const string every = "--checkpoint-every=1", where = "--checkpoint-dir=" + checkpoints;
+
+  unsigned failures = 0;
+  try
+  {
+    run({ every, where });
+
+    // window from a checkpoint after the first division to the next one
+    vector<unsigned> cells;
+    for(unsigned t=0; t<nsteps; ++t) cells.push_back(checkpoint_cells(checkpoints, t));
+    unsigned from = 1;
+    while(from<nsteps and cells[from]==cells[0]) ++from;
+    unsigned to = from+1;
+    while(to<nsteps and cells[to]==cells[from]) ++to;
+
+    if(to>=nsteps)
+    {
+      cout << "the original run has less than two divisions" << endl;
+      ++failures;
+    }
+    else
+    {
+      const unsigned checks = run({ every, where, "--replay",
+                                    inline_str("from=", from), inline_str("to=", to),
+                                    "output=replay" });
+      if(checks!=to-from)
+      {
+        cout << "replay from " << from << " to " << to << " was checked against "
+             << checks << " checkpoint(s)" << endl;
+        ++failures;
+      }
+    }
+  }
+  catch(const error_msg& e)
+  {
+    cerr << "error: " << e.what() << endl;
+    ++failures;
+  }
+
+  remove_dir(checkpoints);
+  remove_dir(dir);
+  if(!failures) cout << "replay across divisions" << endl;
+  return failures ? 1 : 0;
+}
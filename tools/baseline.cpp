@@ -0,0 +1,157 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include "baseline.hpp"
+#include "error_msg.hpp"
+#include "json.hpp"
+
+using namespace std;
+
+/** Version of the baseline files */
+static const unsigned baseline_version = 1;
+
+/** Quantile of sorted samples (linear interpolation) */
+static double quantile(const vector<double>& sorted, double p)
+{
+  if(sorted.empty()) return 0;
+  const double x = p*(sorted.size()-1);
+  const size_t i = static_cast<size_t>(x);
+  if(i+1>=sorted.size()) return sorted.back();
+  return sorted[i] + (x-i)*(sorted[i+1]-sorted[i]);
+}
+
+sample_stats compute_stats(vector<double> samples)
+{
+  sort(samples.begin(), samples.end());
+  sample_stats s;
+  s.median = quantile(samples, .5);
+  s.q1     = quantile(samples, .25);
+  s.q3     = quantile(samples, .75);
+  return s;
+}
+
+void write_baseline(const string& fname, const baseline& b)
+{
+  ofstream file(fname);
+  if(!file.good()) throw error_msg("can not open file ", fname, ".");
+  file << setprecision(9);
+
+  file << "{\n  \"version\": " << baseline_version
+       << ",\n  \"steps\": " << b.steps
+       << ",\n  \"scenarios\": {";
+  bool first_scenario = true;
+  for(const auto& s : b.samples)
+  {
+    file << (first_scenario ? "\n" : ",\n") << "    \"" << s.first << "\": {";
+    first_scenario = false;
+    bool first = true;
+    for(const auto& q : s.second)
+    {
+      const auto stats = compute_stats(q.second);
+      file << (first ? "\n" : ",\n") << "      \"" << q.first << "\": { "
+           << "\"median\": " << stats.median << ", \"q1\": " << stats.q1
+           << ", \"q3\": " << stats.q3 << ", \"samples\": [";
+      for(unsigned k=0; k<q.second.size(); ++k)
+        file << (k ? ", " : "") << q.second[k];
+      file << "] }";
+      first = false;
+    }
+    file << "\n    }";
+  }
+  file << "\n  }\n}\n";
+
+  if(!file) throw error_msg("error while writing file ", fname, ".");
+}
+
+baseline read_baseline(const string& fname)
+{
+  const auto root = read_json_file(fname);
+  if(root["version"].as_number()!=baseline_version)
+    throw error_msg("baseline ", fname, " has an unsupported version.");
+
+  baseline b;
+  b.steps = root["steps"].as_number();
+  for(const auto& s : root["scenarios"].members)
+    for(const auto& q : s.second.members)
+      b.samples[s.first][q.first] = q.second["samples"].as_numbers();
+  return b;
+}
+
+vector<regression> compare(const baseline& base, const baseline& current,
+                           double threshold, double min_time)
+{
+  if(base.steps!=current.steps)
+    throw error_msg("the baseline was measured over ", base.steps,
+                    " steps instead of ", current.steps, ".");
+
+  vector<regression> diff;
+  for(const auto& s : current.samples)
+  {
+    const auto bs = base.samples.find(s.first);
+    if(bs==base.samples.end()) continue;
+
+    for(const auto& q : s.second)
+    {
+      const auto bq = bs->second.find(q.first);
+      if(bq==bs->second.end()) continue;
+
+      regression r;
+      r.scenario = s.first;
+      r.quantity = q.first;
+      r.base     = compute_stats(bq->second);
+      r.current  = compute_stats(q.second);
+      if(r.base.median<min_time and r.current.median<min_time) continue;
+
+      r.ratio   = r.base.median>0 ? r.current.median/r.base.median : 1.;
+      r.flagged = r.ratio>1+threshold and r.current.q1>r.base.q3;
+      diff.push_back(r);
+    }
+  }
+  return diff;
+}
+
+void write_diff(const string& fname, const vector<regression>& diff,
+                double threshold)
+{
+  ofstream file(fname);
+  if(!file.good()) throw error_msg("can not open file ", fname, ".");
+  file << setprecision(9);
+
+  const auto nflagged = count_if(diff.begin(), diff.end(),
+                                 [](const regression& r) { return r.flagged; });
+  file << "{\n  \"threshold\": " << threshold
+       << ",\n  \"regressions\": " << nflagged
+       << ",\n  \"quantities\": [";
+  for(unsigned k=0; k<diff.size(); ++k)
+  {
+    const auto& r = diff[k];
+    file << (k ? ",\n" : "\n")
+         << "    { \"scenario\": \"" << r.scenario << "\""
+         << ", \"quantity\": \"" << r.quantity << "\""
+         << ", \"base_median\": " << r.base.median
+         << ", \"base_iqr\": " << r.base.iqr()
+         << ", \"median\": " << r.current.median
+         << ", \"iqr\": " << r.current.iqr()
+         << ", \"ratio\": " << r.ratio
+         << ", \"regression\": " << (r.flagged ? "true" : "false") << " }";
+  }
+  file << "\n  ]\n}\n";
+
+  if(!file) throw error_msg("error while writing file ", fname, ".");
+}
@@ -0,0 +1,80 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BASELINE_HPP_
+#define BASELINE_HPP_
+
+#include <map>
+#include <string>
+#include <vector>
+
+/** Performance baselines (celadro_bench --save-baseline / --compare)
+  *
+  * A baseline holds, for every scenario and every timed quantity (the stages
+  * of timer.hpp and the total time of the step loop), the times measured over
+  * a number of repetitions. Comparisons use the median and the interquartile
+  * range, such that a single slow repetition does not trigger a regression.
+  * */
+
+/** Samples of each timed quantity of each scenario */
+struct baseline
+{
+  /** Number of time steps of each repetition */
+  unsigned steps = 0;
+  /** samples[scenario][quantity] */
+  std::map<std::string, std::map<std::string, std::vector<double>>> samples;
+};
+
+/** Median and quartiles of a set of samples */
+struct sample_stats
+{
+  double median = 0, q1 = 0, q3 = 0;
+  double iqr() const { return q3 - q1; }
+};
+
+sample_stats compute_stats(std::vector<double> samples);
+
+/** Comparison of one quantity against the baseline */
+struct regression
+{
+  std::string scenario, quantity;
+  sample_stats base, current;
+  /** Ratio of the medians (current/base) */
+  double ratio;
+  /** Slower by more than the threshold and beyond the noise */
+  bool flagged;
+};
+
+/** Write a baseline to a json file */
+void write_baseline(const std::string& fname, const baseline& b);
+/** Read a baseline from a json file */
+baseline read_baseline(const std::string& fname);
+
+/** Compare to a baseline
+ *
+ * A quantity is flagged if its median is slower than the baseline by more
+ * than the relative threshold, and if the interquartile ranges do not
+ * overlap. Quantities below min_time (in seconds) in both runs are ignored,
+ * as their relative variations are dominated by the timer resolution.
+ * */
+std::vector<regression> compare(const baseline& base, const baseline& current,
+                                double threshold, double min_time);
+
+/** Write the result of a comparison to a json file */
+void write_diff(const std::string& fname, const std::vector<regression>& diff,
+                double threshold);
+
+#endif//BASELINE_HPP_
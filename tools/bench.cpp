@@ -0,0 +1,379 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** celadro_bench
+  *
+  * Runs canonical scenarios through libceladro with output disabled and
+  * reports the throughput of the step loop:
+  *
+  *   example   the 80x80x40 channel of example/ (bc=2) with 25 cells
+  *   tissue    a proliferating monolayer of 400 cells
+  *   periodic  a large periodic box filled with cells
+  *
+  * The scenarios are built from the options below and do not need any input
+  * file. Usage:
+  *
+  *   celadro_bench [--scenario NAME]... [--steps N] [--relax N] [-o FILE]
+  *
+  * Performance checks: with --repeat R each scenario is run R times and the
+  * per-stage times can be saved as a baseline (--save-baseline FILE), or
+  * compared to a previous baseline (--compare FILE). Comparisons write a
+  * json diff and return 2 if a regression is found, see baseline.hpp.
+  * */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/program_options.hpp>
+#include <unistd.h>
+#include "baseline.hpp"
+#include "celadro.hpp"
+#include "error_msg.hpp"
+
+using namespace std;
+namespace opt = boost::program_options;
+
+/** Integration parameters shared by all scenarios */
+constexpr unsigned ninfo = 5, nsubsteps = 5, npc = 4;
+
+/** A benchmark scenario */
+struct scenario
+{
+  string name;
+  celadro::parameters params;
+  /** Initial positions of the cells */
+  vector<celadro::coord> cells;
+};
+
+/** Result of a run */
+struct result
+{
+  string name;
+  unsigned steps, ncells_start, ncells_end, divisions;
+  double seconds, steps_per_s, node_updates_per_s, divisions_per_s;
+  /** Highest memory of the model (bytes) */
+  size_t peak_host, peak_device;
+  map<string, double> stages;
+};
+
+/** Parameters shared by all scenarios (same as example/simCard.dat) */
+static celadro::parameters base_parameters()
+{
+  celadro::parameters p;
+  p.set("config", "input const")
+   .set("ninfo", ninfo)
+   .set("nsubsteps", nsubsteps)
+   .set("npc", npc)
+   .set("margin", 18)
+   .set("gamma", 0.006)
+   .set("mu", 45)
+   .set("lambda", 3)
+   .set("kappa_cc", 0.5)
+   .set("R", 8)
+   .set("xi", 1)
+   .set("omega_cc", 0.0002)
+   .set("wall-thickness", 7)
+   .set("kappa_cs", 0.15)
+   .set("omega_cs", 0.002)
+   .set("alpha", 0.15)
+   .set("S-pol", 1)
+   .set("D-pol", 0.05)
+   .set("J-pol", 0.1)
+   .set("K-pol", 0.)
+   .set("zetaS", 0)
+   .set("zetaQ", 0)
+   .set("S-nem", 0)
+   .set("K-nem", 0)
+   .set("J-nem", 0)
+   .set("W-nem", 0)
+   .set("prolif_freq_std", 0.)
+   .set("mutation_strength", 0.25)
+   .set("max_prop_val", 0.0025)
+   .set("min_prop_val", 0.0001)
+   .set("time_corr_OU", 25)
+   .set("sigma_OU", 50)
+   .set("seed", 1);
+  return p;
+}
+
+/** Square lattice of nx x ny cells with spacing d at height z */
+static vector<celadro::coord> monolayer(unsigned nx, unsigned ny, unsigned d,
+                                        unsigned z)
+{
+  vector<celadro::coord> cells;
+  for(unsigned i=0; i<nx; ++i)
+    for(unsigned j=0; j<ny; ++j)
+      cells.push_back({ d/2 + d*i, d/2 + d*j, z });
+  return cells;
+}
+
+static scenario make_scenario(const string& name, unsigned steps,
+                              unsigned relax)
+{
+  scenario s { name, base_parameters(), {} };
+  auto& p = s.params;
+  p.set("relax-time", relax).set("nsteps", steps);
+
+  if(name=="example")
+  {
+    p.set("LX", 80).set("LY", 80).set("LZ", 40).set("bc", 2)
+     .set("nphases_max", 400)
+     .set("proliferate", "true")
+     .set("prolif_start", 150)
+     .set("prolif_freq_mean", 1500);
+    s.cells = monolayer(5, 5, 16, 11);
+  }
+  else if(name=="tissue")
+  {
+    // divisions start right away and are frequent
+    p.set("LX", 320).set("LY", 320).set("LZ", 40).set("bc", 2)
+     .set("nphases_max", 1000)
+     .set("proliferate", "true")
+     .set("prolif_start", 0)
+     .set("prolif_freq_mean", 20);
+    s.cells = monolayer(20, 20, 16, 11);
+  }
+  else if(name=="periodic")
+  {
+    p.set("LX", 128).set("LY", 128).set("LZ", 128).set("bc", 0)
+     .set("nphases_max", 512)
+     .set("proliferate", "false")
+     .set("prolif_start", 0)
+     .set("prolif_freq_mean", 1500);
+    for(unsigned z=0; z<8; ++z)
+      for(const auto& c : monolayer(8, 8, 16, 8 + 16*z))
+        s.cells.push_back(c);
+  }
+  else throw error_msg("unknown scenario ", name, ".");
+
+  p.set("nphases_init", s.cells.size());
+  return s;
+}
+
+static result run(const scenario& s, unsigned steps)
+{
+  // the initial configuration is read from input_str.dat in the working
+  // directory: write it to a scratch directory
+  char tmpl[] = "/tmp/celadro_bench_XXXXXX";
+  const char* dir = mkdtemp(tmpl);
+  if(!dir) throw error_msg("can not create a scratch directory.");
+  const string fname = string(dir) + "/input_str.dat";
+  {
+    ofstream file(fname);
+    for(const auto& c : s.cells) file << c[0] << ' ' << c[1] << ' ' << c[2] << '\n';
+  }
+
+  char cwd[4096];
+  if(!getcwd(cwd, sizeof(cwd)) or chdir(dir))
+    throw error_msg("can not change to the scratch directory.");
+  unique_ptr<celadro::simulation> sim;
+  try { sim.reset(new celadro::simulation(s.params)); }
+  catch(...) { if(chdir(cwd)) {} throw; }
+  if(chdir(cwd)) throw error_msg("can not change back to ", cwd, ".");
+  remove(fname.c_str());
+  rmdir(dir);
+
+  result r;
+  r.name = s.name;
+  r.steps = steps;
+  r.ncells_start = sim->ncells();
+  const auto stages_before = sim->timings();
+  const auto ids = sim->cell_ids();
+  const unsigned head_before = *max_element(ids.begin(), ids.end());
+  const size_t patch_N = sim->patch(0).phi.size();
+
+  // advance one streak at a time to follow the number of cells
+  double node_updates = 0;
+  const auto start = chrono::steady_clock::now();
+  for(unsigned t=0; t<steps; t+=ninfo)
+  {
+    const unsigned n = min(ninfo, steps-t);
+    node_updates += double(sim->ncells())*patch_N*n*nsubsteps*(npc+1);
+    sim->advance(n);
+  }
+  r.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  // every division creates two new cells
+  const auto ids_after = sim->cell_ids();
+  const unsigned head_after = ids_after.empty() ? head_before
+    : max(head_before, *max_element(ids_after.begin(), ids_after.end()));
+  r.divisions = (head_after - head_before)/2;
+  r.ncells_end = sim->ncells();
+
+  r.steps_per_s = steps/r.seconds;
+  r.node_updates_per_s = node_updates/r.seconds;
+  r.divisions_per_s = r.divisions/r.seconds;
+  // the memory of this scenario only (the resident size of the process is a
+  // maximum over all the scenarios run so far)
+  const auto memory = sim->peak_memory();
+  r.peak_host = memory[0];
+  r.peak_device = memory[1];
+  for(const auto& st : sim->timings())
+    r.stages[st.first] = st.second - stages_before.at(st.first);
+  return r;
+}
+
+static void print(const result& r)
+{
+  cout << r.name << '\n'
+       << "  steps               " << r.steps << " in " << r.seconds << " s\n"
+       << "  cells               " << r.ncells_start << " -> " << r.ncells_end << '\n'
+       << "  steps/s             " << r.steps_per_s << '\n'
+       << "  cell-node updates/s " << r.node_updates_per_s << '\n'
+       << "  divisions           " << r.divisions << " (" << r.divisions_per_s << " /s)\n"
+       << "  peak memory         " << r.peak_host/1048576. << " MB host, "
+       << r.peak_device/1048576. << " MB device\n"
+       << "  stages (s)         ";
+  for(const auto& st : r.stages)
+    if(st.second>0) cout << ' ' << st.first << '=' << st.second;
+  cout << endl;
+}
+
+static void write_json(const string& fname, const vector<result>& results)
+{
+  ofstream file(fname);
+  if(!file.good()) throw error_msg("can not open file ", fname, ".");
+  file << setprecision(9) << "[";
+  for(unsigned k=0; k<results.size(); ++k)
+  {
+    const auto& r = results[k];
+    file << (k ? ",\n" : "\n") << "  { \"scenario\": \"" << r.name << "\""
+         << ", \"steps\": " << r.steps
+         << ", \"seconds\": " << r.seconds
+         << ", \"ncells_start\": " << r.ncells_start
+         << ", \"ncells_end\": " << r.ncells_end
+         << ", \"steps_per_s\": " << r.steps_per_s
+         << ", \"node_updates_per_s\": " << r.node_updates_per_s
+         << ", \"divisions\": " << r.divisions
+         << ", \"divisions_per_s\": " << r.divisions_per_s
+         << ", \"peak_host_bytes\": " << r.peak_host
+         << ", \"peak_device_bytes\": " << r.peak_device
+         << ", \"stages\": {";
+    bool first = true;
+    for(const auto& st : r.stages)
+    {
+      file << (first ? " " : ", ") << '"' << st.first << "\": " << st.second;
+      first = false;
+    }
+    file << " } }";
+  }
+  file << "\n]\n";
+}
+
+int main(int argc, char **argv)
+{
+  vector<string> names;
+  unsigned steps, relax, repeat;
+  string output, save_name, compare_name, diff_name;
+  double threshold, min_time;
+
+  opt::options_description options("Options");
+  options.add_options()
+    ("help,h", "produce help message")
+    ("scenario,s", opt::value<vector<string>>(&names)->multitoken(),
+     "scenarios to run (example, tissue, periodic; default: all)")
+    ("steps,n", opt::value<unsigned>(&steps)->default_value(100u),
+     "number of time steps of each run")
+    ("relax", opt::value<unsigned>(&relax)->default_value(10u),
+     "relaxation time before the timed steps")
+    ("output,o", opt::value<string>(&output),
+     "write the results to a json file")
+    ("repeat,r", opt::value<unsigned>(&repeat)->default_value(1u),
+     "number of repetitions of each scenario")
+    ("save-baseline", opt::value<string>(&save_name),
+     "save the per-stage times as a baseline")
+    ("compare", opt::value<string>(&compare_name),
+     "compare the per-stage times to a baseline")
+    ("threshold", opt::value<double>(&threshold)->default_value(.1),
+     "relative slowdown of the median above which a stage is flagged")
+    ("min-time", opt::value<double>(&min_time)->default_value(1e-3),
+     "stages faster than this (in seconds) are not compared")
+    ("diff", opt::value<string>(&diff_name)->default_value("perf_diff.json"),
+     "file to which the comparison is written");
+
+  try
+  {
+    opt::variables_map vm;
+    opt::store(opt::parse_command_line(argc, argv, options), vm);
+    opt::notify(vm);
+    if(vm.count("help"))
+    {
+      cout << options << endl;
+      return 0;
+    }
+    if(names.empty()) names = { "example", "tissue", "periodic" };
+    if(steps==0) throw error_msg("the number of steps must be positive.");
+    if(repeat==0) throw error_msg("the number of repetitions must be positive.");
+
+    // read the baseline first to fail early
+    baseline base;
+    if(!compare_name.empty()) base = read_baseline(compare_name);
+
+    vector<result> results;
+    baseline current;
+    current.steps = steps;
+    for(const auto& name : names)
+      for(unsigned k=0; k<repeat; ++k)
+      {
+        // the device memory is freed between the runs
+        const auto s = make_scenario(name, steps, relax);
+        results.push_back(run(s, steps));
+        print(results.back());
+
+        auto& samples = current.samples[name];
+        samples["loop"].push_back(results.back().seconds);
+        for(const auto& st : results.back().stages)
+          samples[st.first].push_back(st.second);
+      }
+
+    if(!output.empty()) write_json(output, results);
+    if(!save_name.empty()) write_baseline(save_name, current);
+
+    if(!compare_name.empty())
+    {
+      const auto diff = compare(base, current, threshold, min_time);
+      write_diff(diff_name, diff, threshold);
+
+      unsigned nflagged = 0;
+      for(const auto& r : diff)
+      {
+        if(!r.flagged) continue;
+        cout << "regression: " << r.scenario << " " << r.quantity << " "
+             << r.base.median << " s -> " << r.current.median << " s (x"
+             << r.ratio << ")" << endl;
+        ++nflagged;
+      }
+      cout << nflagged << " regression(s) found, see " << diff_name << endl;
+      if(nflagged) return 2;
+    }
+  }
+  catch(const error_msg& e) {
+    cerr << argv[0] << ": error: " << e.what() << endl;
+    return 1;
+  }
+  catch(const exception& e) {
+    cerr << argv[0] << ": " << e.what() << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,230 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "host_header.hpp"
+#include "json.hpp"
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+// =============================================================================
+// Access
+
+const json_value* json_value::find(const string& key) const
+{
+  if(type!=kind::object) return nullptr;
+  for(const auto& m : members)
+    if(m.first==key) return &m.second;
+  return nullptr;
+}
+
+const json_value& json_value::operator[](const string& key) const
+{
+  const auto v = find(key);
+  if(!v) throw error_msg("json: member '", key, "' not found.");
+  return *v;
+}
+
+const json_value& json_value::operator[](size_t i) const
+{
+  if(type!=kind::array or i>=items.size())
+    throw error_msg("json: array index out of bounds.");
+  return items[i];
+}
+
+size_t json_value::size() const
+{
+  if(type==kind::array) return items.size();
+  if(type==kind::numbers) return numbers.size();
+  throw error_msg("json: value is not an array.");
+}
+
+double json_value::as_number() const
+{
+  if(type!=kind::number and type!=kind::boolean)
+    throw error_msg("json: value is not a number.");
+  return number;
+}
+
+const vector<double>& json_value::as_numbers() const
+{
+  if(type!=kind::numbers)
+    throw error_msg("json: value is not an array of numbers.");
+  return numbers;
+}
+
+// =============================================================================
+// Parser
+
+namespace
+{
+  struct parser
+  {
+    const char* p;
+
+    void skip()
+    {
+      while(*p==' ' or *p=='\n' or *p=='\t' or *p=='\r') ++p;
+    }
+
+    void expect(char c)
+    {
+      skip();
+      if(*p!=c) throw error_msg("json: expected '", c, "' but found '",
+                                *p ? string(1, *p) : "end of file", "'.");
+      ++p;
+    }
+
+    bool is_number_start() const
+    {
+      // nan is written as such by oarchive
+      return (*p>='0' and *p<='9') or *p=='-' or *p=='+' or *p=='n' or *p=='i';
+    }
+
+    double parse_number()
+    {
+      // check for null (starts with n as nan)
+      if(!strncmp(p, "null", 4)) throw error_msg("json: unexpected null.");
+
+      char* end;
+      const double v = strtod(p, &end);
+      if(end==p) throw error_msg("json: invalid number.");
+      p = end;
+      return v;
+    }
+
+    string parse_string()
+    {
+      expect('"');
+      string s;
+      while(*p!='"')
+      {
+        if(*p=='\0') throw error_msg("json: unterminated string.");
+        if(*p=='\\')
+        {
+          ++p;
+          switch(*p)
+          {
+            case 'n': s += '\n'; break;
+            case 't': s += '\t'; break;
+            case 'r': s += '\r'; break;
+            case 'b': s += '\b'; break;
+            case 'f': s += '\f'; break;
+            case '\0': throw error_msg("json: unterminated string.");
+            default: s += *p;
+          }
+          ++p;
+        }
+        else s += *p++;
+      }
+      ++p;
+      return s;
+    }
+
+    json_value parse_value()
+    {
+      json_value v;
+      skip();
+
+      if(*p=='{')
+      {
+        ++p;
+        v.type = json_value::kind::object;
+        skip();
+        if(*p=='}') { ++p; return v; }
+        for(;;)
+        {
+          string key = parse_string();
+          expect(':');
+          v.members.emplace_back(move(key), parse_value());
+          skip();
+          if(*p==',') { ++p; continue; }
+          expect('}');
+          return v;
+        }
+      }
+
+      if(*p=='[')
+      {
+        ++p;
+        skip();
+        // arrays of numbers are stored packed (empty arrays as well)
+        v.type = json_value::kind::numbers;
+        if(*p==']') { ++p; return v; }
+        if(!is_number_start() or !strncmp(p, "null", 4))
+          v.type = json_value::kind::array;
+
+        for(;;)
+        {
+          if(v.type==json_value::kind::numbers)
+            v.numbers.push_back(parse_number());
+          else
+            v.items.push_back(parse_value());
+          skip();
+          if(*p==',') { ++p; skip(); continue; }
+          expect(']');
+          return v;
+        }
+      }
+
+      if(*p=='"')
+      {
+        v.type = json_value::kind::string;
+        v.str = parse_string();
+        return v;
+      }
+
+      if(!strncmp(p, "true", 4))  { p += 4; v.type = json_value::kind::boolean; v.number = 1; return v; }
+      if(!strncmp(p, "false", 5)) { p += 5; v.type = json_value::kind::boolean; v.number = 0; return v; }
+      if(!strncmp(p, "null", 4))  { p += 4; return v; }
+
+      v.type = json_value::kind::number;
+      v.number = parse_number();
+      return v;
+    }
+  };
+}
+
+json_value parse_json(const char* buffer)
+{
+  parser ps { buffer };
+  auto v = ps.parse_value();
+  ps.skip();
+  if(*ps.p!='\0') throw error_msg("json: trailing characters.");
+  return v;
+}
+
+json_value read_json_file(const string& fname)
+{
+  ifstream stream(fname, ios::in | ios::binary);
+  if(!stream.good()) throw error_msg("can not open file ", fname, ".");
+
+  stream.seekg(0, ios::end);
+  string buffer(static_cast<size_t>(stream.tellg()), '\0');
+  stream.seekg(0, ios::beg);
+  stream.read(&buffer[0], buffer.size());
+  if(!stream) throw error_msg("error while reading file ", fname, ".");
+
+  try
+  {
+    return parse_json(buffer.c_str());
+  }
+  catch(const error_msg& e)
+  {
+    throw error_msg(fname, ": ", e.what());
+  }
+}
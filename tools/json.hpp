@@ -0,0 +1,67 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JSON_HPP_
+#define JSON_HPP_
+
+#include <string>
+#include <vector>
+#include <utility>
+
+/** Minimal json reader for the archives written by oarchive
+  *
+  * Arrays containing only numbers (the bulk of the data) are stored packed as
+  * a vector of doubles, other values are stored as a tree.
+  * */
+class json_value
+{
+public:
+  enum class kind { null, boolean, number, string, array, object, numbers };
+
+  /** Type of the value */
+  kind type = kind::null;
+  /** Value if number or boolean */
+  double number = 0;
+  /** Value if string */
+  std::string str;
+  /** Elements if array (not only numbers) */
+  std::vector<json_value> items;
+  /** Elements if array of numbers */
+  std::vector<double> numbers;
+  /** Members if object */
+  std::vector<std::pair<std::string, json_value>> members;
+
+  /** Member with given name (nullptr if not found or not an object) */
+  const json_value* find(const std::string& key) const;
+  /** Member with given name (throws if not found) */
+  const json_value& operator[](const std::string& key) const;
+  /** Element of an array (throws if out of bounds) */
+  const json_value& operator[](std::size_t i) const;
+  /** Number of elements of an array */
+  std::size_t size() const;
+  /** Value of a number (throws if not a number) */
+  double as_number() const;
+  /** Elements of an array of numbers (throws otherwise) */
+  const std::vector<double>& as_numbers() const;
+};
+
+/** Parse json from a character buffer (must be null terminated) */
+json_value parse_json(const char* buffer);
+
+/** Read and parse json file */
+json_value read_json_file(const std::string& fname);
+
+#endif//JSON_HPP_
@@ -0,0 +1,344 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** celadro_microbench
+  *
+  * Micro-benchmarks of the primitives that dominate the time step, measured
+  * in isolation on the host (the same inline functions are used by the
+  * kernels):
+  *
+  *   deriv, laplacian  finite differences over the global and patch stencils
+  *   index mapping     GetPatchIndex, GetIndexFromPatch and GetNodePosOnDomain
+  *   vec               addition, dot product and norm of vec<double, 3>
+  *   stress            2x2x2 stress integration (see stress.hpp)
+  *
+  * for a range of cubic boxes and patch margins. Every benchmark reports the
+  * time per operation and the achieved bandwidth, computed from the bytes an
+  * operation nominally reads and writes (none for the index computations).
+  * Usage:
+  *
+  *   celadro_microbench [--box L]... [--margin M]... [--min-time S] [-o FILE]
+  * */
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+#include <boost/program_options.hpp>
+#include "header.hpp"
+#include "model.hpp"
+#include "derivatives.hpp"
+#include "stress.hpp"
+
+using namespace std;
+namespace opt = boost::program_options;
+
+/** Result of a benchmark */
+struct measure
+{
+  string name;
+  unsigned box, patch;
+  double ns_per_op, gb_per_s;
+};
+
+/** Results are accumulated here such that they are not optimised away */
+static volatile double sink;
+
+/** Time per operation (in ns) of f, which performs nops operations
+ *
+ * Best of five batches, each repeating f for at least min_time/5.
+ * */
+template<class F>
+static double time_per_op(F f, size_t nops, double min_time)
+{
+  double best = numeric_limits<double>::max();
+  for(unsigned b=0; b<5; ++b)
+  {
+    size_t reps = 0;
+    double elapsed = 0;
+    const auto start = chrono::steady_clock::now();
+    do
+    {
+      f();
+      ++reps;
+      elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    while(elapsed<min_time/5);
+    best = min(best, elapsed/(double(reps)*nops));
+  }
+  return 1e9*best;
+}
+
+class microbench
+{
+  double min_time;
+  mt19937 gen { 1 };
+  vector<measure> results;
+
+  void report(const string& name, unsigned box, unsigned patch, double ns,
+              size_t bytes)
+  {
+    results.push_back({ name, box, patch, ns, bytes/ns });
+    const auto& r = results.back();
+    cout << "  " << setw(24) << left << r.name << right
+         << setw(6) << r.box << setw(6) << r.patch
+         << setw(12) << fixed << setprecision(3) << r.ns_per_op;
+    if(bytes) cout << setw(12) << setprecision(2) << r.gb_per_s;
+    else      cout << setw(12) << "-";
+    cout << defaultfloat << '\n';
+  }
+
+  vector<double> random_field(size_t n)
+  {
+    uniform_real_distribution<double> dist(0, 1);
+    vector<double> f(n);
+    for(auto& v : f) v = dist(gen);
+    return f;
+  }
+
+  /** Derivatives and laplacian over a stencil table */
+  void stencils(const string& which, const vector<stencil>& s, unsigned box,
+                unsigned patch)
+  {
+    const size_t n = s.size();
+    auto f = random_field(n);
+    vector<double> out(n);
+
+    // two (seven) values and their indices read, one value written
+    const size_t deriv_bytes = 2*sizeof(double) + 2*sizeof(unsigned) + sizeof(double);
+    const size_t lapl_bytes  = 7*sizeof(double) + 7*sizeof(unsigned) + sizeof(double);
+
+    const auto run = [&](const string& name, size_t bytes, double (*op)(double*, const stencil&)) {
+      const double ns = time_per_op([&] {
+        for(size_t k=0; k<n; ++k) out[k] = op(f.data(), s[k]);
+        sink = sink + out[n/2];
+      }, n, min_time);
+      report(name + " " + which, box, patch, ns, bytes);
+    };
+    run("derivX",    deriv_bytes, derivX);
+    run("derivY",    deriv_bytes, derivY);
+    run("derivZ",    deriv_bytes, derivZ);
+    run("laplacian", lapl_bytes,  laplacian);
+  }
+
+  /** Index mapping between patches and domain */
+  void mapping(Model& model, unsigned box, unsigned patch)
+  {
+    const unsigned ncells = 16;
+    const auto& Size = model.Size;
+    const auto& patch_size = model.patch_size;
+    model.patch_min.resize(ncells);
+    model.offset.resize(ncells);
+    for(unsigned n=0; n<ncells; ++n)
+      for(unsigned d=0; d<3; ++d)
+      {
+        model.patch_min[n][d] = gen()%Size[d];
+        model.offset[n][d] = gen()%patch_size[d];
+      }
+
+    const size_t nops = size_t(ncells)*model.patch_N;
+    vector<coord> pos(nops);
+    for(unsigned n=0; n<ncells; ++n)
+      for(unsigned q=0; q<model.patch_N; ++q)
+        pos[size_t(n)*model.patch_N + q] = model.GetNodePosOnDomain(n, q);
+
+    double ns = time_per_op([&] {
+      size_t s = 0;
+      for(unsigned n=0; n<ncells; ++n)
+        for(unsigned q=0; q<model.patch_N; ++q)
+          s += model.GetIndexFromPatch(n, q);
+      sink = sink + s;
+    }, nops, min_time);
+    report("GetIndexFromPatch", box, patch, ns, 0);
+
+    ns = time_per_op([&] {
+      size_t s = 0;
+      for(unsigned n=0; n<ncells; ++n)
+        for(unsigned q=0; q<model.patch_N; ++q)
+        {
+          const coord p = model.GetNodePosOnDomain(n, q);
+          s += p[0] + p[1] + p[2];
+        }
+      sink = sink + s;
+    }, nops, min_time);
+    report("GetNodePosOnDomain", box, patch, ns, 0);
+
+    ns = time_per_op([&] {
+      size_t s = 0;
+      for(unsigned n=0; n<ncells; ++n)
+        for(unsigned q=0; q<model.patch_N; ++q)
+          s += model.GetPatchIndex(n, pos[size_t(n)*model.patch_N + q]);
+      sink = sink + s;
+    }, nops, min_time);
+    report("GetPatchIndex", box, patch, ns, sizeof(coord));
+  }
+
+  /** Operations on vec<double, 3> */
+  void vectors(size_t n, unsigned box)
+  {
+    using vec3 = vec<double, 3>;
+    const auto fa = random_field(3*n), fb = random_field(3*n);
+    vector<vec3> a(n), b(n), c(n);
+    for(size_t i=0; i<n; ++i)
+    {
+      a[i] = { fa[3*i], fa[3*i+1], fa[3*i+2] };
+      b[i] = { fb[3*i], fb[3*i+1], fb[3*i+2] };
+    }
+
+    double ns = time_per_op([&] {
+      for(size_t i=0; i<n; ++i) c[i] = a[i] + b[i];
+      sink = sink + c[n/2][0];
+    }, n, min_time);
+    report("vec add", box, 0, ns, 3*sizeof(vec3));
+
+    ns = time_per_op([&] {
+      double s = 0;
+      for(size_t i=0; i<n; ++i) s += a[i]*b[i];
+      sink = sink + s;
+    }, n, min_time);
+    report("vec dot", box, 0, ns, 2*sizeof(vec3));
+
+    ns = time_per_op([&] {
+      double s = 0;
+      for(size_t i=0; i<n; ++i) s += sqrt(a[i].abs());
+      sink = sink + s;
+    }, n, min_time);
+    report("vec norm", box, 0, ns, sizeof(vec3));
+  }
+
+  /** Stress integration over the whole domain */
+  void stress(const Model& model, unsigned box)
+  {
+    const size_t N = model.N;
+    auto vx = random_field(N), vy = random_field(N), vz = random_field(N);
+    vector<double> sxx(N), sxy(N), sxz(N), syy(N), syz(N), szz(N);
+
+    const double ns = time_per_op([&] {
+      for(unsigned k=0; k<N; ++k)
+        integrate_stress(k, model.Size, 1., vx.data(), vy.data(), vz.data(),
+                         sxx.data(), sxy.data(), sxz.data(),
+                         syy.data(), syz.data(), szz.data());
+      sink = sink + sxx[N/2];
+    }, N, min_time);
+    // eight velocities read, six components read and written
+    report("stress 2x2x2", box, 0, ns, 8*3*sizeof(double) + 6*2*sizeof(double));
+  }
+
+public:
+  explicit microbench(double min_time)
+    : min_time(min_time)
+  {}
+
+  void run(const vector<unsigned>& boxes, const vector<unsigned>& margins)
+  {
+    cout << "  " << setw(24) << left << "benchmark" << right
+         << setw(6) << "box" << setw(6) << "patch"
+         << setw(12) << "ns/op" << setw(12) << "GB/s" << '\n';
+
+    for(const auto L : boxes)
+    {
+      Model model;
+      model.Size = { L, L, L };
+      model.margin = margins.empty() ? 1 : margins.front();
+      model.ComputeSizes();
+      model.InitializeNeighbors();
+
+      stencils("global", model.neighbors, L, 0);
+      vectors(model.N, L);
+      stress(model, L);
+
+      for(const auto M : margins)
+      {
+        model.margin = M;
+        model.ComputeSizes();
+        model.InitializeNeighbors();
+        stencils("patch", model.neighbors_patch, L, model.patch_size[0]);
+        mapping(model, L, model.patch_size[0]);
+      }
+    }
+  }
+
+  void write_json(const string& fname) const
+  {
+    ofstream file(fname);
+    if(!file.good()) throw error_msg("can not open file ", fname, ".");
+    file << setprecision(9) << "[";
+    for(unsigned k=0; k<results.size(); ++k)
+    {
+      const auto& r = results[k];
+      file << (k ? ",\n" : "\n") << "  { \"benchmark\": \"" << r.name << "\""
+           << ", \"box\": " << r.box
+           << ", \"patch\": " << r.patch
+           << ", \"ns_per_op\": " << r.ns_per_op
+           << ", \"gb_per_s\": " << r.gb_per_s << " }";
+    }
+    file << "\n]\n";
+  }
+};
+
+int main(int argc, char **argv)
+{
+  vector<unsigned> boxes, margins;
+  double min_time;
+  string output;
+
+  opt::options_description options("Options");
+  options.add_options()
+    ("help,h", "produce help message")
+    ("box,b", opt::value<vector<unsigned>>(&boxes)->multitoken(),
+     "sizes of the cubic boxes (default: 32 64 128)")
+    ("margin,m", opt::value<vector<unsigned>>(&margins)->multitoken(),
+     "patch margins (default: 8 12 16)")
+    ("min-time", opt::value<double>(&min_time)->default_value(.2),
+     "minimal time spent on each benchmark (in seconds)")
+    ("output,o", opt::value<string>(&output),
+     "write the results to a json file");
+
+  try
+  {
+    opt::variables_map vm;
+    opt::store(opt::parse_command_line(argc, argv, options), vm);
+    opt::notify(vm);
+    if(vm.count("help"))
+    {
+      cout << options << endl;
+      return 0;
+    }
+    if(boxes.empty()) boxes = { 32, 64, 128 };
+    if(margins.empty()) margins = { 8, 12, 16 };
+    for(const auto L : boxes)
+      if(L<4) throw error_msg("boxes must be at least 4 nodes wide.");
+
+    microbench bench(min_time);
+    bench.run(boxes, margins);
+    if(!output.empty()) bench.write_json(output);
+  }
+  catch(const error_msg& e) {
+    cerr << argv[0] << ": error: " << e.what() << endl;
+    return 1;
+  }
+  catch(const exception& e) {
+    cerr << argv[0] << ": " << e.what() << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,372 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** celadro_oracle
+  *
+  * Checks the device update against the scalar reference implementation (see
+  * reference.cpp) on small random configurations. Every substep starts from
+  * the state of the device: the reference update is performed on the host
+  * copy, then the device performs the same substep and both states are
+  * compared field by field, such that errors do not accumulate. The division
+  * split is checked in the same way at the end of every configuration.
+  *
+  * The error of a field is max|device - reference| / max|reference|, and a
+  * field fails if its error is above its tolerance. The noise on the
+  * polarisation is switched off. Usage:
+  *
+  *   celadro_oracle [--configs N] [--substeps N] [--seed S] [--rtol TOL]
+  *                  [--tol FIELD=TOL]...
+  *
+  * The device does not add the contributions in the order of the reference:
+  * the node fields are sums over the overlapping cells and the per-cell
+  * quantities sums over the patches, both with atomicAdd in no fixed order,
+  * and nvcc contracts products into fused multiply-adds. The default
+  * tolerances (see default_tolerance()) bound the resulting roundings:
+  *
+  *   1e-12  node fields, patch fields, volumes and the division split
+  *   1e-10  sums over a patch without cancellation (com_x, com, ...) and
+  *          the polarisation
+  *   1e-8   sums over a patch that largely cancel (Fpressure, vorticity,
+  *          delta_theta_pol, cS**) and the velocity
+  *   0      integer fields (patch_min, patch_max, offset)
+  *
+  * These are bounds derived from the number and size of the terms, with a
+  * margin of about 100, not errors measured on a given device. --rtol replaces
+  * all of them, --tol replaces the tolerance of a single field.
+  *
+  * Returns 1 if any field fails.
+  * */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include <boost/program_options.hpp>
+#include <dirent.h>
+#include <unistd.h>
+#include "header.hpp"
+#include "model.hpp"
+#include "celadro.hpp"
+
+using namespace std;
+namespace opt = boost::program_options;
+
+/** Largest error of a field over the substeps of a configuration */
+struct field_error
+{
+  double error = 0;
+  unsigned substep = 0;
+};
+
+/** Relative error between two copies of a field */
+static double relative_error(const field& dev, const field& ref)
+{
+  if(dev.size()!=ref.size()) return numeric_limits<double>::infinity();
+
+  double diff = 0, scale = 0;
+  for(size_t i=0; i<ref.size(); ++i)
+  {
+    // nan compares false: catch it explicitly
+    const double d = abs(dev[i] - ref[i]);
+    if(!isfinite(d)) return numeric_limits<double>::infinity();
+    diff  = max(diff, d);
+    scale = max(scale, abs(ref[i]));
+  }
+  return scale>0 ? diff/scale : diff;
+}
+
+/** Remove a scratch directory and its content (no sub-directories) */
+static void remove_scratch(const string& dir)
+{
+  if(DIR *d = opendir(dir.c_str()))
+  {
+    while(const dirent *e = readdir(d))
+    {
+      const string name = e->d_name;
+      if(name!="." and name!="..") remove((dir + "/" + name).c_str());
+    }
+    closedir(d);
+  }
+  rmdir(dir.c_str());
+}
+
+/** Default tolerance of a field (see the top of the file) */
+static double default_tolerance(const string& name)
+{
+  static const map<string, double> defaults = {
+    { "com_x", 1e-10 }, { "com_y", 1e-10 }, { "com_z", 1e-10 },
+    { "com", 1e-10 },
+    { "theta_pol", 1e-10 }, { "theta_pol_old", 1e-10 },
+    { "polarization", 1e-10 }, { "Fpol", 1e-10 },
+    { "Fpressure", 1e-8 }, { "vorticity", 1e-8 }, { "delta_theta_pol", 1e-8 },
+    { "cSxx", 1e-8 }, { "cSxy", 1e-8 }, { "cSxz", 1e-8 },
+    { "cSyy", 1e-8 }, { "cSyz", 1e-8 }, { "cSzz", 1e-8 },
+    { "velocity", 1e-8 },
+    { "patch_min", 0 }, { "patch_max", 0 }, { "offset", 0 },
+  };
+  const auto it = defaults.find(name);
+  return it==defaults.end() ? 1e-12 : it->second;
+}
+
+class oracle
+{
+  mt19937 gen;
+  unsigned substeps;
+  double rtol;
+  map<string, double> tolerances;
+  bool verbose;
+  unsigned failures = 0;
+
+  double tolerance(const string& name) const
+  {
+    const auto it = tolerances.find(name);
+    if(it!=tolerances.end()) return it->second;
+    return rtol<0 ? default_tolerance(name) : rtol;
+  }
+
+  /** Random small configuration */
+  celadro::parameters random_parameters(vector<celadro::coord>& cells)
+  {
+    uniform_int_distribution<unsigned> box(24, 40), count(2, 6);
+    const unsigned LX = box(gen), LY = box(gen), LZ = box(gen)/2 + 8;
+    const unsigned bc = gen()%2 ? 2 : 0;
+
+    celadro::parameters p;
+    p.set("config", "input const")
+     .set("LX", LX).set("LY", LY).set("LZ", LZ).set("bc", bc)
+     .set("nsteps", 1).set("ninfo", 1).set("nsubsteps", 5).set("npc", 1)
+     .set("relax-time", 0)
+     .set("margin", 10)
+     .set("gamma", 0.006)
+     .set("mu", 45)
+     .set("lambda", 3)
+     .set("kappa_cc", 0.5)
+     .set("R", 6)
+     .set("xi", 1)
+     .set("omega_cc", 0.0002)
+     .set("wall-thickness", 5)
+     .set("kappa_cs", 0.15)
+     .set("omega_cs", 0.002)
+     .set("alpha", 0.15)
+     .set("S-pol", 1)
+     .set("D-pol", 0)
+     .set("J-pol", 0.1)
+     .set("K-pol", 0.05)
+     .set("zetaS", 0).set("zetaQ", 0)
+     .set("S-nem", 0).set("K-nem", 0).set("J-nem", 0).set("W-nem", 0)
+     .set("proliferate", "false")
+     .set("prolif_start", 0)
+     .set("prolif_freq_mean", 1500)
+     .set("prolif_freq_std", 0.)
+     .set("time_corr_OU", 25)
+     .set("sigma_OU", 50)
+     .set("seed", gen());
+
+    // cells anywhere above the wall, overlapping or not
+    cells.resize(count(gen));
+    for(auto& c : cells)
+      c = { unsigned(gen()%LX), unsigned(gen()%LY), 8 + unsigned(gen()%(LZ-12)) };
+    p.set("nphases_init", cells.size())
+     .set("nphases_max", 2*cells.size() + 2);
+    return p;
+  }
+
+  void check(const string& name, double error, unsigned substep,
+             map<string, field_error>& errors)
+  {
+    auto& e = errors[name];
+    if(error>e.error or !isfinite(error)) e = { error, substep };
+  }
+
+  void report(const map<string, field_error>& errors)
+  {
+    for(const auto& e : errors)
+    {
+      const bool fail = !(e.second.error<=tolerance(e.first));
+      failures += fail;
+      if(!fail and !verbose) continue;
+      cout << "  " << setw(18) << left << e.first << right
+           << setw(14) << scientific << setprecision(3) << e.second.error
+           << defaultfloat << "  (substep " << e.second.substep << ")"
+           << (fail ? "  FAIL" : "") << '\n';
+    }
+  }
+
+  /** Run one configuration in the current directory */
+  void run(unsigned config)
+  {
+    vector<celadro::coord> cells;
+    const auto params = random_parameters(cells);
+    {
+      ofstream file("input_str.dat");
+      for(const auto& c : cells) file << c[0] << ' ' << c[1] << ' ' << c[2] << '\n';
+    }
+
+    // same set-up as celadro::simulation
+    Model model;
+    model.runcard = params.runcard();
+    vector<string> args = { "celadro", "--verbose=0", "--no-write" };
+    vector<char*> argv;
+    for(auto& a : args) argv.push_back(&a[0]);
+    model.ParseProgramOptions(argv.size(), argv.data());
+    model.SetupModel();
+    model.Pre();
+    model.GetFromDevice();
+
+    cout << "configuration " << config << ": " << model.Size[0] << "x"
+         << model.Size[1] << "x" << model.Size[2] << ", bc=" << model.BC
+         << ", " << cells.size() << " cells" << endl;
+
+    map<string, field_error> errors;
+    for(unsigned s=0; s<substeps; ++s)
+    {
+      const bool store = s%(model.npc+1)==0;
+
+      model.ReferenceUpdate(store);
+      const auto ref = model.ReferenceState();
+      // starts from the device memory and copies it back to the host
+      model.Update(store, s%(model.npc+1)==model.npc, s);
+      const auto dev = model.ReferenceState();
+
+      for(unsigned i=0; i<ref.size(); ++i)
+        check(ref[i].first, relative_error(dev[i].second, ref[i].second), s, errors);
+    }
+
+    // division split of every cell, in a random direction
+    const unsigned ncells = model.nphases_index.size();
+    uniform_real_distribution<double> angle(0, 2*Pi);
+    for(unsigned n=0; n<ncells; ++n)
+    {
+      const double direction = angle(gen);
+      model.BirthCellMemories(ncells + 2);
+      model.SplitCell(n, ncells + 1, direction);
+      const auto ref = model.ReferenceSplit(n, direction);
+      check("split", max(relative_error(model.phi[ncells + 1], ref[0]),
+                         relative_error(model.phi[ncells], ref[1])), substeps, errors);
+      check("split phi_old", max(relative_error(model.phi_old[ncells + 1], ref[0]),
+                                 relative_error(model.phi_old[ncells], ref[1])), substeps, errors);
+    }
+    model.BirthCellMemories(ncells);
+
+    report(errors);
+    model.Cleanup();
+  }
+
+public:
+  oracle(unsigned seed, unsigned substeps, double rtol,
+         const map<string, double>& tolerances, bool verbose)
+    : gen(seed), substeps(substeps), rtol(rtol), tolerances(tolerances),
+      verbose(verbose)
+  {}
+
+  /** Run n configurations in a scratch directory, returns the number of
+   * fields that failed */
+  unsigned run_all(unsigned n)
+  {
+    // the initial configuration is read from the working directory, and some
+    // files are written there whatever the options
+    char tmpl[] = "/tmp/celadro_oracle_XXXXXX";
+    const char* dir = mkdtemp(tmpl);
+    if(!dir) throw error_msg("can not create a scratch directory.");
+    char cwd[4096];
+    if(!getcwd(cwd, sizeof(cwd)) or chdir(dir))
+      throw error_msg("can not change to the scratch directory.");
+
+    try
+    {
+      for(unsigned c=0; c<n; ++c) run(c);
+    }
+    catch(...)
+    {
+      if(chdir(cwd)) {}
+      remove_scratch(dir);
+      throw;
+    }
+    if(chdir(cwd)) throw error_msg("can not change back to ", cwd, ".");
+    remove_scratch(dir);
+    return failures;
+  }
+};
+
+int main(int argc, char **argv)
+{
+  unsigned configs, substeps, seed;
+  // negative: default tolerance of each field
+  double rtol = -1;
+  vector<string> tols;
+
+  opt::options_description options("Options");
+  options.add_options()
+    ("help,h", "produce help message")
+    ("verbose,v", "print the errors of all the fields")
+    ("configs,c", opt::value<unsigned>(&configs)->default_value(4u),
+     "number of random configurations")
+    ("substeps,n", opt::value<unsigned>(&substeps)->default_value(10u),
+     "number of substeps compared for each configuration")
+    ("seed", opt::value<unsigned>(&seed)->default_value(1u),
+     "seed of the random configurations")
+    ("rtol", opt::value<double>(&rtol),
+     "tolerance on the relative error of all the fields (default: 1e-12 "
+     "for node and patch fields, up to 1e-8 for per-cell sums, see the "
+     "sources)")
+    ("tol", opt::value<vector<string>>(&tols)->multitoken(),
+     "tolerance of a given field (FIELD=TOL)");
+
+  try
+  {
+    opt::variables_map vm;
+    opt::store(opt::parse_command_line(argc, argv, options), vm);
+    opt::notify(vm);
+    if(vm.count("help"))
+    {
+      cout << options << endl;
+      return 0;
+    }
+
+    map<string, double> tolerances;
+    for(const auto& t : tols)
+    {
+      const auto eq = t.find('=');
+      if(eq==string::npos) throw error_msg("invalid tolerance ", t, " (FIELD=TOL).");
+      tolerances[t.substr(0, eq)] = stod(t.substr(eq+1));
+    }
+
+    oracle o(seed, substeps, rtol, tolerances, vm.count("verbose"));
+    const unsigned failures = o.run_all(configs);
+    if(failures)
+    {
+      cout << failures << " field(s) above tolerance" << endl;
+      return 1;
+    }
+    cout << "all fields within tolerance" << endl;
+  }
+  catch(const error_msg& e) {
+    cerr << argv[0] << ": error: " << e.what() << endl;
+    return 1;
+  }
+  catch(const exception& e) {
+    cerr << argv[0] << ": " << e.what() << endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,456 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** celadro-reconstruct
+  *
+  * Rebuilds the full-domain fields from the patches stored in an archive: the
+  * sum of all phase fields, a label field (persistent id of the dominant cell,
+  * -1 where no cell is above threshold) and the extent of each cell. Frames
+  * are processed in parallel and written as binary vtk or raw arrays. Both
+  * json frames (any output precision) and delta archives are supported.
+  * */
+
+#include "host_header.hpp"
+#include "files.hpp"
+#include "delta.hpp"
+#include "patch.hpp"
+#include "precision.hpp"
+#include "json.hpp"
+#include <cstring>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+namespace opt = boost::program_options;
+
+// =============================================================================
+// Archive
+
+/** Description of an archive */
+struct archive_info
+{
+  /** Path of the archive (with trailing slash) */
+  string path;
+  /** Size of the domain and of the patches */
+  delta_coord Size, patch_size;
+  /** Times of the frames */
+  vector<unsigned> times;
+  /** Are the phase fields stored in a delta archive? */
+  bool delta = false;
+};
+
+/** Value of an entry of the archive */
+static const json_value& value(const json_value& data, const string& name)
+{
+  return data[name]["value"];
+}
+
+static delta_coord to_coord(const json_value& v)
+{
+  const auto& n = v.as_numbers();
+  if(n.size()!=3) throw error_msg("expected a triplet.");
+  return { unsigned(n[0]), unsigned(n[1]), unsigned(n[2]) };
+}
+
+static archive_info open_archive(string path, unsigned from, unsigned to)
+{
+  archive_info ar;
+  if(!path.empty() and path.back()!='/') path += '/';
+  ar.path = path;
+
+  if(ifstream(path + "parameters.json.zip").good() or
+     ifstream(path.substr(0, path.size()-1) + ".zip").good())
+    throw error_msg("compressed archives are not supported, please unzip first.");
+
+  const auto params = read_json_file(path + "parameters.json");
+  const auto& data = params["data"];
+  ar.Size       = to_coord(value(data, "Size"));
+  ar.patch_size = to_coord(value(data, "patch_size"));
+
+  const unsigned nstart = value(data, "nstart").as_number();
+  const unsigned nsteps = value(data, "nsteps").as_number();
+  const unsigned ninfo  = value(data, "ninfo").as_number();
+  for(unsigned t=nstart; t<=nsteps; t+=ninfo)
+    if(t>=from and t<=to and ifstream(inline_str(path, "frame", t, ".json")).good())
+      ar.times.push_back(t);
+
+  ar.delta = ifstream(path + "frames.bin").good();
+  return ar;
+}
+
+/** Decoder for the innermost arrays of a field (see precision.hpp) */
+struct leaf_decoder
+{
+  enum { plain, half, fixed } mode = plain;
+  /** Type of the fixed-point words */
+  string word;
+  double offset = 0, step = 1;
+
+  explicit leaf_decoder(string type)
+  {
+    while(type.compare(0, 6, "array(")==0) type = type.substr(6, type.size()-7);
+    if(type=="double" or type=="float") return;
+
+    if(type.compare(0, 7, "base64(")==0) type = type.substr(7, type.size()-8);
+    if(type=="float16") mode = half;
+    else if(type.compare(0, 6, "fixed(")==0)
+    {
+      mode = fixed;
+      char w[16];
+      if(sscanf(type.c_str(), "fixed(%lf,%lf,%15[^)])", &offset, &step, w)!=3)
+        throw error_msg("invalid type ", type, ".");
+      word = w;
+      if(word!="uint8" and word!="uint16" and word!="int32")
+        throw error_msg("unsupported fixed-point words ", word, ".");
+    }
+    else throw error_msg("unsupported field type ", type, ".");
+  }
+
+  /** Copy the words packed in bytes */
+  template<class W>
+  static vector<W> words(const vector<unsigned char>& bytes)
+  {
+    vector<W> w(bytes.size()/sizeof(W));
+    memcpy(w.data(), bytes.data(), w.size()*sizeof(W));
+    return w;
+  }
+
+  /** Values of an innermost array */
+  vector<double> operator()(const json_value& v) const
+  {
+    if(mode==plain) return v.as_numbers();
+
+    const auto bytes = base64_decode(v.str);
+    vector<double> values;
+    if(mode==half)
+      for(const auto h : words<uint16_t>(bytes)) values.push_back(half_to_float(h));
+    else if(word=="uint8")
+      for(const auto q : words<uint8_t>(bytes)) values.push_back(offset + step*q);
+    else if(word=="uint16")
+      for(const auto q : words<uint16_t>(bytes)) values.push_back(offset + step*q);
+    else
+      for(const auto q : words<int32_t>(bytes)) values.push_back(offset + step*q);
+    return values;
+  }
+};
+
+/** Read the phase fields and patch positions from a json frame */
+static void read_json_frame(const archive_info& ar, unsigned t, delta_frame& f)
+{
+  const auto frame = read_json_file(inline_str(ar.path, "frame", t, ".json"));
+  const auto& data = frame["data"];
+
+  f.time = t;
+  f.phi.clear();
+  f.ids.clear();
+  f.patch_min.clear();
+  f.offset.clear();
+
+  const auto& phi = data["phi"];
+  const leaf_decoder decode(phi["type"].str);
+  const auto& cells = phi["value"];
+  for(size_t i=0; i<cells.size(); ++i)
+  {
+    f.phi.push_back(cells.type==json_value::kind::array
+                    ? decode(cells[i]) : vector<double>());
+  }
+
+  const auto& pmin = value(data, "patch_min");
+  const auto& off  = value(data, "offset");
+  for(size_t i=0; i<f.phi.size(); ++i)
+  {
+    f.patch_min.push_back(to_coord(pmin[i]));
+    f.offset.push_back(to_coord(off[i]));
+  }
+
+  // persistent indices are only written with an output selection
+  if(const auto idx = data.find("cell_index"))
+    for(const auto i : (*idx)["value"].as_numbers()) f.ids.push_back(i);
+  else
+    for(unsigned i=0; i<f.phi.size(); ++i) f.ids.push_back(i);
+}
+
+// =============================================================================
+// Reconstruction
+
+/** Extent of a cell (unwrapped domain coordinates, may exceed Size) */
+struct cell_extent
+{
+  unsigned id;
+  double volume = 0;
+  delta_coord min, max;
+  bool empty = true;
+};
+
+/** Full-domain fields of a frame */
+struct reconstruction
+{
+  vector<float> sum, maxphi;
+  vector<int32_t> label;
+  vector<cell_extent> cells;
+};
+
+static void reconstruct(const archive_info& ar, const delta_frame& f,
+                        double threshold, reconstruction& r)
+{
+  const size_t N = size_t(ar.Size[0])*ar.Size[1]*ar.Size[2];
+  const size_t patch_N = size_t(ar.patch_size[0])*ar.patch_size[1]*ar.patch_size[2];
+
+  r.sum.assign(N, 0.f);
+  r.maxphi.assign(N, 0.f);
+  r.label.assign(N, -1);
+  r.cells.assign(f.phi.size(), cell_extent());
+
+  for(size_t n=0; n<f.phi.size(); ++n)
+  {
+    const auto& phi = f.phi[n];
+    if(phi.size()!=patch_N)
+      throw error_msg("wrong patch size in frame ", f.time, ".");
+
+    auto& c = r.cells[n];
+    c.id = f.ids[n];
+
+    for(size_t q=0; q<patch_N; ++q)
+    {
+      const double p = phi[q];
+      const auto k = domain_index_from_patch(q, ar.patch_size, f.offset[n],
+                                             f.patch_min[n], ar.Size);
+      r.sum[k] += p;
+      c.volume += p;
+
+      if(p<=threshold) continue;
+      if(p>r.maxphi[k])
+      {
+        r.maxphi[k] = p;
+        r.label[k] = c.id;
+      }
+
+      const auto u = unwrapped_patch_position(q, ar.patch_size, f.offset[n]);
+      for(unsigned d=0; d<3; ++d)
+      {
+        const unsigned x = u[d] + f.patch_min[n][d];
+        if(c.empty or x<c.min[d]) c.min[d] = x;
+        if(c.empty or x>c.max[d]) c.max[d] = x;
+      }
+      c.empty = false;
+    }
+  }
+}
+
+// =============================================================================
+// Output
+
+/** Write values in big endian order (legacy vtk binary format) */
+template<class T>
+static void write_big_endian(ostream& stream, const vector<T>& v)
+{
+  static_assert(sizeof(T)==4, "only 32 bits values are supported");
+  vector<char> buf(v.size()*4);
+  for(size_t i=0; i<v.size(); ++i)
+  {
+    uint32_t x;
+    memcpy(&x, &v[i], 4);
+    for(unsigned b=0; b<4; ++b) buf[4*i+b] = char((x>>(24-8*b))&0xff);
+  }
+  stream.write(buf.data(), buf.size());
+}
+
+static void write_vtk(const archive_info& ar, const string& fname,
+                      const reconstruction& r)
+{
+  ofstream stream(fname, ios::out | ios::binary);
+  if(!stream.good()) throw error_msg("can not open output file ", fname, ".");
+
+  // same axis order as the memory layout (y runs fastest), as the python
+  // scripts do
+  stream << "# vtk DataFile Version 3.0\n"
+         << "celadro reconstruction\n"
+         << "BINARY\n"
+         << "DATASET STRUCTURED_POINTS\n"
+         << "DIMENSIONS " << ar.Size[1] << ' ' << ar.Size[0] << ' ' << ar.Size[2] << '\n'
+         << "ORIGIN 0 0 0\n"
+         << "SPACING 1 1 1\n"
+         << "POINT_DATA " << r.sum.size() << '\n'
+         << "SCALARS phi_sum float 1\n"
+         << "LOOKUP_TABLE default\n";
+  write_big_endian(stream, r.sum);
+  stream << "\nSCALARS label int 1\n"
+         << "LOOKUP_TABLE default\n";
+  write_big_endian(stream, r.label);
+  stream << '\n';
+
+  if(!stream.good()) throw error_msg("error while writing ", fname, ".");
+}
+
+template<class T>
+static void write_raw(const string& fname, const vector<T>& v)
+{
+  ofstream stream(fname, ios::out | ios::binary);
+  stream.write(reinterpret_cast<const char*>(v.data()), v.size()*sizeof(T));
+  if(!stream.good()) throw error_msg("error while writing ", fname, ".");
+}
+
+static void write_cells(const string& fname, const reconstruction& r)
+{
+  ofstream stream(fname);
+  if(!stream.good()) throw error_msg("can not open output file ", fname, ".");
+
+  stream << "# id volume xmin xmax ymin ymax zmin zmax\n";
+  for(const auto& c : r.cells)
+  {
+    stream << c.id << ' ' << c.volume;
+    for(unsigned d=0; d<3; ++d)
+      if(c.empty) stream << " -1 -1";
+      else stream << ' ' << c.min[d] << ' ' << c.max[d];
+    stream << '\n';
+  }
+}
+
+// =============================================================================
+// Main
+
+int main(int argc, char **argv)
+{
+  string input, output, format;
+  double threshold;
+  unsigned from, to, nthreads;
+
+  opt::options_description options("Options");
+  options.add_options()
+    ("help,h", "produce help message")
+    ("output,o", opt::value<string>(&output),
+     "output directory (default: archive + _reconstructed)")
+    ("format,f", opt::value<string>(&format)->default_value("vtk"),
+     "output format: vtk (binary) or raw (native float32 and int32 arrays)")
+    ("threshold", opt::value<double>(&threshold)->default_value(.5),
+     "value of phi above which a node belongs to a cell")
+    ("from", opt::value<unsigned>(&from)->default_value(0u),
+     "first time to reconstruct")
+    ("to", opt::value<unsigned>(&to)->default_value(-1u),
+     "last time to reconstruct")
+    ("threads,t", opt::value<unsigned>(&nthreads)->default_value(0u),
+     "number of threads (0=OpenMP default)");
+
+  opt::options_description hidden("Hidden");
+  hidden.add_options()
+    ("input", opt::value<string>(&input), "archive");
+  opt::positional_options_description positional;
+  positional.add("input", 1);
+
+  opt::options_description all;
+  all.add(options).add(hidden);
+
+  try
+  {
+    opt::variables_map vm;
+    opt::store(opt::command_line_parser(argc, argv).options(all)
+               .positional(positional).run(), vm);
+    opt::notify(vm);
+
+    if(vm.count("help") or input.empty())
+    {
+      cout << "Usage: " << argv[0] << " [options] archive\n\n" << options << endl;
+      return vm.count("help") ? 0 : 1;
+    }
+    if(format!="vtk" and format!="raw")
+      throw error_msg("unknown output format ", format, ".");
+
+    const auto ar = open_archive(input, from, to);
+    if(ar.times.empty()) throw error_msg("no frame found in ", input, ".");
+
+    if(output.empty())
+    {
+      output = ar.path.substr(0, ar.path.size()-1);
+      output = (output.empty() or output==".") ? "reconstructed"
+                                               : output + "_reconstructed";
+    }
+    if(output.back()!='/') output += '/';
+    create_directory(output);
+
+    if(format=="raw")
+    {
+      ofstream info(output + "raw.txt");
+      info << "memory order (z, x, y), y runs fastest\n"
+           << "Size " << ar.Size[0] << ' ' << ar.Size[1] << ' ' << ar.Size[2] << '\n'
+           << "phi_sum<t>.raw float32\nlabel<t>.raw int32\n";
+    }
+
+#ifdef _OPENMP
+    if(nthreads) omp_set_num_threads(nthreads);
+#endif
+
+    const long nframes = ar.times.size();
+    string error;
+
+    #pragma omp parallel
+    {
+      // every thread reads a contiguous range of frames from the delta
+      // archive, such that each frame is decoded from the previous one
+      unique_ptr<deltareader> delta;
+      delta_frame frame;
+      reconstruction r;
+
+      #pragma omp for schedule(static)
+      for(long i=0; i<nframes; ++i)
+      {
+        try
+        {
+          const unsigned t = ar.times[i];
+          if(ar.delta)
+          {
+            if(!delta) delta.reset(new deltareader(ar.path + "frames.bin"));
+            frame = delta->read_time(t);
+          }
+          else read_json_frame(ar, t, frame);
+
+          reconstruct(ar, frame, threshold, r);
+
+          if(format=="vtk")
+            write_vtk(ar, inline_str(output, "frame", t, ".vtk"), r);
+          else
+          {
+            write_raw(inline_str(output, "phi_sum", t, ".raw"), r.sum);
+            write_raw(inline_str(output, "label", t, ".raw"), r.label);
+          }
+          write_cells(inline_str(output, "cells", t, ".dat"), r);
+        }
+        catch(const exception& e)
+        {
+          #pragma omp critical
+          if(error.empty()) error = e.what();
+        }
+        catch(const error_msg& e)
+        {
+          #pragma omp critical
+          if(error.empty()) error = e.what();
+        }
+      }
+    }
+
+    if(!error.empty()) throw error_msg(error);
+    cout << "reconstructed " << nframes << " frames to " << output << endl;
+  }
+  catch(const error_msg& e) {
+    cerr << argv[0] << ": error: " << e.what() << endl;
+    return 1;
+  }
+  catch(const exception& e) {
+    cerr << argv[0] << ": " << e.what() << endl;
+    return 1;
+  }
+  return 0;
+}
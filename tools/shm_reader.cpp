@@ -0,0 +1,105 @@
+/*
+ * This file is part of CELADRO-3D-CUDA, Copyright (C) 2024, Siavash Monfared
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** celadro-shm-reader
+  *
+  * Example consumer of the live frames published with --shm-name. Follows the
+  * simulation and prints, for every frame, the mean of a cell scalar and of
+  * the published global fields. Usage:
+  *
+  *   celadro-shm-reader NAME [cell scalar (default: vol)]
+  * */
+
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "error_msg.hpp"
+#include "shm.hpp"
+
+using namespace std;
+
+int main(int argc, char **argv)
+{
+  if(argc<2)
+  {
+    cerr << "Usage: " << argv[0] << " NAME [cell scalar]" << endl;
+    return 1;
+  }
+  const string column_name = argc>2 ? argv[2] : "vol";
+
+  try
+  {
+    // wait for the simulation to create the segment
+    unique_ptr<shm_consumer> shm;
+    while(!shm)
+    {
+      try { shm.reset(new shm_consumer(argv[1])); }
+      catch(const error_msg&) { this_thread::sleep_for(chrono::milliseconds(100)); }
+    }
+
+    const auto& h = shm->header();
+    const unsigned c = shm->column(column_name);
+    const size_t N = size_t(h.Size[0])*h.Size[1]*h.Size[2];
+
+    uint64_t next = 0;
+    for(;;)
+    {
+      const uint64_t last = shm->latest();
+      if(last<next or last==0)
+      {
+        if(shm->closed()) break;
+        this_thread::sleep_for(chrono::milliseconds(10));
+        continue;
+      }
+      // skip frames that have been overwritten already
+      if(next+h.nslots<=last+1 or next==0) next = last;
+
+      shm_frame f;
+      if(!shm->acquire(next, f)) { ++next; continue; }
+
+      // the data is read in place, and checked afterwards
+      double mean = 0;
+      for(unsigned i=0; i<f.ncells; ++i) mean += f.column(c)[i];
+      if(f.ncells) mean /= f.ncells;
+
+      ostringstream line;
+      line << "t = " << f.time << "  cells = " << f.ncells
+           << "  <" << column_name << "> = " << mean;
+      for(unsigned k=0; k<h.nfields; ++k)
+      {
+        double m = 0;
+        for(size_t i=0; i<N; ++i) m += f.field(k)[i];
+        line << "  <" << h.fields[k] << "> = " << m/N;
+      }
+
+      if(shm->still_valid(f)) cout << line.str() << endl;
+      else cout << "frame " << next << " overwritten while reading" << endl;
+      ++next;
+    }
+  }
+  catch(const error_msg& e) {
+    cerr << argv[0] << ": error: " << e.what() << endl;
+    return 1;
+  }
+  catch(const exception& e) {
+    cerr << argv[0] << ": " << e.what() << endl;
+    return 1;
+  }
+  return 0;
+}